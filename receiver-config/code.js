@@ -4,10 +4,38 @@ const CONFIG_VERSION = 2;
 const CONFIG_SIZE = 63;
 const REPORT_ID_CONFIG = 1;
 const REPORT_ID_COMMAND = 2;
+const REPORT_ID_LATENCY = 3;
+const REPORT_ID_STATS = 4;
+const REPORT_ID_FRAME_PHASE = 5;
 const COMMAND_PAIR_NEW_DEVICE = 1;
 const COMMAND_FORGET_ALL_DEVICES = 2;
+const COMMAND_RESET_LATENCY_HISTOGRAM = 3;
+const LATENCY_BUCKET0_US = 8;
+const FRAME_PHASE_BUCKET_US = 125;
+const TRANSPORT_NAMES = ["Serial", "Bluetooth", "WiFi"];
+const STATS_FIELDS = [
+    ["packets", "Packets"],
+    ["bytes", "Bytes"],
+    ["crc_errors", "CRC errors"],
+    ["framing_errors", "Framing errors"],
+    ["invalid_packets", "Invalid packets"],
+    ["queue_drops", "Queue drops"],
+    ["uart_overruns", "UART overruns"],
+    ["descriptor_switches", "Device type switches"],
+];
+// Come after uptime_ms in the report.
+const SEQUENCE_STATS_FIELDS = [
+    ["late_packets", "Late packets"],
+    ["recovered_packets", "Recovered packets"],
+];
+const STATS_POLL_INTERVAL = 1000; // ms
+
+let stats_timer = null;
+let prev_stats = null;
 const BLUETOOTH_ENABLED_FLAG_MASK = (1 << 0);
 const WIFI_ENABLED_FLAG_MASK = (1 << 1);
+const SOF_ALIGNED_FLAG_MASK = (1 << 2);
+const COMPOSITE_FLAG_MASK = (1 << 3);
 
 let device = null;
 
@@ -17,6 +45,9 @@ document.addEventListener("DOMContentLoaded", function () {
     document.getElementById("save_to_device").addEventListener("click", save_to_device);
     document.getElementById("pair_new_device").addEventListener("click", pair_new_device);
     document.getElementById("forget_all_devices").addEventListener("click", forget_all_devices);
+    document.getElementById("load_latency").addEventListener("click", load_latency);
+    document.getElementById("reset_latency").addEventListener("click", reset_latency);
+    document.getElementById("poll_stats_checkbox").addEventListener("change", poll_stats_changed);
 
     device_buttons_set_disabled_state(true);
 
@@ -84,6 +115,9 @@ async function load_from_device() {
         const flags = data.getUint8(pos++);
         document.getElementById("bluetooth_enabled_checkbox").checked = ((flags & BLUETOOTH_ENABLED_FLAG_MASK) != 0);
         document.getElementById("wifi_enabled_checkbox").checked = ((flags & WIFI_ENABLED_FLAG_MASK) != 0);
+        document.getElementById("sof_aligned_checkbox").checked = ((flags & SOF_ALIGNED_FLAG_MASK) != 0);
+        document.getElementById("composite_checkbox").checked = ((flags & COMPOSITE_FLAG_MASK) != 0);
+        document.getElementById("merge_policy_dropdown").value = data.getUint8(pos++);
     } catch (e) {
         display_error(e);
     }
@@ -127,9 +161,16 @@ async function save_to_device() {
         if (document.getElementById("wifi_enabled_checkbox").checked) {
             flags |= WIFI_ENABLED_FLAG_MASK;
         }
+        if (document.getElementById("sof_aligned_checkbox").checked) {
+            flags |= SOF_ALIGNED_FLAG_MASK;
+        }
+        if (document.getElementById("composite_checkbox").checked) {
+            flags |= COMPOSITE_FLAG_MASK;
+        }
         dataview.setUint8(pos++, flags);
+        dataview.setUint8(pos++, get_int("merge_policy_dropdown", "merge policy"));
 
-        for (let i = 0; i < 12; i++) {
+        for (let i = 0; i < 11; i++) {
             dataview.setUint8(pos++, 0);
         }
 
@@ -189,6 +230,13 @@ function device_buttons_set_disabled_state(state) {
     document.getElementById("save_to_device").disabled = state;
     document.getElementById("pair_new_device").disabled = state;
     document.getElementById("forget_all_devices").disabled = state;
+    document.getElementById("load_latency").disabled = state;
+    document.getElementById("reset_latency").disabled = state;
+    document.getElementById("poll_stats_checkbox").disabled = state;
+    if (state) {
+        document.getElementById("poll_stats_checkbox").checked = false;
+        poll_stats_changed();
+    }
 }
 
 async function send_feature_command(command) {
@@ -206,4 +254,190 @@ async function pair_new_device() {
 
 async function forget_all_devices() {
     await send_feature_command(COMMAND_FORGET_ALL_DEVICES);
-}
\ No newline at end of file
+}
+async function reset_latency() {
+    await send_feature_command(COMMAND_RESET_LATENCY_HISTOGRAM);
+    await load_latency();
+}
+
+function format_us(us) {
+    if (us >= 1000000) {
+        return (us / 1000000) + " s";
+    }
+    if (us >= 1000) {
+        return (us / 1000) + " ms";
+    }
+    return us + " \u00b5s";
+}
+
+async function load_latency() {
+    if (device == null) {
+        return;
+    }
+    clear_error();
+
+    try {
+        const data_with_report_id = await device.receiveFeatureReport(REPORT_ID_LATENCY);
+        const data = new DataView(data_with_report_id.buffer, 1);
+        check_crc(data);
+        let pos = 0;
+
+        const config_version = data.getUint8(pos++);
+        check_received_version(config_version);
+
+        const nbuckets = data.getUint8(pos++);
+        pos++;
+        const samples = data.getUint32(pos, true);
+        pos += 4;
+        const max_us = data.getUint32(pos, true);
+        pos += 4;
+        const mean_us = data.getUint32(pos, true);
+        pos += 4;
+        let buckets = [];
+        for (let i = 0; i < nbuckets; i++) {
+            buckets.push(data.getUint16(pos, true));
+            pos += 2;
+        }
+
+        let text = "reports: " + samples + ", mean: " + format_us(mean_us) + ", max: " + format_us(max_us) + "\n\n";
+        const total = buckets.reduce((a, b) => a + b, 0);
+        const first = buckets.findIndex(x => x > 0);
+        const last = buckets.findLastIndex(x => x > 0);
+        for (let i = first; (first >= 0) && (i <= last); i++) {
+            const low = (i == 0) ? 0 : (LATENCY_BUCKET0_US << (i - 1));
+            const label = (i == nbuckets - 1) ? ("\u2265 " + format_us(low)) : (format_us(low) + " - " + format_us(LATENCY_BUCKET0_US << i));
+            const percent = 100 * buckets[i] / total;
+            text += label.padStart(20) + " " + "#".repeat(Math.round(percent / 2)).padEnd(50) + " " + percent.toFixed(1).padStart(5) + "%\n";
+        }
+        text += "\n" + await load_frame_phase();
+        document.getElementById("latency_histogram").innerText = text;
+    } catch (e) {
+        display_error(e);
+    }
+}
+
+function histogram_bars(buckets, label) {
+    const total = buckets.reduce((a, b) => a + b, 0);
+    let text = "";
+    for (let i = 0; i < buckets.length; i++) {
+        const percent = (total > 0) ? (100 * buckets[i] / total) : 0;
+        text += label(i).padStart(20) + " " + "#".repeat(Math.round(percent / 2)).padEnd(50) + " " + percent.toFixed(1).padStart(5) + "%\n";
+    }
+    return text;
+}
+
+// Where in the 1 ms USB frame reports arrived and were read by the host.
+async function load_frame_phase() {
+    const data_with_report_id = await device.receiveFeatureReport(REPORT_ID_FRAME_PHASE);
+    const data = new DataView(data_with_report_id.buffer, 1);
+    check_crc(data);
+    check_received_version(data.getUint8(0));
+    const nbuckets = data.getUint8(1);
+    const sof_aligned = data.getUint8(2);
+    let arrival = [];
+    let complete = [];
+    for (let i = 0; i < nbuckets; i++) {
+        arrival.push(data.getUint16(7 + 2 * i, true));
+        complete.push(data.getUint16(7 + 2 * nbuckets + 2 * i, true));
+    }
+    const label = i => "+" + (i * FRAME_PHASE_BUCKET_US) + " \u00b5s";
+    return "time since start of frame" + (sof_aligned ? " (SOF aligned mode)" : "") + "\n\n" +
+        "arrived:\n" + histogram_bars(arrival, label) + "\n" +
+        "read by host:\n" + histogram_bars(complete, label);
+}
+
+function poll_stats_changed() {
+    if (stats_timer != null) {
+        clearInterval(stats_timer);
+        stats_timer = null;
+    }
+    prev_stats = null;
+    if (document.getElementById("poll_stats_checkbox").checked) {
+        load_stats();
+        stats_timer = setInterval(load_stats, STATS_POLL_INTERVAL);
+    }
+}
+
+async function load_transport_stats(transport) {
+    let buffer = new ArrayBuffer(CONFIG_SIZE);
+    let dataview = new DataView(buffer);
+    dataview.setUint8(0, CONFIG_VERSION);
+    dataview.setUint8(1, transport);
+    add_crc(dataview);
+    await device.sendFeatureReport(REPORT_ID_STATS, buffer);
+
+    const data_with_report_id = await device.receiveFeatureReport(REPORT_ID_STATS);
+    const data = new DataView(data_with_report_id.buffer, 1);
+    check_crc(data);
+    check_received_version(data.getUint8(0));
+    if (data.getUint8(1) != transport) {
+        throw new Error("Unexpected statistics report.");
+    }
+    let stats = {};
+    let pos = 2;
+    for (const [field, _] of STATS_FIELDS) {
+        stats[field] = data.getUint32(pos, true);
+        pos += 4;
+    }
+    stats.uptime_ms = data.getUint32(pos, true);
+    pos += 4;
+    for (const [field, _] of SEQUENCE_STATS_FIELDS) {
+        stats[field] = data.getUint32(pos, true);
+        pos += 4;
+    }
+    return stats;
+}
+
+async function load_stats() {
+    if (device == null) {
+        return;
+    }
+
+    try {
+        let all_stats = [];
+        for (let transport = 0; transport < TRANSPORT_NAMES.length; transport++) {
+            all_stats.push(await load_transport_stats(transport));
+        }
+
+        let text = "".padEnd(22);
+        for (const name of TRANSPORT_NAMES) {
+            text += name.padStart(14);
+        }
+        text += "\n";
+        for (const [field, label] of STATS_FIELDS.concat(SEQUENCE_STATS_FIELDS)) {
+            text += label.padEnd(22);
+            for (const stats of all_stats) {
+                text += String(stats[field]).padStart(14);
+            }
+            text += "\n";
+        }
+
+        text += "Packets/s".padEnd(22);
+        for (let transport = 0; transport < all_stats.length; transport++) {
+            let rate = "-";
+            if (prev_stats != null) {
+                const dt = (all_stats[transport].uptime_ms - prev_stats[transport].uptime_ms) / 1000;
+                if (dt > 0) {
+                    rate = ((all_stats[transport].packets - prev_stats[transport].packets) / dt).toFixed(1);
+                }
+            }
+            text += rate.padStart(14);
+        }
+        text += "\n";
+
+        text += "Loss".padEnd(22);
+        for (const stats of all_stats) {
+            const lost = stats.crc_errors + stats.framing_errors + stats.queue_drops;
+            const total = stats.packets + stats.crc_errors + stats.framing_errors;
+            text += ((total > 0) ? (100 * lost / total).toFixed(2) + "%" : "-").padStart(14);
+        }
+        text += "\n";
+
+        prev_stats = all_stats;
+        document.getElementById("stats").innerText = text;
+    } catch (e) {
+        display_error(e);
+        document.getElementById("poll_stats_checkbox").checked = false;
+        poll_stats_changed();
+    }
+}
@@ -0,0 +1,194 @@
+// Counts the bytes copied on the way from a transport to the IN endpoint,
+// per report the host receives. Copies into pool buffers are counted by
+// the pool, the copy into the endpoint by this program's tud_hid_n_report()
+// hook, which stands for TinyUSB's. The wire bytes the decoders write are
+// not copies and don't count.
+//
+// Each case sends the same reports with the endpoint always free, and with
+// an endpoint that is busy whenever a packet arrives, so every report goes
+// through the queue. The host then reads everything that's queued after
+// every other packet, the reports of the two packets are merged in
+// between. Buttons and keys only change every other packet.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+
+#include "host_frames.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#include "globals.h"
+#include "packet.h"
+#include "report_pool.h"
+#include "report_queue.h"
+#include "stats.h"
+
+#define PACKETS 10000
+#define MAX_PACKET_SIZE 512
+
+typedef struct {
+    const char* name;
+    uint8_t transport;
+    // Builds packet number n, returns its length.
+    size_t (*build)(uint8_t* out, uint32_t n);
+} bench_case_t;
+
+static uint64_t endpoint_bytes;
+static uint64_t report_bytes_delivered;
+static bool host_busy_mode;
+
+static void on_report(uint8_t report_id, const uint8_t* report, uint16_t len) {
+    endpoint_bytes += len;
+    report_bytes_delivered += len;
+    if (host_busy_mode) {
+        host_usb_ready = false;
+    }
+}
+
+static void fill(uint8_t* report, uint8_t len, uint32_t n) {
+    for (int i = 0; i < len; i++) {
+        report[i] = n * 7 + i;
+    }
+}
+
+static void fill_gamepad(uint8_t* report, uint32_t n) {
+    fill(report, SWITCH_REPORT_SIZE, n);
+    report[0] = (n & 2) ? SWITCH_BUTTON_A : 0;
+    report[1] = 0;
+    report[2] = SWITCH_HAT_CENTERED;
+}
+
+// Switch gamepad, the sticks move in every report.
+static size_t build_gamepad(uint8_t* out, uint32_t n) {
+    uint8_t report[SWITCH_REPORT_SIZE];
+    fill_gamepad(report, n);
+    return build_packet(out, SWITCH_GAMEPAD, SWITCH_REPORT_ID, report, sizeof(report));
+}
+
+// Keyboard, mouse and consumer control in one frame.
+static size_t build_batch(uint8_t* out, uint32_t n) {
+    static const uint8_t report_ids[] = { 1, 2, 3 };
+    static const uint8_t lens[] = { 9, 16, 1 };
+    uint8_t reports[3][16];
+    const uint8_t* report_ptrs[3] = { reports[0], reports[1], reports[2] };
+    for (int r = 0; r < 3; r++) {
+        fill(reports[r], lens[r], n / 2 + r);
+    }
+    return build_batch_packet(out, KB_MOUSE, 3, report_ids, report_ptrs, lens);
+}
+
+// The same with longer reports, too long for a pool buffer together.
+static size_t build_long_batch(uint8_t* out, uint32_t n) {
+    static const uint8_t report_ids[] = { 1, 2, 3 };
+    static const uint8_t lens[] = { 64, 64, 16 };
+    uint8_t reports[3][64];
+    const uint8_t* report_ptrs[3] = { reports[0], reports[1], reports[2] };
+    for (int r = 0; r < 3; r++) {
+        fill(reports[r], lens[r], n / 2 + r);
+    }
+    return build_batch_packet(out, KB_MOUSE, 3, report_ids, report_ptrs, lens);
+}
+
+// Protocol version 2 keyframes, the report comes out of the delta state.
+static size_t build_delta(uint8_t* out, uint32_t n) {
+    out[0] = 2;
+    out[1] = SWITCH_GAMEPAD;
+    out[2] = 8;
+    out[3] = 0;
+    out[4] = n;
+    out[5] = 1;
+    fill_gamepad(out + 6, n);
+    return 6 + 8;
+}
+
+static const bench_case_t cases[] = {
+    { "serial gamepad", TRANSPORT_UART, build_gamepad },
+    { "serial batch", TRANSPORT_UART, build_batch },
+    { "serial long batch", TRANSPORT_UART, build_long_batch },
+    { "serial delta", TRANSPORT_UART, build_delta },
+    { "udp gamepad", TRANSPORT_UDP, build_gamepad },
+    { "udp batch", TRANSPORT_UDP, build_batch },
+};
+
+static void host_poll() {
+    if (!host_usb_ready) {
+        host_usb_ready = true;
+        tud_hid_report_complete_cb(0, host_last_report, host_last_report_len);
+    }
+    outgoing_reports_task();
+}
+
+static void host_read_all() {
+    do {
+        host_poll();
+    } while (!host_usb_ready);
+}
+
+static void run(const bench_case_t* c, bool busy) {
+    host_stubs_reset();
+    host_report_hook = on_report;
+    host_busy_mode = busy;
+    memset(rx_stats, 0, sizeof(rx_stats));
+    memset(usb_queue_drops, 0, sizeof(usb_queue_drops));
+    uint8_t descriptor = (c->build == build_gamepad || c->build == build_delta) ? SWITCH_GAMEPAD : KB_MOUSE;
+    our_descriptor_number = descriptor;
+    usb_descriptor_number = descriptor;
+    packet_forget_source(c->transport, 0);
+    packet_set_source(c->transport, 0, 0);
+    endpoint_bytes = 0;
+    report_bytes_delivered = 0;
+    uint32_t copied_at_start = report_pool_bytes_copied;
+
+    // The first report makes the endpoint busy.
+    host_usb_ready = !busy;
+    for (uint32_t n = 0; n < PACKETS; n++) {
+        uint8_t packet[MAX_PACKET_SIZE];
+        size_t len = c->build(packet, n);
+        if (c->transport == TRANSPORT_UDP) {
+            handle_received_packet(packet, len);
+        } else {
+            uint8_t frame[SLIP_FRAME_MAX_SIZE(MAX_PACKET_SIZE)];
+            size_t frame_len = slip_encode_frame(packet, len, frame);
+            serial_read_bytes(frame, frame_len);
+        }
+        if (busy && (n & 1)) {
+            host_read_all();
+            host_usb_ready = false;
+        }
+    }
+    host_read_all();
+
+    const transport_stats_t* s = &rx_stats[c->transport];
+    if ((s->invalid_packets != 0) || (s->queue_drops != 0) || (s->crc_errors != 0) || (usb_queue_drops[c->transport] != 0)) {
+        fprintf(stderr, "%s: packets weren't handled\n", c->name);
+        exit(1);
+    }
+    uint32_t delivered = host_reports_sent;
+    uint32_t pool_bytes = report_pool_bytes_copied - copied_at_start;
+    printf("%-18s %-5s %9u %10.1f %10.1f %10.1f %10.1f\n",
+           c->name, busy ? "busy" : "free", delivered,
+           (double) report_bytes_delivered / delivered,
+           (double) pool_bytes / delivered,
+           (double) endpoint_bytes / delivered,
+           (double) (pool_bytes + endpoint_bytes) / delivered);
+
+    report_queue_clear();
+    packet_forget_source(c->transport, 0);
+    if (report_pool_available() != REPORT_POOL_BUFFERS) {
+        fprintf(stderr, "%s: %d pool buffers weren't released\n", c->name, REPORT_POOL_BUFFERS - report_pool_available());
+        exit(1);
+    }
+}
+
+int main() {
+    printf("%-18s %-5s %9s %10s %10s %10s %10s\n", "", "host", "reports", "B/report", "pool B/r", "endp B/r", "copied B/r");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        run(&cases[i], false);
+        run(&cases[i], true);
+    }
+    return 0;
+}
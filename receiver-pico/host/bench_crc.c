@@ -0,0 +1,61 @@
+// Compares the software CRC-32 backends. The DMA sniffer backend only
+// exists on the Pico, crc32_dma() has to be timed there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc.h"
+
+#define MIN_RUN_NS 100000000ULL
+
+typedef uint32_t (*crc_fn_t)(const uint8_t* buf, int len);
+
+static const int sizes[] = { 8, 16, 24, 68, 512 };
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double ns_per_call(crc_fn_t fn, const uint8_t* buf, int len) {
+    volatile uint32_t sink = 0;
+    uint64_t calls = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 1000; i++) {
+            sink ^= fn(buf, len);
+        }
+        calls += 1000;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+    return (double) elapsed / calls;
+}
+
+int main() {
+    static uint8_t buf[512];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = i * 7 + 3;
+    }
+
+    if (crc32_slice_by_8((const uint8_t*) "123456789", 9) != 0xCBF43926) {
+        fprintf(stderr, "CRC check value mismatch\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (crc32_bytewise(buf + 1, sizes[i]) != crc32_slice_by_8(buf + 1, sizes[i])) {
+            fprintf(stderr, "CRC mismatch for %d bytes\n", sizes[i]);
+            return 1;
+        }
+    }
+
+    printf("%6s %14s %14s %8s\n", "bytes", "bytewise ns", "slice8 ns", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double bytewise = ns_per_call(crc32_bytewise, buf, sizes[i]);
+        double slice8 = ns_per_call(crc32_slice_by_8, buf, sizes[i]);
+        printf("%6d %14.1f %14.1f %7.2fx\n", sizes[i], bytewise, slice8, bytewise / slice8);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// Measures decode+CRC+dispatch throughput of the receiver's packet path
+// on the host. The first table feeds SLIP frames through serial_read_byte()
+// one byte at a time and through serial_read_bytes() in CHUNK_SIZE byte
+// pieces, the way serial_task() and bt_task() hand them over on the Pico.
+// The second table compares a keyboard+mouse+consumer update sent as three
+// frames and as one batched frame.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "host_frames.h"
+#include "host_stubs.h"
+
+#include "globals.h"
+#include "packet.h"
+#include "stats.h"
+
+#define STREAM_TARGET_BYTES (1 << 20)
+#define MIN_RUN_NS 200000000ULL
+// About what a DMA buffer or an RFCOMM packet holds.
+#define CHUNK_SIZE 64
+
+static const uint8_t payload_sizes[] = { 4, 8, 16, 32, 64 };
+static const int escape_percentages[] = { 0, 10, 50, 100 };
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng() {
+    rng_state = rng_state * 1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t random_byte(int escape_percentage) {
+    if ((int) (rng() % 100) < escape_percentage) {
+        return (rng() & 1) ? 0300 : 0333;
+    }
+    uint8_t b;
+    do {
+        b = rng();
+    } while ((b == 0300) || (b == 0333));
+    return b;
+}
+
+// Fills stream with back-to-back frames. Returns the number of frames.
+static size_t build_stream(uint8_t* stream, size_t* stream_len, uint8_t payload_size, int escape_percentage) {
+    uint8_t report[64];
+    uint8_t packet[4 + 64];
+    size_t nframes = 0;
+    size_t pos = 0;
+
+    while (pos + SLIP_FRAME_MAX_SIZE(sizeof(packet)) < STREAM_TARGET_BYTES) {
+        for (int i = 0; i < payload_size; i++) {
+            report[i] = random_byte(escape_percentage);
+        }
+        size_t packet_len = build_packet(packet, our_descriptor_number, 1, report, payload_size);
+        pos += slip_encode_frame(packet, packet_len, stream + pos);
+        nframes++;
+    }
+
+    *stream_len = pos;
+    return nframes;
+}
+
+static void feed(const uint8_t* stream, size_t stream_len, bool chunked) {
+    if (chunked) {
+        for (size_t i = 0; i < stream_len; i += CHUNK_SIZE) {
+            serial_read_bytes(stream + i, (stream_len - i < CHUNK_SIZE) ? stream_len - i : CHUNK_SIZE);
+        }
+    } else {
+        for (size_t i = 0; i < stream_len; i++) {
+            serial_read_byte(stream[i]);
+        }
+    }
+}
+
+// Returns ns per byte.
+static double time_stream(const uint8_t* stream, size_t stream_len, size_t nframes, bool chunked) {
+    host_stubs_reset();
+    packet_set_source(TRANSPORT_UART, 0, 0);
+    uint64_t iterations = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+    do {
+        feed(stream, stream_len, chunked);
+        iterations++;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+
+    uint64_t total_frames = iterations * nframes;
+    if (host_reports_sent != total_frames) {
+        fprintf(stderr, "expected %llu reports, got %u\n", (unsigned long long) total_frames, host_reports_sent);
+        exit(1);
+    }
+    return (double) elapsed / (iterations * stream_len);
+}
+
+static void run(uint8_t payload_size, int escape_percentage) {
+    static uint8_t stream[STREAM_TARGET_BYTES];
+    size_t stream_len;
+    size_t nframes = build_stream(stream, &stream_len, payload_size, escape_percentage);
+
+    double bytewise = time_stream(stream, stream_len, nframes, false);
+    double chunked = time_stream(stream, stream_len, nframes, true);
+
+    printf("%8u %8d%% %10.1f %12.2f %12.2f %8.2fx %14.0f\n",
+        payload_size,
+        escape_percentage,
+        (double) stream_len / nframes,
+        bytewise,
+        chunked,
+        bytewise / chunked,
+        1e9 / (chunked * stream_len / nframes));
+}
+
+// Report IDs and lengths of a mouse and keyboard update (descriptor 0).
+static const uint8_t kb_mouse_report_ids[] = { 1, 2, 3 };
+static const uint8_t kb_mouse_lens[] = { 9, 16, 1 };
+
+static size_t build_kb_mouse_stream(uint8_t* stream, size_t* stream_len, bool batched) {
+    uint8_t reports[3][64];
+    const uint8_t* report_ptrs[3] = { reports[0], reports[1], reports[2] };
+    uint8_t packet[3 + 3 * (2 + 64)];
+    size_t nupdates = 0;
+    size_t pos = 0;
+
+    while (pos + 3 * SLIP_FRAME_MAX_SIZE(4 + 64) < STREAM_TARGET_BYTES) {
+        for (int r = 0; r < 3; r++) {
+            for (int i = 0; i < kb_mouse_lens[r]; i++) {
+                reports[r][i] = random_byte(10);
+            }
+        }
+        if (batched) {
+            size_t packet_len = build_batch_packet(packet, 0, 3, kb_mouse_report_ids, report_ptrs, kb_mouse_lens);
+            pos += slip_encode_frame(packet, packet_len, stream + pos);
+        } else {
+            for (int r = 0; r < 3; r++) {
+                size_t packet_len = build_packet(packet, 0, kb_mouse_report_ids[r], reports[r], kb_mouse_lens[r]);
+                pos += slip_encode_frame(packet, packet_len, stream + pos);
+            }
+        }
+        nupdates++;
+    }
+
+    *stream_len = pos;
+    return nupdates;
+}
+
+static void run_kb_mouse(bool batched) {
+    static uint8_t stream[STREAM_TARGET_BYTES];
+    size_t stream_len;
+    size_t nupdates = build_kb_mouse_stream(stream, &stream_len, batched);
+
+    host_stubs_reset();
+    packet_set_source(TRANSPORT_UART, 0, 0);
+    our_descriptor_number = 0;
+    uint64_t iterations = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+    do {
+        feed(stream, stream_len, true);
+        iterations++;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+
+    uint64_t total_updates = iterations * nupdates;
+    if (host_reports_sent != 3 * total_updates) {
+        fprintf(stderr, "expected %llu reports, got %u\n", (unsigned long long) (3 * total_updates), host_reports_sent);
+        exit(1);
+    }
+
+    printf("%8s %10.1f %12.1f %14.0f\n",
+        batched ? "batched" : "single",
+        (double) stream_len / nupdates,
+        (double) elapsed / total_updates,
+        total_updates * 1e9 / elapsed);
+}
+
+int main() {
+    printf("%8s %9s %10s %12s %12s %9s %14s\n", "payload", "escaped", "wire B/pkt", "ns/B byte", "ns/B chunk", "speedup", "packets/sec");
+    for (size_t i = 0; i < sizeof(payload_sizes); i++) {
+        for (size_t j = 0; j < sizeof(escape_percentages) / sizeof(escape_percentages[0]); j++) {
+            run(payload_sizes[i], escape_percentages[j]);
+        }
+    }
+
+    printf("\n%8s %10s %12s %14s\n", "frames", "wire B/upd", "ns/update", "updates/sec");
+    run_kb_mouse(false);
+    run_kb_mouse(true);
+    return 0;
+}
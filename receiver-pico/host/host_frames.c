@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "host_frames.h"
+
+#include "crc.h"
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+static size_t put_escaped(uint8_t* out, uint8_t b) {
+    switch (b) {
+        case END:
+            out[0] = ESC;
+            out[1] = ESC_END;
+            return 2;
+        case ESC:
+            out[0] = ESC;
+            out[1] = ESC_ESC;
+            return 2;
+        default:
+            out[0] = b;
+            return 1;
+    }
+}
+
+size_t slip_encode_frame(const uint8_t* data, size_t len, uint8_t* out) {
+    uint32_t crc = crc32(data, len);
+    size_t pos = 0;
+
+    out[pos++] = END;
+    for (size_t i = 0; i < len; i++) {
+        pos += put_escaped(out + pos, data[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pos += put_escaped(out + pos, (crc >> (i * 8)) & 0xFF);
+    }
+    out[pos++] = END;
+
+    return pos;
+}
+
+size_t build_packet(uint8_t* out, uint8_t our_descriptor_number, uint8_t report_id, const uint8_t* report, uint8_t len) {
+    out[0] = 1;
+    out[1] = our_descriptor_number;
+    out[2] = len;
+    out[3] = report_id;
+    memcpy(out + 4, report, len);
+    return 4 + len;
+}
+
+size_t build_batch_packet(uint8_t* out, uint8_t our_descriptor_number, uint8_t count, const uint8_t* report_ids, const uint8_t* const* reports, const uint8_t* lens) {
+    size_t pos = 0;
+    out[pos++] = 3;
+    out[pos++] = our_descriptor_number;
+    out[pos++] = count;
+    for (int i = 0; i < count; i++) {
+        out[pos++] = report_ids[i];
+        out[pos++] = lens[i];
+        memcpy(out + pos, reports[i], lens[i]);
+        pos += lens[i];
+    }
+    return pos;
+}
+
+size_t build_sequenced_packet(uint8_t* out, uint32_t seq, uint32_t timestamp_us, uint8_t count, const uint8_t* const* packets, const uint16_t* lens) {
+    size_t pos = 0;
+    out[pos++] = 4;
+    out[pos++] = count;
+    for (int i = 0; i < 4; i++) {
+        out[pos++] = (seq >> (i * 8)) & 0xFF;
+    }
+    for (int i = 0; i < 4; i++) {
+        out[pos++] = (timestamp_us >> (i * 8)) & 0xFF;
+    }
+    for (int i = 0; i < count; i++) {
+        out[pos++] = lens[i] & 0xFF;
+        out[pos++] = lens[i] >> 8;
+        memcpy(out + pos, packets[i], lens[i]);
+        pos += lens[i];
+    }
+    return pos;
+}
@@ -0,0 +1,24 @@
+#ifndef _HOST_FRAMES_H_
+#define _HOST_FRAMES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst case size of an encoded frame for a payload of len bytes.
+#define SLIP_FRAME_MAX_SIZE(len) (2 * ((len) + 4) + 2)
+
+// Appends the CRC and SLIP-encodes data the same way the transmitters do.
+// Returns the number of bytes written to out.
+size_t slip_encode_frame(const uint8_t* data, size_t len, uint8_t* out);
+
+// Builds a protocol version 1 packet. Returns its length.
+size_t build_packet(uint8_t* out, uint8_t our_descriptor_number, uint8_t report_id, const uint8_t* report, uint8_t len);
+
+// Builds a protocol version 3 packet with one record per report. Returns its length.
+size_t build_batch_packet(uint8_t* out, uint8_t our_descriptor_number, uint8_t count, const uint8_t* report_ids, const uint8_t* const* reports, const uint8_t* lens);
+
+// Builds a protocol version 4 packet around count complete packets, newest
+// first. Returns its length.
+size_t build_sequenced_packet(uint8_t* out, uint32_t seq, uint32_t timestamp_us, uint8_t count, const uint8_t* const* packets, const uint16_t* lens);
+
+#endif
@@ -0,0 +1,31 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "host_pty.h"
+
+int host_pty_open(char* path, size_t path_size, int* slave_fd) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+        perror("posix_openpt");
+        exit(1);
+    }
+    if (ptsname_r(master, path, path_size) != 0) {
+        perror("ptsname_r");
+        exit(1);
+    }
+    int slave = open(path, O_RDWR | O_NOCTTY);
+    struct termios t;
+    if ((slave < 0) || (tcgetattr(slave, &t) != 0)) {
+        perror(path);
+        exit(1);
+    }
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+    *slave_fd = slave;
+    return master;
+}
@@ -0,0 +1,13 @@
+#ifndef _HOST_PTY_H_
+#define _HOST_PTY_H_
+
+#include <stddef.h>
+
+// Opens a pseudo-terminal in raw mode for transmitters to connect to as if
+// it were a serial port. path gets the device name they open. Returns the
+// master side, non-blocking, for reading what they send. slave_fd gets the
+// other end, which stays open so transmitters can come and go without a
+// hangup on the master side. Exits on failure.
+int host_pty_open(char* path, size_t path_size, int* slave_fd);
+
+#endif
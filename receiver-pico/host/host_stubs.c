@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "tusb.h"
+
+#include "host_stubs.h"
+
+#include "globals.h"
+#include "receiver.h"
+
+bool host_usb_ready = true;
+bool host_usb_connected = true;
+
+uint32_t host_reports_sent = 0;
+uint8_t host_last_report_instance = 0;
+uint8_t host_last_report_id = 0;
+uint8_t host_last_report[64];
+uint16_t host_last_report_len = 0;
+void (*host_report_hook)(uint8_t report_id, const uint8_t* report, uint16_t len) = NULL;
+
+uint32_t host_descriptor_switches = 0;
+
+void host_stubs_reset() {
+    host_usb_ready = true;
+    host_usb_connected = true;
+    host_reports_sent = 0;
+    host_last_report_instance = 0;
+    host_last_report_id = 0;
+    host_last_report_len = 0;
+    host_descriptor_switches = 0;
+    host_report_hook = NULL;
+}
+
+bool tud_hid_n_ready(uint8_t instance) {
+    return host_usb_ready && host_usb_connected;
+}
+
+bool tud_disconnect() {
+    host_usb_connected = false;
+    return true;
+}
+
+bool tud_connect() {
+    host_usb_connected = true;
+    return true;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const* report, uint16_t len) {
+    if (len > sizeof(host_last_report)) {
+        return false;
+    }
+    host_reports_sent++;
+    host_last_report_instance = instance;
+    host_last_report_id = report_id;
+    host_last_report_len = len;
+    memcpy(host_last_report, report, len);
+    if (host_report_hook != NULL) {
+        host_report_hook(report_id, report, len);
+    }
+    return true;
+}
+
+// On the Pico this also schedules a config write.
+void switch_our_descriptor(uint8_t descriptor_number) {
+    our_descriptor_number = descriptor_number;
+    host_descriptor_switches++;
+}
+
+// The serial link speed can't be negotiated on the host.
+void link_handle_packet(const uint8_t* data, uint16_t len) {
+}
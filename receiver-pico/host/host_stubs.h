@@ -0,0 +1,26 @@
+#ifndef _HOST_STUBS_H_
+#define _HOST_STUBS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Whether tud_hid_n_ready() reports the IN endpoint as free.
+extern bool host_usb_ready;
+// Cleared by tud_disconnect(), set by tud_connect().
+extern bool host_usb_connected;
+
+// Reports handed to tud_hid_n_report() and the last one of them.
+extern uint32_t host_reports_sent;
+extern uint8_t host_last_report_instance;
+extern uint8_t host_last_report_id;
+extern uint8_t host_last_report[64];
+extern uint16_t host_last_report_len;
+// Called for every report handed to tud_hid_n_report(), if set.
+extern void (*host_report_hook)(uint8_t report_id, const uint8_t* report, uint16_t len);
+
+// Number of times the receiver asked to switch to another descriptor.
+extern uint32_t host_descriptor_switches;
+
+void host_stubs_reset();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Emulated devices and reports the host tests send, see descriptors.c.
+#define KB_MOUSE 0
+#define MOUSE_REPORT_ID 1
+#define MOUSE_REPORT_SIZE 9
+#define KEYBOARD_REPORT_ID 2
+#define KEYBOARD_REPORT_SIZE 16
+
+#define SWITCH_GAMEPAD 2
+#define SWITCH_REPORT_ID 0
+#define SWITCH_REPORT_SIZE 8
+#define SWITCH_HAT_CENTERED 15
+
+#define SWITCH_BUTTON_Y (1 << 0)
+#define SWITCH_BUTTON_B (1 << 1)
+#define SWITCH_BUTTON_A (1 << 2)
+
+// Prints what went wrong unless condition holds, and returns it.
+static inline bool check(bool condition, const char* what) {
+    if (!condition) {
+        fprintf(stderr, "%s\n", what);
+    }
+    return condition;
+}
+
+// A Switch gamepad report with the right stick centered.
+static inline void fill_switch_report(uint8_t* report, uint8_t buttons, uint8_t hat, uint8_t lx) {
+    memset(report, 0x80, SWITCH_REPORT_SIZE);
+    report[0] = buttons;
+    report[1] = 0;
+    report[2] = hat;
+    report[3] = lx;
+    report[7] = 0;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HOST_HARDWARE_UART_H_
+#define _HOST_HARDWARE_UART_H_
+
+// Host stand-in for the UART type in the link speed negotiation API, the
+// link itself isn't part of the host build.
+
+typedef struct uart_inst uart_inst_t;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HOST_PICO_TIME_H_
+#define _HOST_PICO_TIME_H_
+
+// Host stand-in for the Pico SDK's microsecond timer.
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint32_t time_us_32() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+#endif
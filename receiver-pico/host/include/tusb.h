@@ -0,0 +1,81 @@
+#ifndef _HOST_TUSB_H_
+#define _HOST_TUSB_H_
+
+// Host stand-in for the parts of the TinyUSB device API used by the
+// receiver's packet path and descriptors.c. Implemented in host_stubs.c.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+bool tud_hid_n_ready(uint8_t instance);
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const* report, uint16_t len);
+bool tud_disconnect(void);
+bool tud_connect(void);
+
+// Implemented by the receiver. Only sim_receiver calls them, as the
+// virtual USB host.
+void tud_sof_cb(uint32_t frame_count);
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len);
+
+// Descriptor layouts as TinyUSB defines them, so descriptors.c builds the
+// same bytes it does on the Pico.
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+#define CFG_TUD_HID_EP_BUFSIZE 64
+
+#define TUSB_DESC_DEVICE 0x01
+#define TUSB_DESC_CONFIGURATION 0x02
+#define TUSB_DESC_STRING 0x03
+#define TUSB_DESC_INTERFACE 0x04
+#define TUSB_DESC_ENDPOINT 0x05
+#define TUSB_CLASS_HID 3
+#define TUSB_XFER_INTERRUPT 3
+#define HID_DESC_TYPE_HID 0x21
+#define HID_DESC_TYPE_REPORT 0x22
+#define HID_SUBCLASS_BOOT 1
+#define HID_ITF_PROTOCOL_NONE 0
+#define HID_ITF_PROTOCOL_KEYBOARD 1
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t bDeviceClass;
+    uint8_t bDeviceSubClass;
+    uint8_t bDeviceProtocol;
+    uint8_t bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t iManufacturer;
+    uint8_t iProduct;
+    uint8_t iSerialNumber;
+    uint8_t bNumConfigurations;
+} tusb_desc_device_t;
+
+#define U16_TO_U8S_LE(x) (uint8_t) ((x) & 0xFF), (uint8_t) (((x) >> 8) & 0xFF)
+
+#define TUD_CONFIG_DESC_LEN 9
+#define TUD_CONFIG_DESCRIPTOR(config_num, _itfcount, _stridx, _total_len, _attribute, _power_ma) \
+    9, TUSB_DESC_CONFIGURATION, U16_TO_U8S_LE(_total_len), _itfcount, config_num, _stridx, (1 << 7) | (_attribute), (_power_ma) / 2
+
+#define TUD_HID_DESC_LEN (9 + 9 + 7)
+#define TUD_HID_DESCRIPTOR(_itfnum, _stridx, _boot_protocol, _report_desc_len, _epin, _epsize, _ep_interval) \
+    9, TUSB_DESC_INTERFACE, _itfnum, 0, 1, TUSB_CLASS_HID, (uint8_t) ((_boot_protocol) ? HID_SUBCLASS_BOOT : 0), _boot_protocol, _stridx, \
+    9, HID_DESC_TYPE_HID, U16_TO_U8S_LE(0x0111), 0, 1, HID_DESC_TYPE_REPORT, U16_TO_U8S_LE(_report_desc_len), \
+    7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(_epsize), _ep_interval
+
+#define TUD_HID_INOUT_DESC_LEN (9 + 9 + 7 + 7)
+#define TUD_HID_INOUT_DESCRIPTOR(_itfnum, _stridx, _boot_protocol, _report_desc_len, _epout, _epin, _epsize, _ep_interval) \
+    9, TUSB_DESC_INTERFACE, _itfnum, 0, 2, TUSB_CLASS_HID, (uint8_t) ((_boot_protocol) ? HID_SUBCLASS_BOOT : 0), _boot_protocol, _stridx, \
+    9, HID_DESC_TYPE_HID, U16_TO_U8S_LE(0x0111), 0, 1, HID_DESC_TYPE_REPORT, U16_TO_U8S_LE(_report_desc_len), \
+    7, TUSB_DESC_ENDPOINT, _epout, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(_epsize), _ep_interval, \
+    7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(_epsize), _ep_interval
+
+// Implemented in descriptors.c.
+uint8_t const* tud_descriptor_device_cb(void);
+uint8_t const* tud_descriptor_configuration_cb(uint8_t index);
+uint8_t const* tud_hid_descriptor_report_cb(uint8_t itf);
+
+#endif
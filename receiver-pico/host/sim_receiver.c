@@ -0,0 +1,435 @@
+// Runs the receiver's packet path behind a pseudo-terminal, with a virtual
+// USB host that reads the IN endpoint once per millisecond. Transmitters
+// connect to the printed device path as if it were a USB-to-serial
+// adapter wired to a Pico, for example
+//
+//   ./sim_receiver
+//   ./gamepad_test.py --serial-port /dev/pts/5
+//
+// prints traffic once per second and the receiver's latency histogram on
+// Ctrl-C. With -r the simulator also runs its own transmitter thread at
+// that many frames per second. Every frame is tagged, so the latency
+// from its write() to the virtual host reading it is measured exactly,
+// along with how many reports never got to the host.
+//
+// Options:
+//   -r RATE   built-in transmitter, frames per second
+//   -d SECS   stop after this long (default 5 with -r, run until Ctrl-C otherwise)
+//   -m MIX    what the built-in transmitter sends:
+//             sticks    Switch gamepad, only the sticks move (default)
+//             buttons   Switch gamepad, a button changes in every report
+//             keyboard  16 byte keyboard reports, a key changes in every report
+//   -b BAUD   bytes reach the receiver no faster than a UART at this rate
+//             would deliver them (default 921600, 0 for no limit)
+//   -c        exit with an error if frames were corrupted or reports lost
+//             (superseded stick positions don't count)
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pico/time.h"
+#include "tusb.h"
+
+#include "host_frames.h"
+#include "host_pty.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#include "globals.h"
+#include "latency.h"
+#include "packet.h"
+#include "stats.h"
+
+#define USB_POLL_INTERVAL_US 1000
+#define MAX_POLL_BACKLOG 100
+// Bytes that arrived in the same wire time slice are fed together.
+#define WIRE_SLICE_US 50
+// Fed to serial_read_bytes(), which takes at most 65535 bytes at a time.
+#define INPUT_BUFFER_SIZE (1 << 15)
+#define TAGS 65536
+// How long the receiver keeps going after the built-in transmitter is done,
+// for the last frames to arrive and be read.
+#define DRAIN_US 100000
+
+#define MIX_STICKS 0
+#define MIX_BUTTONS 1
+#define MIX_KEYBOARD 2
+
+typedef struct {
+    const char* name;
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    uint8_t len;
+    // Where the 16-bit tag goes in the report.
+    uint8_t tag_offset;
+    // Whether every report has a button or key edge, which must never be lost.
+    bool edges;
+} mix_t;
+
+static const mix_t mixes[] = {
+    [MIX_STICKS] = { "sticks", SWITCH_GAMEPAD, SWITCH_REPORT_ID, SWITCH_REPORT_SIZE, 3, false },
+    [MIX_BUTTONS] = { "buttons", SWITCH_GAMEPAD, SWITCH_REPORT_ID, SWITCH_REPORT_SIZE, 3, true },
+    [MIX_KEYBOARD] = { "keyboard", KB_MOUSE, KEYBOARD_REPORT_ID, KEYBOARD_REPORT_SIZE, 14, true },
+};
+
+static volatile sig_atomic_t running = 1;
+
+// Built-in transmitter.
+static const mix_t* mix = &mixes[MIX_STICKS];
+static uint32_t send_rate = 0;
+static double duration = 0;
+static int transmitter_fd;
+static uint32_t send_times_us[TAGS];
+static volatile uint32_t frames_sent = 0;
+static uint64_t wire_bytes_sent = 0;
+
+// Virtual USB host.
+static uint8_t pending_report[64];
+static uint16_t pending_len;
+static uint32_t reports_read = 0;
+static uint32_t last_seq;
+static bool any_read = false;
+static uint32_t superseded = 0;
+static uint32_t* e2e_samples = NULL;
+static uint32_t e2e_count = 0;
+static uint32_t e2e_capacity = 0;
+
+static void on_signal(int sig) {
+    running = 0;
+}
+
+static void sleep_until_us(uint64_t t) {
+    struct timespec ts = { .tv_sec = t / 1000000, .tv_nsec = (t % 1000000) * 1000 };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t build_frame(uint8_t* out, uint32_t seq) {
+    uint8_t report[64];
+    uint8_t packet[4 + 64];
+    if (mix->our_descriptor_number == SWITCH_GAMEPAD) {
+        fill_switch_report(report, (mix->edges && (seq & 1)) ? SWITCH_BUTTON_A : 0, SWITCH_HAT_CENTERED, 0x80);
+    } else {
+        memset(report, 0, mix->len);
+        report[1] = (seq & 1) ? 1 : 0;  // key A
+    }
+    report[mix->tag_offset] = seq & 0xFF;
+    report[mix->tag_offset + 1] = (seq >> 8) & 0xFF;
+    size_t len = build_packet(packet, mix->our_descriptor_number, mix->report_id, report, mix->len);
+    return slip_encode_frame(packet, len, out);
+}
+
+static void* transmitter_thread(void* arg) {
+    uint8_t frame[SLIP_FRAME_MAX_SIZE(4 + 64)];
+    uint64_t next = now_us();
+    uint64_t interval_ns = 1000000000ULL / send_rate;
+    uint64_t start = next;
+    uint32_t nframes = send_rate * duration;
+    uint32_t seq = 0;
+    while (running && (seq < nframes)) {
+        size_t len = build_frame(frame, seq);
+        send_times_us[seq % TAGS] = time_us_32();
+        if (write(transmitter_fd, frame, len) != (ssize_t) len) {
+            perror("write");
+            break;
+        }
+        wire_bytes_sent += len;
+        seq++;
+        frames_sent = seq;
+        next = start + seq * interval_ns / 1000;
+        sleep_until_us(next);
+    }
+    return NULL;
+}
+
+static void add_e2e_sample(uint32_t latency_us) {
+    if (e2e_count == e2e_capacity) {
+        e2e_capacity = e2e_capacity ? 2 * e2e_capacity : 4096;
+        e2e_samples = realloc(e2e_samples, e2e_capacity * sizeof(uint32_t));
+        if (e2e_samples == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    e2e_samples[e2e_count++] = latency_us;
+}
+
+static void on_report(uint8_t report_id, const uint8_t* report, uint16_t len) {
+    // The endpoint is busy until the host's next poll.
+    host_usb_ready = false;
+    memcpy(pending_report, report, len);
+    pending_len = len;
+}
+
+// The host read the report that was waiting on the endpoint.
+static void host_read(uint32_t now) {
+    reports_read++;
+    if (send_rate == 0) {
+        return;
+    }
+    if (pending_len != mix->len) {
+        return;
+    }
+    uint16_t tag = pending_report[mix->tag_offset] | (pending_report[mix->tag_offset + 1] << 8);
+    uint32_t seq = any_read ? last_seq + (uint16_t) (tag - (uint16_t) last_seq) : tag;
+    if (any_read && (seq == last_seq)) {
+        return;
+    }
+    superseded += seq - (any_read ? last_seq + 1 : 0);
+    last_seq = seq;
+    any_read = true;
+    add_e2e_sample(now - send_times_us[seq % TAGS]);
+}
+
+static void usb_poll(uint32_t frame_count) {
+    tud_sof_cb(frame_count);
+    if (!host_usb_ready) {
+        uint32_t now = time_us_32();
+        host_read(now);
+        host_usb_ready = true;
+        tud_hid_report_complete_cb(0, pending_report, pending_len);
+    }
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t* sorted, uint32_t n, int p) {
+    return sorted[(uint64_t) (n - 1) * p / 100];
+}
+
+// Upper bound of the histogram bucket the p-th percentile falls in.
+static uint32_t histogram_percentile(const latency_histogram_t* h, int p) {
+    uint32_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        total += h->buckets[i];
+    }
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if ((uint64_t) seen * 100 >= (uint64_t) total * p) {
+            return LATENCY_BUCKET0_US << i;
+        }
+    }
+    return 0;
+}
+
+static uint32_t corrupted() {
+    const transport_stats_t* s = &rx_stats[TRANSPORT_UART];
+    return s->crc_errors + s->framing_errors + s->invalid_packets + s->queue_drops + usb_queue_drops[TRANSPORT_UART];
+}
+
+static void print_summary(double elapsed) {
+    const transport_stats_t* s = &rx_stats[TRANSPORT_UART];
+    if (send_rate != 0) {
+        printf("sent %u %s frames at %u/s, %.1f B/frame on the wire\n", frames_sent, mix->name, send_rate,
+               frames_sent ? (double) wire_bytes_sent / frames_sent : 0.0);
+    }
+    printf("received %u packets (%.0f/s), %u CRC errors, %u framing errors, %u invalid, %u queue drops\n",
+           s->packets, s->packets / elapsed, s->crc_errors, s->framing_errors, s->invalid_packets,
+           s->queue_drops + usb_queue_drops[TRANSPORT_UART]);
+    printf("host read %u reports (%.0f/s)", reports_read, reports_read / elapsed);
+    if (send_rate != 0) {
+        uint32_t never_read = any_read ? frames_sent - (last_seq + 1) : frames_sent;
+        printf(", %u superseded before the host read them, %u still on their way at the end", superseded, never_read);
+    }
+    printf("\n");
+    if (e2e_count > 0) {
+        qsort(e2e_samples, e2e_count, sizeof(uint32_t), compare_u32);
+        printf("end-to-end latency (us): p50 %u, p90 %u, p99 %u, p99.9 %u, max %u\n",
+               percentile(e2e_samples, e2e_count, 50), percentile(e2e_samples, e2e_count, 90),
+               percentile(e2e_samples, e2e_count, 99), e2e_samples[(uint64_t) (e2e_count - 1) * 999 / 1000],
+               e2e_samples[e2e_count - 1]);
+    }
+    latency_histogram_t h;
+    latency_get(&h);
+    if (h.samples > 0) {
+        printf("receiver latency, arrival to host read (us): mean %u, p50 < %u, p99 < %u, max %u\n",
+               h.mean_us, histogram_percentile(&h, 50), histogram_percentile(&h, 99), h.max_us);
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t baudrate = 921600;
+    bool check = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:m:b:c")) != -1) {
+        switch (opt) {
+            case 'r':
+                send_rate = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration = strtod(optarg, NULL);
+                break;
+            case 'm':
+                mix = NULL;
+                for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+                    if (strcmp(optarg, mixes[i].name) == 0) {
+                        mix = &mixes[i];
+                    }
+                }
+                if (mix == NULL) {
+                    fprintf(stderr, "unknown mix %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'b':
+                baudrate = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                check = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r RATE] [-d SECS] [-m sticks|buttons|keyboard] [-b BAUD] [-c]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((send_rate != 0) && (duration == 0)) {
+        duration = 5;
+    }
+
+    char path[64];
+    int master = host_pty_open(path, sizeof(path), &transmitter_fd);
+    printf("receiver on %s\n", path);
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    host_stubs_reset();
+    host_report_hook = on_report;
+    our_descriptor_number = mix->our_descriptor_number;
+    usb_descriptor_number = mix->our_descriptor_number;
+    latency_reset();
+
+    pthread_t transmitter;
+    if (send_rate != 0) {
+        pthread_create(&transmitter, NULL, transmitter_thread, NULL);
+    }
+
+    static uint8_t input[INPUT_BUFFER_SIZE];
+    size_t input_head = 0;
+    size_t input_tail = 0;
+    // Time the next byte is done arriving over the simulated wire.
+    double wire_next_us = 0;
+    double byte_us = baudrate ? 10e6 / baudrate : 0;
+
+    uint64_t start = now_us();
+    uint64_t next_poll = start + USB_POLL_INTERVAL_US;
+    uint64_t next_print = start + 1000000;
+    uint32_t frame_count = 0;
+    uint32_t packets_at_print = 0;
+    uint32_t reads_at_print = 0;
+
+    while (running) {
+        uint64_t now = now_us();
+        if ((duration > 0) && (now - start >= duration * 1e6 + ((send_rate != 0) ? DRAIN_US : 0))) {
+            break;
+        }
+
+        uint64_t wake = next_poll;
+        if ((input_tail != input_head) && (wire_next_us + WIRE_SLICE_US < wake)) {
+            wake = wire_next_us + WIRE_SLICE_US;
+        }
+        struct timespec timeout = { 0, 0 };
+        if (wake > now) {
+            timeout.tv_sec = (wake - now) / 1000000;
+            timeout.tv_nsec = ((wake - now) % 1000000) * 1000;
+        }
+        struct pollfd pfd = { .fd = master, .events = POLLIN };
+        if ((input_head - input_tail < INPUT_BUFFER_SIZE) && (ppoll(&pfd, 1, &timeout, NULL) > 0) && (pfd.revents & POLLIN)) {
+            size_t space = INPUT_BUFFER_SIZE - (input_head - input_tail);
+            size_t offset = input_head % INPUT_BUFFER_SIZE;
+            if (space > INPUT_BUFFER_SIZE - offset) {
+                space = INPUT_BUFFER_SIZE - offset;
+            }
+            ssize_t n = read(master, input + offset, space);
+            if (n > 0) {
+                if ((input_head == input_tail) && (wire_next_us < now_us() + byte_us)) {
+                    wire_next_us = now_us() + byte_us;
+                }
+                input_head += n;
+            } else if ((n < 0) && (errno != EAGAIN) && (errno != EIO)) {
+                perror("read");
+                break;
+            }
+        }
+
+        now = now_us();
+        if (input_tail != input_head) {
+            // Everything the simulated UART has finished receiving by now.
+            size_t due = input_head - input_tail;
+            if (byte_us > 0) {
+                due = (now >= wire_next_us) ? 1 + (size_t) ((now - wire_next_us) / byte_us) : 0;
+                if (due > input_head - input_tail) {
+                    due = input_head - input_tail;
+                }
+            }
+            if (due > 0) {
+                packet_set_source(TRANSPORT_UART, 0, time_us_32());
+                // In at most two pieces, where the ring wraps around.
+                size_t offset = input_tail % INPUT_BUFFER_SIZE;
+                size_t first = (due < INPUT_BUFFER_SIZE - offset) ? due : INPUT_BUFFER_SIZE - offset;
+                serial_read_bytes(input + offset, first);
+                serial_read_bytes(input, due - first);
+                input_tail += due;
+                wire_next_us += due * byte_us;
+                outgoing_reports_task();
+            }
+        }
+
+        // A real host doesn't skip frames when we're late, so neither does
+        // this one, unless we're so late it's pointless.
+        if ((now > next_poll) && (now - next_poll > MAX_POLL_BACKLOG * USB_POLL_INTERVAL_US)) {
+            next_poll = now;
+        }
+        while (now >= next_poll) {
+            usb_poll(frame_count++);
+            outgoing_reports_task();
+            next_poll += USB_POLL_INTERVAL_US;
+        }
+
+        if ((send_rate == 0) && (now >= next_print)) {
+            printf("%u packets/s, %u reports/s read, %u errors\n",
+                   rx_stats[TRANSPORT_UART].packets - packets_at_print, reports_read - reads_at_print, corrupted());
+            fflush(stdout);
+            packets_at_print = rx_stats[TRANSPORT_UART].packets;
+            reads_at_print = reports_read;
+            next_print += 1000000;
+        }
+    }
+
+    running = 0;
+    if (send_rate != 0) {
+        pthread_join(transmitter, NULL);
+    }
+    print_summary((now_us() - start) / 1e6);
+
+    if (check) {
+        bool lost = (send_rate != 0) && (rx_stats[TRANSPORT_UART].packets != frames_sent);
+        bool edges_lost = (send_rate != 0) && mix->edges && (superseded > 0);
+        if (corrupted() || lost || edges_lost) {
+            fprintf(stderr, "frames corrupted or reports lost\n");
+            return 1;
+        }
+    }
+    return 0;
+}
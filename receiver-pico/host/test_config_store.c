@@ -0,0 +1,199 @@
+// Runs the config log against a simulated flash: wear has to be spread
+// evenly over the sectors, and cutting the power in the middle of any
+// program or erase has to leave either the last complete write or the
+// interrupted one readable after a reboot, never anything older.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_store.h"
+
+#define CONFIG_SIZE 63
+#define SLOTS_PER_SECTOR (CONFIG_STORE_SECTOR_SIZE / CONFIG_STORE_RECORD_SIZE)
+
+static uint8_t flash_contents[CONFIG_STORE_SIZE];
+static uint32_t erase_counts[CONFIG_STORE_SECTORS];
+static uint32_t programs;
+
+// Operations left before the power goes, -1 for never. The operation that
+// gets cut only gets partway, everything after it doesn't happen at all.
+static int ops_until_power_loss = -1;
+static bool power_lost;
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng() {
+    rng_state = rng_state * 1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+static bool power_fails_now() {
+    if (ops_until_power_loss == 0) {
+        ops_until_power_loss = -1;
+        power_lost = true;
+        return true;
+    }
+    if (ops_until_power_loss > 0) {
+        ops_until_power_loss--;
+    }
+    return false;
+}
+
+static void sim_erase_sector(uint32_t offset) {
+    if ((offset % CONFIG_STORE_SECTOR_SIZE != 0) || (offset >= CONFIG_STORE_SIZE)) {
+        fprintf(stderr, "bad erase offset %u\n", offset);
+        exit(1);
+    }
+    if (power_lost) {
+        return;
+    }
+    uint32_t len = power_fails_now() ? rng() % CONFIG_STORE_SECTOR_SIZE : CONFIG_STORE_SECTOR_SIZE;
+    memset(flash_contents + offset, 0xFF, len);
+    erase_counts[offset / CONFIG_STORE_SECTOR_SIZE]++;
+}
+
+static void sim_program_page(uint32_t offset, const uint8_t* page) {
+    if ((offset % CONFIG_STORE_PAGE_SIZE != 0) || (offset >= CONFIG_STORE_SIZE)) {
+        fprintf(stderr, "bad program offset %u\n", offset);
+        exit(1);
+    }
+    if (power_lost) {
+        return;
+    }
+    uint32_t len = power_fails_now() ? rng() % CONFIG_STORE_PAGE_SIZE : CONFIG_STORE_PAGE_SIZE;
+    // Programming can only clear bits.
+    for (uint32_t i = 0; i < len; i++) {
+        flash_contents[offset + i] &= page[i];
+    }
+    programs++;
+}
+
+static const config_store_flash_t sim_flash = {
+    .contents = flash_contents,
+    .erase_sector = sim_erase_sector,
+    .program_page = sim_program_page,
+};
+
+static void make_config(uint8_t* config, uint32_t n) {
+    for (int i = 0; i < CONFIG_SIZE; i++) {
+        config[i] = n * 7 + i;
+    }
+    memcpy(config, &n, sizeof(n));
+}
+
+static uint32_t read_config_number() {
+    uint8_t config[CONFIG_SIZE];
+    uint8_t expected[CONFIG_SIZE];
+    uint32_t n;
+    if (!config_store_read(config, sizeof(config))) {
+        return UINT32_MAX;
+    }
+    memcpy(&n, config, sizeof(n));
+    make_config(expected, n);
+    if (memcmp(config, expected, sizeof(config)) != 0) {
+        fprintf(stderr, "config %u corrupted\n", n);
+        exit(1);
+    }
+    return n;
+}
+
+static void reset_flash(bool garbage) {
+    for (int i = 0; i < CONFIG_STORE_SIZE; i++) {
+        flash_contents[i] = garbage ? rng() : 0xFF;
+    }
+    memset(erase_counts, 0, sizeof(erase_counts));
+    programs = 0;
+    power_lost = false;
+    ops_until_power_loss = -1;
+    config_store_init(&sim_flash);
+}
+
+// idle: whether the background erase gets a chance to run between writes.
+static bool test_wear(bool idle) {
+    const uint32_t nwrites = 10000;
+    reset_flash(false);
+    for (uint32_t n = 0; n < nwrites; n++) {
+        uint8_t config[CONFIG_SIZE];
+        make_config(config, n);
+        if (!config_store_write(config, sizeof(config))) {
+            fprintf(stderr, "write %u failed\n", n);
+            return false;
+        }
+        if (idle) {
+            config_store_task();
+        }
+        if (read_config_number() != n) {
+            fprintf(stderr, "read back the wrong config after write %u\n", n);
+            return false;
+        }
+    }
+    config_store_init(&sim_flash);
+    if (read_config_number() != nwrites - 1) {
+        fprintf(stderr, "wrong config after reboot\n");
+        return false;
+    }
+
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint32_t total = 0;
+    for (int i = 0; i < CONFIG_STORE_SECTORS; i++) {
+        min = (erase_counts[i] < min) ? erase_counts[i] : min;
+        max = (erase_counts[i] > max) ? erase_counts[i] : max;
+        total += erase_counts[i];
+    }
+    printf("%s: %u writes, %u page programs, %u erases (%u-%u per sector)\n",
+           idle ? "idle" : "busy", nwrites, programs, total, min, max);
+    if ((programs != nwrites) || (max - min > 1) || (total > nwrites / SLOTS_PER_SECTOR + CONFIG_STORE_SECTORS)) {
+        fprintf(stderr, "wear not spread evenly\n");
+        return false;
+    }
+    return true;
+}
+
+static bool test_power_loss(bool garbage) {
+    const int iterations = 20000;
+    uint32_t committed = UINT32_MAX;
+    uint32_t n = 0;
+    int losses = 0;
+
+    reset_flash(garbage);
+    for (int i = 0; i < iterations; i++) {
+        ops_until_power_loss = (rng() % 4 == 0) ? (int) (rng() % 3) : -1;
+        if ((rng() % 3 == 0) && config_store_erase_pending()) {
+            config_store_task();
+        } else {
+            uint8_t config[CONFIG_SIZE];
+            make_config(config, ++n);
+            if (config_store_write(config, sizeof(config)) && !power_lost) {
+                committed = n;
+            }
+        }
+        if (!power_lost) {
+            ops_until_power_loss = -1;
+            continue;
+        }
+
+        losses++;
+        power_lost = false;
+        config_store_init(&sim_flash);
+        uint32_t read = read_config_number();
+        if ((read != committed) && (read != n)) {
+            fprintf(stderr, "after power loss %d: read config %d, last complete write %d, interrupted %u\n",
+                    losses, (int) read, (int) committed, n);
+            return false;
+        }
+        committed = read;
+    }
+    printf("%s flash: %d power losses, last config survived every one\n", garbage ? "garbage" : "blank", losses);
+    return true;
+}
+
+int main() {
+    bool ok = test_wear(true) &&
+              test_wear(false) &&
+              test_power_loss(false) &&
+              test_power_loss(true);
+    return ok ? 0 : 1;
+}
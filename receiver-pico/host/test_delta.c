@@ -0,0 +1,132 @@
+// Runs the receiver's protocol version 2 decoder on its own: keyframes and
+// deltas have to rebuild the report, a lost frame has to stop deltas until
+// the next keyframe, and malformed runs must neither be applied nor write
+// past the report.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "delta.h"
+#include "host_test.h"
+
+#define DESCRIPTOR 2
+#define REPORT_ID 0
+#define LEN 64
+
+static const uint8_t* keyframe(uint8_t source, uint8_t seq, const uint8_t* report, uint8_t len) {
+    return delta_decode(source, DESCRIPTOR, REPORT_ID, len, seq, DELTA_FLAG_KEYFRAME, report, len);
+}
+
+static const uint8_t* delta(uint8_t source, uint8_t seq, const uint8_t* body, uint16_t body_len) {
+    return delta_decode(source, DESCRIPTOR, REPORT_ID, LEN, seq, 0, body, body_len);
+}
+
+static void fill(uint8_t* report, uint8_t value) {
+    for (int i = 0; i < LEN; i++) {
+        report[i] = value + i;
+    }
+}
+
+static bool equals(const uint8_t* decoded, const uint8_t* expected, const char* what) {
+    return check((decoded != NULL) && (memcmp(decoded, expected, LEN) == 0), what);
+}
+
+static bool test_apply() {
+    uint8_t report[LEN];
+    delta_reset();
+    fill(report, 0);
+    bool ok = equals(keyframe(0, 10, report, LEN), report, "keyframe wasn't applied");
+
+    // Two runs, one of them up to the end of the report.
+    const uint8_t body[] = { 3, 2, 0xAA, 0xBB, 62, 2, 0xCC, 0xDD };
+    report[3] = 0xAA;
+    report[4] = 0xBB;
+    report[62] = 0xCC;
+    report[63] = 0xDD;
+    ok = ok && equals(delta(0, 11, body, sizeof(body)), report, "delta wasn't applied");
+
+    // No runs at all, nothing changed.
+    ok = ok && equals(delta(0, 12, NULL, 0), report, "empty delta wasn't applied");
+
+    // The sequence number wraps around.
+    ok = ok && equals(keyframe(0, 255, report, LEN), report, "keyframe wasn't applied");
+    const uint8_t body2[] = { 0, 1, 0x11 };
+    report[0] = 0x11;
+    return ok && equals(delta(0, 0, body2, sizeof(body2)), report, "delta after wraparound wasn't applied");
+}
+
+static bool test_gap() {
+    uint8_t report[LEN];
+    delta_reset();
+    fill(report, 0);
+    keyframe(0, 1, report, LEN);
+    const uint8_t body[] = { 0, 1, 0x55 };
+    bool ok = check(delta(0, 3, body, sizeof(body)) == NULL, "delta after a gap was applied");
+    // The next one in sequence after the gap can't be trusted either.
+    ok = ok && check(delta(0, 4, body, sizeof(body)) == NULL, "delta after a gap was applied");
+    ok = ok && check(delta(0, 2, body, sizeof(body)) == NULL, "delta after a gap was applied");
+    // Repeated frames count as a gap too.
+    fill(report, 7);
+    ok = ok && equals(keyframe(0, 20, report, LEN), report, "keyframe after a gap wasn't applied");
+    ok = ok && check(delta(0, 20, body, sizeof(body)) == NULL, "repeated delta was applied");
+
+    ok = ok && equals(keyframe(0, 30, report, LEN), report, "keyframe wasn't applied");
+    report[0] = 0x55;
+    ok = ok && equals(delta(0, 31, body, sizeof(body)), report, "delta after a keyframe wasn't applied");
+
+    // A different length means a different report, the state is stale.
+    ok = ok && check(delta_decode(0, DESCRIPTOR, REPORT_ID, LEN - 1, 32, 0, body, sizeof(body)) == NULL,
+                     "delta with another length was applied");
+    ok = ok && check(delta(0, 33, body, sizeof(body)) == NULL, "delta after a length change was applied");
+
+    // Without any keyframe there's nothing to apply deltas to.
+    return ok && check(delta(1, 0, body, sizeof(body)) == NULL, "delta without a keyframe was applied");
+}
+
+static bool test_malformed() {
+    uint8_t report[LEN];
+    uint8_t neighbour[LEN];
+    delta_reset();
+    // Two sources' states, next to each other, so a write past the first
+    // report would show up in the second.
+    fill(report, 0);
+    fill(neighbour, 100);
+    keyframe(0, 0, report, LEN);
+    keyframe(1, 0, neighbour, LEN);
+
+    static const struct {
+        const char* what;
+        uint8_t body[8];
+        uint8_t len;
+    } bad[] = {
+        { "run past the end of the report", { 60, 5, 1, 2, 3, 4, 5 }, 7 },
+        { "run starting past the end", { 64, 1, 1 }, 3 },
+        { "run longer than the body", { 0, 6, 1, 2, 3 }, 5 },
+        { "truncated run header", { 0, 1, 9, 5 }, 4 },
+        { "good run before an overlong one", { 0, 1, 9, 63, 255, 1, 2, 3 }, 8 },
+    };
+
+    bool ok = true;
+    for (size_t i = 0; ok && (i < sizeof(bad) / sizeof(bad[0])); i++) {
+        ok = check(delta(0, i + 1, bad[i].body, bad[i].len) == NULL, bad[i].what);
+        // Rejected, but the state is intact and the next frame applies.
+        ok = ok && equals(delta(0, i + 1, NULL, 0), report, "state changed by a rejected frame");
+    }
+    ok = ok && equals(delta(1, 1, NULL, 0), neighbour, "other source's state was overwritten");
+
+    // Keyframes longer than the state can hold, or shorter than they claim.
+    uint8_t big[LEN + 1] = { 0 };
+    ok = ok && check(delta_decode(0, DESCRIPTOR, REPORT_ID, LEN + 1, 10, DELTA_FLAG_KEYFRAME, big, sizeof(big)) == NULL,
+                     "overlong keyframe was applied");
+    ok = ok && check(delta_decode(0, DESCRIPTOR, REPORT_ID, LEN, 10, DELTA_FLAG_KEYFRAME, big, LEN - 1) == NULL,
+                     "short keyframe was applied");
+    return ok && equals(delta(1, 2, NULL, 0), neighbour, "other source's state was overwritten");
+}
+
+int main() {
+    bool ok = test_apply() &&
+              test_gap() &&
+              test_malformed();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+// Checks the canonical gamepad packers against the report descriptors in
+// descriptors.c: every button has to land on a button, the sticks on X, Y,
+// Z and Rz, the triggers on an analog trigger and the hat switch on the hat
+// switch, and every gamepad descriptor has to have a packer. Then sends
+// canonical reports through the receiver to each emulated gamepad and
+// compares what comes out with reports built by hand.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+
+#include "host_frames.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#include "descriptors.h"
+#include "gamepad.h"
+#include "globals.h"
+#include "packet.h"
+#include "stats.h"
+
+#define MAX_FIELDS 256
+
+#define PAGE_GENERIC_DESKTOP 0x01
+#define PAGE_SIMULATION 0x02
+#define PAGE_BUTTON 0x09
+
+#define USAGE_GAMEPAD 0x05
+#define USAGE_X 0x30
+#define USAGE_Y 0x31
+#define USAGE_Z 0x32
+#define USAGE_RX 0x33
+#define USAGE_RY 0x34
+#define USAGE_RZ 0x35
+#define USAGE_HAT_SWITCH 0x39
+#define USAGE_ACCELERATOR 0xC4
+#define USAGE_BRAKE 0xC5
+
+typedef struct {
+    uint8_t report_id;
+    uint16_t bit;
+    uint8_t size;
+    uint16_t page;
+    uint16_t usage;
+    bool constant;
+} field_t;
+
+typedef struct {
+    field_t fields[MAX_FIELDS];
+    int nfields;
+    uint16_t input_bits[256];
+    bool gamepad;
+} parsed_t;
+
+// Defined in descriptors.c.
+uint8_t const* tud_descriptor_configuration_cb(uint8_t index);
+uint8_t const* tud_hid_descriptor_report_cb(uint8_t itf);
+
+static bool check_descriptor(bool condition, const char* what, uint8_t descriptor_number) {
+    if (!condition) {
+        fprintf(stderr, "descriptor %u: ", descriptor_number);
+    }
+    return check(condition, what);
+}
+
+// Length of interface 0's report descriptor, from its HID descriptor.
+static uint16_t report_descriptor_len() {
+    const uint8_t* p = tud_descriptor_configuration_cb(0);
+    const uint8_t* end = p + (p[2] | (p[3] << 8));
+    uint8_t interface = NO_DESCRIPTOR;
+    while ((p < end) && (p[0] != 0)) {
+        if (p[1] == TUSB_DESC_INTERFACE) {
+            interface = p[2];
+        } else if ((p[1] == HID_DESC_TYPE_HID) && (interface == 0)) {
+            return p[7] | (p[8] << 8);
+        }
+        p += p[0];
+    }
+    return 0;
+}
+
+// Just enough of a report descriptor parser for the input reports of our
+// descriptors: no push/pop, no delimiters, no long items.
+static void parse(const uint8_t* desc, uint16_t len, parsed_t* out) {
+    memset(out, 0, sizeof(*out));
+    uint16_t page = 0;
+    uint8_t report_size = 0;
+    uint8_t report_count = 0;
+    uint8_t report_id = 0;
+    uint16_t usages[64];
+    int nusages = 0;
+    uint16_t usage_min = 0;
+    uint16_t usage_max = 0;
+    bool usage_range = false;
+
+    uint16_t i = 0;
+    while (i < len) {
+        uint8_t prefix = desc[i];
+        uint8_t size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+        uint32_t value = 0;
+        for (int b = 0; b < size; b++) {
+            value |= (uint32_t) desc[i + 1 + b] << (8 * b);
+        }
+        i += 1 + size;
+
+        switch (prefix & 0xFC) {
+            case 0x04:  // Usage Page
+                page = value;
+                break;
+            case 0x74:  // Report Size
+                report_size = value;
+                break;
+            case 0x94:  // Report Count
+                report_count = value;
+                break;
+            case 0x84:  // Report ID
+                report_id = value;
+                break;
+            case 0x08:  // Usage
+                if (nusages < 64) {
+                    usages[nusages++] = value;
+                }
+                break;
+            case 0x18:  // Usage Minimum
+                usage_min = value;
+                usage_range = true;
+                break;
+            case 0x28:  // Usage Maximum
+                usage_max = value;
+                break;
+            case 0xA0:  // Collection
+                if ((value == 0x01) && (page == PAGE_GENERIC_DESKTOP) && (nusages > 0) && (usages[0] == USAGE_GAMEPAD)) {
+                    out->gamepad = true;
+                }
+                nusages = 0;
+                usage_range = false;
+                break;
+            case 0x80:  // Input
+                for (int n = 0; n < report_count; n++) {
+                    field_t* f = &out->fields[out->nfields++];
+                    f->report_id = report_id;
+                    f->bit = out->input_bits[report_id];
+                    f->size = report_size;
+                    f->page = page;
+                    f->constant = value & 1;
+                    if (usage_range) {
+                        f->usage = (usage_min + n <= usage_max) ? usage_min + n : usage_max;
+                    } else if (nusages > 0) {
+                        f->usage = usages[(n < nusages) ? n : nusages - 1];
+                    }
+                    out->input_bits[report_id] += report_size;
+                }
+                nusages = 0;
+                usage_range = false;
+                break;
+            case 0x90:  // Output
+            case 0xB0:  // Feature
+            case 0xC0:  // End Collection
+                nusages = 0;
+                usage_range = false;
+                break;
+        }
+    }
+}
+
+static const field_t* field_at(const parsed_t* parsed, uint8_t report_id, uint16_t bit) {
+    for (int i = 0; i < parsed->nfields; i++) {
+        const field_t* f = &parsed->fields[i];
+        if ((f->report_id == report_id) && (f->bit == bit)) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static bool is_field(const field_t* f, uint8_t size, uint16_t page, uint16_t usage) {
+    return (f != NULL) && !f->constant && (f->size == size) && (f->page == page) && (f->usage == usage);
+}
+
+static bool check_layout(uint8_t n) {
+    usb_descriptor_number = n;
+    parsed_t parsed;
+    parse(tud_hid_descriptor_report_cb(0), report_descriptor_len(), &parsed);
+    const gamepad_layout_t* layout = gamepad_layout(n);
+
+    if (!check_descriptor(parsed.gamepad == (layout != NULL), "gamepad descriptor without a packer or the other way round", n)) {
+        return false;
+    }
+    if (layout == NULL) {
+        return true;
+    }
+
+    bool ok = check_descriptor(layout->len * 8 == parsed.input_bits[layout->report_id], "wrong report length", n);
+    uint64_t used = 0;
+    for (int i = 0; i < GAMEPAD_BUTTONS; i++) {
+        uint8_t bit = layout->buttons[i];
+        if (bit == GAMEPAD_NONE) {
+            continue;
+        }
+        const field_t* f = field_at(&parsed, layout->report_id, bit);
+        ok = check_descriptor((f != NULL) && !f->constant && (f->size == 1) && (f->page == PAGE_BUTTON), "button isn't on a button", n) && ok;
+        ok = check_descriptor(!(used & (1ULL << bit)), "two buttons on the same bit", n) && ok;
+        used |= 1ULL << bit;
+    }
+
+    static const uint16_t stick_usages[] = { USAGE_X, USAGE_Y, USAGE_Z, USAGE_RZ };
+    for (int i = 0; i < GAMEPAD_L2_AXIS; i++) {
+        ok = check_descriptor(is_field(field_at(&parsed, layout->report_id, layout->axes[i] * 8), 8, PAGE_GENERIC_DESKTOP, stick_usages[i]),
+                   "stick isn't on X, Y, Z or Rz", n) &&
+             ok;
+    }
+    for (int i = GAMEPAD_L2_AXIS; i < GAMEPAD_AXES; i++) {
+        if (layout->axes[i] == GAMEPAD_NONE) {
+            continue;
+        }
+        const field_t* f = field_at(&parsed, layout->report_id, layout->axes[i] * 8);
+        bool left = (i == GAMEPAD_L2_AXIS);
+        ok = check_descriptor(is_field(f, 8, PAGE_GENERIC_DESKTOP, left ? USAGE_RX : USAGE_RY) ||
+                       is_field(f, 8, PAGE_SIMULATION, left ? USAGE_BRAKE : USAGE_ACCELERATOR),
+                   "trigger isn't on an analog trigger", n) &&
+             ok;
+    }
+
+    ok = check_descriptor(is_field(field_at(&parsed, layout->report_id, layout->hat), 4, PAGE_GENERIC_DESKTOP, USAGE_HAT_SWITCH),
+               "hat switch isn't on the hat switch", n) &&
+         ok;
+    return ok;
+}
+
+static void canonical(uint8_t* report, uint32_t buttons, int16_t lx, int16_t ly, int16_t rx, int16_t ry, uint16_t l2, uint16_t r2) {
+    uint16_t values[] = { (uint16_t) lx, (uint16_t) ly, (uint16_t) rx, (uint16_t) ry, l2, r2 };
+    for (int i = 0; i < 4; i++) {
+        report[i] = buttons >> (8 * i);
+    }
+    for (int i = 0; i < 6; i++) {
+        report[4 + 2 * i] = values[i] & 0xFF;
+        report[5 + 2 * i] = values[i] >> 8;
+    }
+}
+
+static void send_canonical(const uint8_t* report) {
+    uint8_t packet[4 + GAMEPAD_REPORT_SIZE];
+    uint8_t frame[SLIP_FRAME_MAX_SIZE(sizeof(packet))];
+    size_t len = build_packet(packet, GAMEPAD_DESCRIPTOR, GAMEPAD_REPORT_ID, report, GAMEPAD_REPORT_SIZE);
+    serial_read_bytes(frame, slip_encode_frame(packet, len, frame));
+}
+
+static bool sent(uint8_t n, uint8_t report_id, const uint8_t* expected, uint8_t len) {
+    bool ok = check_descriptor(host_last_report_id == report_id, "wrong report ID", n);
+    ok = check_descriptor(host_last_report_len == len, "wrong report length", n) && ok;
+    ok = check_descriptor(memcmp(host_last_report, expected, len) == 0, "wrong report", n) && ok;
+    return ok;
+}
+
+static void reset(uint8_t descriptor_number) {
+    host_stubs_reset();
+    memset(rx_stats, 0, sizeof(rx_stats));
+    composite_mode = false;
+    our_descriptor_number = descriptor_number;
+    usb_descriptor_number = descriptor_number;
+    packet_forget_source(TRANSPORT_UART, 0);
+    packet_set_source(TRANSPORT_UART, 0, 0);
+}
+
+static bool check_packing() {
+    uint8_t report[GAMEPAD_REPORT_SIZE];
+    bool ok = true;
+
+    // East (A on a Switch controller) and up-right on the dpad, left stick
+    // all the way right and up, right stick centered, right trigger held.
+    uint32_t buttons = (1 << GAMEPAD_EAST) | (1 << GAMEPAD_DPAD_UP) | (1 << GAMEPAD_DPAD_RIGHT);
+    canonical(report, buttons, 32767, -32768, 0, 0, 0, 0xFFFF);
+
+    reset(2);
+    send_canonical(report);
+    static const uint8_t switch_report[] = { 0x04, 0x00, 0x01, 0xFF, 0x00, 0x80, 0x80, 0x00 };
+    ok = sent(2, 0, switch_report, sizeof(switch_report)) && ok;
+
+    reset(3);
+    send_canonical(report);
+    uint8_t ps4_report[63] = { 0xFF, 0x00, 0x80, 0x80, 0x01 | (1 << 6), 0x00, 0x00, 0x00, 0xFF };
+    ok = sent(3, 1, ps4_report, sizeof(ps4_report)) && ok;
+
+    reset(4);
+    send_canonical(report);
+    // The sticks don't go below 1.
+    static const uint8_t stadia_report[] = { 0x01, 0x00, 0x20, 0xFF, 0x01, 0x80, 0x80, 0x00, 0xFF, 0x00 };
+    ok = sent(4, 3, stadia_report, sizeof(stadia_report)) && ok;
+
+    reset(5);
+    send_canonical(report);
+    static const uint8_t xac_report[] = { 0xFF, 0x00, 0x80, 0x80, 0x01 | (1 << 5), 0x00 };
+    ok = sent(5, 0, xac_report, sizeof(xac_report)) && ok;
+
+    // Nothing pressed, centered hat.
+    canonical(report, 0, 0, 0, 0, 0, 0, 0);
+    reset(2);
+    send_canonical(report);
+    static const uint8_t switch_idle[] = { 0x00, 0x00, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    ok = sent(2, 0, switch_idle, sizeof(switch_idle)) && ok;
+
+    // In composite mode they go to the Switch gamepad's interface.
+    reset(0);
+    composite_mode = true;
+    send_canonical(report);
+    ok = check_descriptor(our_descriptor_number == 0, "switched descriptors in composite mode", 0) && ok;
+    ok = check_descriptor(host_last_report_instance == 3, "not sent on the gamepad's interface", 0) && ok;
+    ok = sent(2, 0, switch_idle, sizeof(switch_idle)) && ok;
+    composite_mode = false;
+
+    // Not emulating a gamepad: the receiver switches to the Switch gamepad.
+    // The report waits for it to re-enumerate.
+    reset(0);
+    send_canonical(report);
+    ok = check_descriptor((our_descriptor_number == 2) && (usb_descriptor_number == 2), "didn't switch to the Switch gamepad", 0) && ok;
+
+    const transport_stats_t* s = &rx_stats[TRANSPORT_UART];
+    ok = check_descriptor((s->invalid_packets == 0) && (s->queue_drops == 0), "packets were dropped", 0) && ok;
+
+    // Anything but a 16 byte report with ID 0 is invalid.
+    reset(2);
+    uint8_t packet[4 + GAMEPAD_REPORT_SIZE];
+    uint8_t frame[SLIP_FRAME_MAX_SIZE(sizeof(packet))];
+    size_t len = build_packet(packet, GAMEPAD_DESCRIPTOR, GAMEPAD_REPORT_ID, report, GAMEPAD_REPORT_SIZE - 1);
+    serial_read_bytes(frame, slip_encode_frame(packet, len, frame));
+    ok = check_descriptor((rx_stats[TRANSPORT_UART].invalid_packets == 1) && (host_reports_sent == 0), "short report accepted", 2) && ok;
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    for (uint8_t n = 0; n < NOUR_DESCRIPTORS; n++) {
+        ok = check_layout(n) && ok;
+    }
+    usb_descriptor_number = 0;
+    ok = check_packing() && ok;
+
+    if (!ok) {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Feeds several senders into the receiver at once: SLIP streams from the
+// UART and two Bluetooth connections interleaved byte by byte have to
+// decode cleanly, and with a merge policy set the reports that go out
+// have to combine what each sender is holding.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_frames.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#include "globals.h"
+#include "merge.h"
+#include "packet.h"
+#include "stats.h"
+
+static size_t gamepad_frame(uint8_t* out, uint8_t buttons, uint8_t hat, uint8_t lx) {
+    uint8_t report[SWITCH_REPORT_SIZE];
+    uint8_t packet[64];
+    fill_switch_report(report, buttons, hat, lx);
+    size_t len = build_packet(packet, SWITCH_GAMEPAD, SWITCH_REPORT_ID, report, sizeof(report));
+    return slip_encode_frame(packet, len, out);
+}
+
+static void send_from(uint8_t transport, uint8_t peer, uint32_t now_us, uint8_t buttons, uint8_t hat, uint8_t lx) {
+    uint8_t frame[SLIP_FRAME_MAX_SIZE(64)];
+    size_t len = gamepad_frame(frame, buttons, hat, lx);
+    packet_set_source(transport, peer, now_us);
+    for (size_t i = 0; i < len; i++) {
+        serial_read_byte(frame[i]);
+    }
+}
+
+static bool sent(uint8_t buttons, uint8_t hat, uint8_t lx) {
+    uint8_t expected[SWITCH_REPORT_SIZE];
+    fill_switch_report(expected, buttons, hat, lx);
+    if ((host_last_report_len != SWITCH_REPORT_SIZE) || (memcmp(host_last_report, expected, sizeof(expected)) != 0)) {
+        fprintf(stderr, "sent buttons %02x hat %u lx %02x, expected %02x %u %02x\n",
+                host_last_report[0], host_last_report[2], host_last_report[3], buttons, hat, lx);
+        return false;
+    }
+    return true;
+}
+
+static void reset(uint8_t policy) {
+    host_stubs_reset();
+    memset(rx_stats, 0, sizeof(rx_stats));
+    our_descriptor_number = SWITCH_GAMEPAD;
+    usb_descriptor_number = SWITCH_GAMEPAD;
+    merge_reset();
+    merge_set_policy(policy);
+    for (int peer = 0; peer < BT_MAX_PEERS; peer++) {
+        packet_forget_source(TRANSPORT_BT, peer);
+    }
+    packet_forget_source(TRANSPORT_UART, 0);
+}
+
+// Three senders whose frames arrive a byte at a time, round robin.
+static bool test_interleaved() {
+    const int nframes = 100;
+    uint8_t frames[3][SLIP_FRAME_MAX_SIZE(64)];
+    size_t lens[3];
+    size_t pos[3] = { 0, 0, 0 };
+
+    reset(MERGE_POLICY_LATEST);
+    for (int n = 0; n < nframes; n++) {
+        for (int s = 0; s < 3; s++) {
+            lens[s] = gamepad_frame(frames[s], 1 << s, SWITCH_HAT_CENTERED, n);
+            pos[s] = 0;
+        }
+        bool more = true;
+        while (more) {
+            more = false;
+            for (int s = 0; s < 3; s++) {
+                if (pos[s] < lens[s]) {
+                    packet_set_source((s == 0) ? TRANSPORT_UART : TRANSPORT_BT, (s == 0) ? 0 : s - 1, n);
+                    serial_read_byte(frames[s][pos[s]++]);
+                    more = true;
+                }
+            }
+        }
+    }
+
+    uint32_t errors = 0;
+    for (int t = 0; t < NTRANSPORTS; t++) {
+        errors += rx_stats[t].crc_errors + rx_stats[t].framing_errors + rx_stats[t].invalid_packets;
+    }
+    printf("interleaved: %u reports sent, %u UART and %u Bluetooth packets, %u errors\n",
+           host_reports_sent, rx_stats[TRANSPORT_UART].packets, rx_stats[TRANSPORT_BT].packets, errors);
+    return check(errors == 0, "interleaved frames corrupted") &&
+           check(host_reports_sent == 3 * nframes, "reports lost");
+}
+
+static bool test_combine() {
+    reset(MERGE_POLICY_COMBINE);
+    send_from(TRANSPORT_UART, 0, 0, SWITCH_BUTTON_A, SWITCH_HAT_CENTERED, 0xC0);
+    if (!sent(SWITCH_BUTTON_A, SWITCH_HAT_CENTERED, 0xC0)) {
+        return false;
+    }
+    // Both held: buttons pressed on either, deflections added up.
+    send_from(TRANSPORT_BT, 1, 1000, SWITCH_BUTTON_B, 2, 0x60);
+    if (!sent(SWITCH_BUTTON_A | SWITCH_BUTTON_B, 2, 0xA0)) {
+        return false;
+    }
+    send_from(TRANSPORT_UART, 0, 2000, SWITCH_BUTTON_A, SWITCH_HAT_CENTERED, 0xF0);
+    if (!sent(SWITCH_BUTTON_A | SWITCH_BUTTON_B, 2, 0xD0)) {
+        return false;
+    }
+    // Saturates instead of wrapping around.
+    send_from(TRANSPORT_BT, 1, 3000, SWITCH_BUTTON_B, 2, 0xFF);
+    if (!sent(SWITCH_BUTTON_A | SWITCH_BUTTON_B, 2, 0xFF)) {
+        return false;
+    }
+    // A sender that goes away stops contributing.
+    packet_forget_source(TRANSPORT_BT, 1);
+    send_from(TRANSPORT_UART, 0, 4000, SWITCH_BUTTON_A, SWITCH_HAT_CENTERED, 0xC0);
+    if (!sent(SWITCH_BUTTON_A, SWITCH_HAT_CENTERED, 0xC0)) {
+        return false;
+    }
+    // So does one that stays quiet for too long.
+    send_from(TRANSPORT_BT, 0, 5000, SWITCH_BUTTON_Y, SWITCH_HAT_CENTERED, 0x80);
+    if (!sent(SWITCH_BUTTON_A | SWITCH_BUTTON_Y, SWITCH_HAT_CENTERED, 0xC0)) {
+        return false;
+    }
+    send_from(TRANSPORT_UART, 0, 5000 + MERGE_SOURCE_TIMEOUT_US, 0, SWITCH_HAT_CENTERED, 0x80);
+    return check(sent(0, SWITCH_HAT_CENTERED, 0x80), "idle sender still merged");
+}
+
+static bool test_priority() {
+    reset(MERGE_POLICY_PRIORITY);
+    send_from(TRANSPORT_BT, 0, 0, SWITCH_BUTTON_B, 4, 0x20);
+    send_from(TRANSPORT_UART, 0, 1000, 0, SWITCH_HAT_CENTERED, 0x80);
+    // The UART is centered, so the Bluetooth sender's stick and hat win.
+    if (!sent(SWITCH_BUTTON_B, 4, 0x20)) {
+        return false;
+    }
+    // Until the UART moves.
+    send_from(TRANSPORT_UART, 0, 2000, SWITCH_BUTTON_A, 6, 0xE0);
+    if (!sent(SWITCH_BUTTON_A | SWITCH_BUTTON_B, 6, 0xE0)) {
+        return false;
+    }
+    send_from(TRANSPORT_BT, 0, 3000, SWITCH_BUTTON_B, 4, 0x10);
+    return sent(SWITCH_BUTTON_A | SWITCH_BUTTON_B, 6, 0xE0);
+}
+
+// Relative movement from one sender is never replayed with another's report.
+static bool test_relative() {
+    uint8_t packet[64];
+    uint8_t frame[SLIP_FRAME_MAX_SIZE(64)];
+    // buttons, x, y, vscroll, hscroll
+    uint8_t move[9] = { 1, 10, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t click[9] = { 2, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    reset(MERGE_POLICY_COMBINE);
+    our_descriptor_number = 0;
+    usb_descriptor_number = 0;
+    size_t len = slip_encode_frame(packet, build_packet(packet, 0, 1, move, sizeof(move)), frame);
+    packet_set_source(TRANSPORT_UART, 0, 0);
+    for (size_t i = 0; i < len; i++) {
+        serial_read_byte(frame[i]);
+    }
+    len = slip_encode_frame(packet, build_packet(packet, 0, 1, click, sizeof(click)), frame);
+    packet_set_source(TRANSPORT_BT, 0, 1000);
+    for (size_t i = 0; i < len; i++) {
+        serial_read_byte(frame[i]);
+    }
+    return check((host_last_report_len == sizeof(click)) && (host_last_report[0] == 3) && (host_last_report[1] == 0),
+                 "relative movement merged");
+}
+
+int main() {
+    bool ok = test_interleaved() &&
+              test_combine() &&
+              test_priority() &&
+              test_relative();
+    return ok ? 0 : 1;
+}
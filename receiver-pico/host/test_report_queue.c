@@ -0,0 +1,205 @@
+// Checks the report queue's coalescing rules directly: relative movement
+// is summed, button, hat switch and key presses and releases that happen
+// between two polls each get a report of their own, and report IDs can't
+// use up the slots for good.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "report_pool.h"
+#include "report_queue.h"
+
+#define INSTANCE 0
+
+static bool push(uint8_t descriptor, uint8_t report_id, const uint8_t* data, uint8_t len) {
+    report_ref_t ref;
+    if (!report_pool_hold(&ref, data, len, NO_BUFFER)) {
+        fprintf(stderr, "out of pool buffers\n");
+        return false;
+    }
+    return report_queue_push(INSTANCE, descriptor, report_id, &ref, 0);
+}
+
+// The host reads the oldest waiting report, which has to be expected.
+static bool read_report(uint8_t report_id, const uint8_t* expected, uint8_t expected_len) {
+    uint8_t id;
+    const uint8_t* data;
+    uint8_t len;
+    uint32_t arrival_us;
+    if (!report_queue_peek(INSTANCE, &id, &data, &len, &arrival_us)) {
+        fprintf(stderr, "no report waiting\n");
+        return false;
+    }
+    if ((id != report_id) || (len != expected_len) || (memcmp(data, expected, len) != 0)) {
+        fprintf(stderr, "report ID %u len %u isn't the expected one\n", id, len);
+        return false;
+    }
+    report_queue_pop(INSTANCE);
+    report_queue_complete(INSTANCE);
+    return true;
+}
+
+// A report that went straight to the endpoint, which the queue compares
+// the next ones against.
+static void sent(uint8_t descriptor, uint8_t report_id, const uint8_t* data, uint8_t len) {
+    report_ref_t ref;
+    report_pool_hold(&ref, data, len, NO_BUFFER);
+    report_queue_sent(INSTANCE, descriptor, report_id, &ref);
+    report_queue_complete(INSTANCE);
+}
+
+static void mouse(uint8_t* report, uint8_t buttons, int16_t x) {
+    memset(report, 0, MOUSE_REPORT_SIZE);
+    report[0] = buttons;
+    report[1] = x & 0xFF;
+    report[2] = (x >> 8) & 0xFF;
+}
+
+static bool test_relative() {
+    uint8_t a[MOUSE_REPORT_SIZE];
+    uint8_t b[MOUSE_REPORT_SIZE];
+    mouse(a, 0, 5);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    mouse(a, 0, -300);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    mouse(a, 0, 7);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    // A click stays on its own side of the movement.
+    mouse(a, 1, 10);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    mouse(a, 1, 20);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+
+    mouse(a, 0, 5 - 300 + 7);
+    mouse(b, 1, 30);
+    return check(read_report(MOUSE_REPORT_ID, a, sizeof(a)), "movement wasn't summed") &&
+           check(read_report(MOUSE_REPORT_ID, b, sizeof(b)), "movement after the click wasn't summed") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+static bool test_saturation() {
+    uint8_t a[MOUSE_REPORT_SIZE];
+    mouse(a, 0, 30000);
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a));
+    mouse(a, 0, INT16_MAX);
+    return check(read_report(MOUSE_REPORT_ID, a, sizeof(a)), "summed movement didn't saturate") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+static bool test_button_tap() {
+    uint8_t idle[SWITCH_REPORT_SIZE];
+    uint8_t pressed[SWITCH_REPORT_SIZE];
+    fill_switch_report(idle, 0, SWITCH_HAT_CENTERED, 0x80);
+    fill_switch_report(pressed, 1 << 2, SWITCH_HAT_CENTERED, 0x80);
+    sent(SWITCH_GAMEPAD, SWITCH_REPORT_ID, idle, sizeof(idle));
+    push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, pressed, sizeof(pressed));
+    push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, idle, sizeof(idle));
+    return check(read_report(SWITCH_REPORT_ID, pressed, sizeof(pressed)), "button press was lost") &&
+           check(read_report(SWITCH_REPORT_ID, idle, sizeof(idle)), "button release was lost") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+static bool test_hat_tap() {
+    uint8_t idle[SWITCH_REPORT_SIZE];
+    uint8_t up[SWITCH_REPORT_SIZE];
+    uint8_t moved[SWITCH_REPORT_SIZE];
+    fill_switch_report(idle, 0, SWITCH_HAT_CENTERED, 0x80);
+    fill_switch_report(up, 0, 0, 0x80);
+    fill_switch_report(moved, 0, SWITCH_HAT_CENTERED, 0xC0);
+    sent(SWITCH_GAMEPAD, SWITCH_REPORT_ID, idle, sizeof(idle));
+    push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, up, sizeof(up));
+    push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, idle, sizeof(idle));
+    // Stick movement alone is merged, the latest position wins.
+    push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, moved, sizeof(moved));
+    return check(read_report(SWITCH_REPORT_ID, up, sizeof(up)), "d-pad press was lost") &&
+           check(read_report(SWITCH_REPORT_ID, moved, sizeof(moved)), "d-pad release was lost or the stick wasn't merged") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+static bool test_key_tap() {
+    uint8_t idle[KEYBOARD_REPORT_SIZE] = { 0 };
+    uint8_t pressed[KEYBOARD_REPORT_SIZE] = { 0 };
+    uint8_t other[KEYBOARD_REPORT_SIZE] = { 0 };
+    pressed[5] = 1 << 3;
+    other[9] = 1 << 1;
+    sent(KB_MOUSE, KEYBOARD_REPORT_ID, idle, sizeof(idle));
+    push(KB_MOUSE, KEYBOARD_REPORT_ID, pressed, sizeof(pressed));
+    push(KB_MOUSE, KEYBOARD_REPORT_ID, idle, sizeof(idle));
+    // Another key going down doesn't hide the release, so it's merged.
+    push(KB_MOUSE, KEYBOARD_REPORT_ID, other, sizeof(other));
+    return check(read_report(KEYBOARD_REPORT_ID, pressed, sizeof(pressed)), "key press was lost") &&
+           check(read_report(KEYBOARD_REPORT_ID, other, sizeof(other)), "key release or second press was lost") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+// The queue keeps the newest state when a slot is out of room for edges.
+static bool test_depth() {
+    uint8_t reports[8][SWITCH_REPORT_SIZE];
+    uint8_t idle[SWITCH_REPORT_SIZE];
+    fill_switch_report(idle, 0, SWITCH_HAT_CENTERED, 0x80);
+    sent(SWITCH_GAMEPAD, SWITCH_REPORT_ID, idle, sizeof(idle));
+    bool dropped = false;
+    for (int i = 0; i < 8; i++) {
+        fill_switch_report(reports[i], (i & 1) ? 0 : 1, SWITCH_HAT_CENTERED, i);
+        dropped |= !push(SWITCH_GAMEPAD, SWITCH_REPORT_ID, reports[i], SWITCH_REPORT_SIZE);
+    }
+    bool ok = check(dropped, "overflow wasn't reported");
+    for (int i = 0; i < 3; i++) {
+        ok = ok && check(read_report(SWITCH_REPORT_ID, reports[i], SWITCH_REPORT_SIZE), "queued edge was lost");
+    }
+    return ok &&
+           check(read_report(SWITCH_REPORT_ID, reports[7], SWITCH_REPORT_SIZE), "newest state was lost") &&
+           check(report_queue_empty(INSTANCE), "more reports than expected");
+}
+
+// IDs the emulated device doesn't have take slots like any other, but
+// only while they have something waiting.
+static bool test_slots() {
+    uint8_t report[4] = { 1, 2, 3, 4 };
+    bool ok = true;
+    for (uint8_t id = 10; id < 20; id++) {
+        ok = ok && check(push(KB_MOUSE, id, report, sizeof(report)), "stray report ID was refused");
+        ok = ok && check(read_report(id, report, sizeof(report)), "stray report ID wasn't sent");
+    }
+    for (uint8_t id = 10; id < 20; id++) {
+        sent(KB_MOUSE, id, report, sizeof(report));
+    }
+
+    uint8_t a[MOUSE_REPORT_SIZE];
+    mouse(a, 0, 1);
+    ok = ok && check(push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a)), "no slot left after stray report IDs");
+    ok = ok && check(read_report(MOUSE_REPORT_ID, a, sizeof(a)), "report after stray IDs wasn't sent");
+
+    // With every slot holding a waiting report, another ID has to wait.
+    for (uint8_t id = 10; id < 14; id++) {
+        ok = ok && check(push(KB_MOUSE, id, report, sizeof(report)), "stray report ID was refused");
+    }
+    ok = ok && check(!push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a)), "more slots than expected");
+    for (uint8_t id = 10; id < 14; id++) {
+        ok = ok && check(read_report(id, report, sizeof(report)), "stray report ID wasn't sent");
+    }
+    ok = ok && check(push(KB_MOUSE, MOUSE_REPORT_ID, a, sizeof(a)), "slots weren't freed after draining");
+    return ok && check(read_report(MOUSE_REPORT_ID, a, sizeof(a)), "report after draining wasn't sent");
+}
+
+int main() {
+    bool (*const tests[])() = {
+        test_relative,
+        test_saturation,
+        test_button_tap,
+        test_hat_tap,
+        test_key_tap,
+        test_depth,
+        test_slots,
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        ok = ok && tests[i]();
+        report_queue_clear();
+        ok = ok && check(report_pool_available() == REPORT_POOL_BUFFERS, "pool buffers weren't released");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Sends a stream of states through a simulated lossy, reordering network
+// as protocol version 4 datagrams and checks what the receiver applies:
+// never an older state after a newer one, and with copies of the previous
+// packets in every datagram, almost nothing lost.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_frames.h"
+#include "host_stubs.h"
+
+#include "packet.h"
+#include "sequence.h"
+#include "stats.h"
+
+#define NSTATES 20000
+#define INTERVAL_US 1000
+#define REPORT_ID 4
+#define MAX_REDUNDANCY 7
+
+// Sender and receiver clocks are unrelated.
+#define CLOCK_OFFSET 0x9e3779b9u
+
+typedef struct {
+    uint32_t seq;
+    uint32_t arrival_us;
+} delivery_t;
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng() {
+    rng_state = rng_state * 1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+static uint32_t applied[NSTATES * (MAX_REDUNDANCY + 1)];
+static uint32_t napplied;
+
+static void record_report(uint8_t report_id, const uint8_t* report, uint16_t len) {
+    uint32_t state;
+    memcpy(&state, report, sizeof(state));
+    applied[napplied++] = state;
+}
+
+static size_t build_state_packet(uint8_t* out, uint32_t state) {
+    uint8_t report[4];
+    memcpy(report, &state, sizeof(state));
+    return build_packet(out, 0, REPORT_ID, report, sizeof(report));
+}
+
+static void send_datagram(uint32_t seq, uint32_t timestamp_us, uint32_t arrival_us, int redundancy) {
+    uint8_t packets[MAX_REDUNDANCY + 1][8];
+    const uint8_t* ptrs[MAX_REDUNDANCY + 1];
+    uint16_t lens[MAX_REDUNDANCY + 1];
+    uint8_t count = 0;
+    for (int i = 0; (i <= redundancy) && (i <= (int) seq); i++) {
+        lens[count] = build_state_packet(packets[count], seq - i);
+        ptrs[count] = packets[count];
+        count++;
+    }
+
+    uint8_t datagram[16 + (MAX_REDUNDANCY + 1) * 10];
+    size_t len = build_sequenced_packet(datagram, seq, timestamp_us, count, ptrs, lens);
+    packet_set_source(TRANSPORT_UDP, 0, arrival_us);
+    handle_received_packet(datagram, len);
+}
+
+static int compare_deliveries(const void* a, const void* b) {
+    const delivery_t* x = a;
+    const delivery_t* y = b;
+    if (x->arrival_us != y->arrival_us) {
+        return (x->arrival_us < y->arrival_us) ? -1 : 1;
+    }
+    return (x->seq < y->seq) ? -1 : 1;
+}
+
+static void reset() {
+    host_stubs_reset();
+    host_report_hook = record_report;
+    sequence_reset();
+    memset(rx_stats, 0, sizeof(rx_stats));
+    napplied = 0;
+}
+
+// 10% loss, up to 3 ms of jitter on a 1 ms send interval (so a lot of
+// reordering) and every 200th datagram held up for 200 ms.
+static bool run(int redundancy, uint32_t max_missing) {
+    static delivery_t deliveries[NSTATES];
+    int ndeliveries = 0;
+
+    reset();
+    for (uint32_t seq = 0; seq < NSTATES; seq++) {
+        bool last = (seq == NSTATES - 1);
+        if (!last && (rng() % 100 < 10)) {
+            continue;
+        }
+        uint32_t delay = 2000 + rng() % 3000;
+        if (!last && (rng() % 200 == 0)) {
+            delay += 200000;
+        }
+        deliveries[ndeliveries].seq = seq;
+        deliveries[ndeliveries].arrival_us = seq * INTERVAL_US + delay;
+        ndeliveries++;
+    }
+    qsort(deliveries, ndeliveries, sizeof(delivery_t), compare_deliveries);
+    for (int i = 0; i < ndeliveries; i++) {
+        uint32_t seq = deliveries[i].seq;
+        send_datagram(seq, seq * INTERVAL_US, deliveries[i].arrival_us + CLOCK_OFFSET, redundancy);
+    }
+
+    for (uint32_t i = 1; i < napplied; i++) {
+        if (applied[i] <= applied[i - 1]) {
+            fprintf(stderr, "K=%d: state %u applied after %u\n", redundancy, applied[i], applied[i - 1]);
+            return false;
+        }
+    }
+    if ((napplied == 0) || (applied[napplied - 1] != NSTATES - 1)) {
+        fprintf(stderr, "K=%d: last state not applied\n", redundancy);
+        return false;
+    }
+    uint32_t missing = NSTATES - napplied;
+    printf("K=%d: %d of %d datagrams delivered, %u late, %u recovered, %u states missing\n",
+           redundancy, ndeliveries, NSTATES, rx_stats[TRANSPORT_UDP].late_packets,
+           rx_stats[TRANSPORT_UDP].recovered_packets, missing);
+    if (missing > max_missing) {
+        fprintf(stderr, "K=%d: expected at most %u states missing\n", redundancy, max_missing);
+        return false;
+    }
+    return true;
+}
+
+// A sender that restarts from sequence number 0 or whose clock jumps has
+// to be picked up again instead of being dropped forever.
+static bool run_resync() {
+    reset();
+    for (uint32_t seq = 5000; seq < 5010; seq++) {
+        send_datagram(seq, seq * INTERVAL_US, seq * INTERVAL_US + 2000, 2);
+    }
+    send_datagram(0, 0, 5010 * INTERVAL_US + 2000, 2);
+    if (applied[napplied - 1] != 0) {
+        fprintf(stderr, "restarted sender not picked up\n");
+        return false;
+    }
+
+    // The sender's clock goes back by a second, everything looks stale.
+    for (uint32_t seq = 1; seq < 20; seq++) {
+        send_datagram(seq, seq * INTERVAL_US - 1000000, (5010 + seq) * INTERVAL_US + 2000, 2);
+    }
+    if (applied[napplied - 1] != 19) {
+        fprintf(stderr, "sender clock jump not picked up\n");
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = run(0, NSTATES / 2) &&
+              run(3, NSTATES / 1000) &&
+              run_resync();
+    return ok ? 0 : 1;
+}
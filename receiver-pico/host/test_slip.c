@@ -0,0 +1,181 @@
+// Feeds the same SLIP stream to the decoder one byte at a time, in chunks
+// of random size and all at once. Frames full of escapes, frames with a
+// bad CRC and frames too long for the buffer are mixed in, and every way
+// of splitting the stream has to give the same reports and statistics,
+// and leave no report buffers behind.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_frames.h"
+#include "host_stubs.h"
+
+#include "globals.h"
+#include "packet.h"
+#include "report_pool.h"
+#include "report_queue.h"
+#include "stats.h"
+
+// serial_read_bytes() takes up to 65535 bytes, so the whole stream fits in one call.
+#define STREAM_SIZE 65535
+#define FRAMES 500
+#define REPORT_ID 1
+#define MAX_REPORT_SIZE 64
+// More than the receiver's frame buffer.
+#define OVERLONG_SIZE 600
+
+#define END 0300
+#define ESC 0333
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[MAX_REPORT_SIZE];
+} report_t;
+
+static uint8_t stream[STREAM_SIZE];
+static size_t stream_len;
+
+static report_t expected[FRAMES];
+static int nexpected;
+static report_t received[FRAMES];
+static int nreceived;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng() {
+    rng_state = rng_state * 1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+static void on_report(uint8_t report_id, const uint8_t* report, uint16_t len) {
+    if ((nreceived < FRAMES) && (len <= MAX_REPORT_SIZE)) {
+        received[nreceived].len = len;
+        memcpy(received[nreceived].data, report, len);
+    }
+    nreceived++;
+}
+
+static void build_stream() {
+    uint8_t packet[4 + MAX_REPORT_SIZE];
+    for (int i = 0; i < FRAMES; i++) {
+        if (stream_len + OVERLONG_SIZE + 1 > STREAM_SIZE) {
+            break;
+        }
+        switch (rng() % 16) {
+            case 0: {
+                // Garbage without an END, longer than any frame can be.
+                for (int j = 0; j < OVERLONG_SIZE; j++) {
+                    uint8_t b = rng();
+                    stream[stream_len++] = (b == END) ? 0 : b;
+                }
+                stream[stream_len++] = END;
+                break;
+            }
+            case 1: {
+                // A byte flipped after encoding, the CRC won't match.
+                uint8_t report[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+                size_t len = build_packet(packet, 0, REPORT_ID, report, sizeof(report));
+                size_t frame_len = slip_encode_frame(packet, len, stream + stream_len);
+                stream[stream_len + 3] ^= 0x01;
+                stream_len += frame_len;
+                break;
+            }
+            default: {
+                report_t* r = &expected[nexpected++];
+                r->len = 1 + rng() % MAX_REPORT_SIZE;
+                // Every other frame is mostly bytes that need escaping.
+                int escape_percentage = (i & 1) ? 70 : 5;
+                for (int j = 0; j < r->len; j++) {
+                    if ((int) (rng() % 100) < escape_percentage) {
+                        r->data[j] = (rng() & 1) ? END : ESC;
+                    } else {
+                        r->data[j] = rng();
+                    }
+                }
+                size_t len = build_packet(packet, 0, REPORT_ID, r->data, r->len);
+                stream_len += slip_encode_frame(packet, len, stream + stream_len);
+                break;
+            }
+        }
+    }
+}
+
+static void reset() {
+    host_stubs_reset();
+    host_report_hook = on_report;
+    memset(rx_stats, 0, sizeof(rx_stats));
+    our_descriptor_number = 0;
+    usb_descriptor_number = 0;
+    packet_forget_source(TRANSPORT_UART, 0);
+    packet_set_source(TRANSPORT_UART, 0, 0);
+    nreceived = 0;
+}
+
+// max_chunk 0 means one byte at a time through serial_read_byte().
+static bool run(const char* name, size_t max_chunk, const transport_stats_t* reference) {
+    reset();
+    size_t pos = 0;
+    while (pos < stream_len) {
+        if (max_chunk == 0) {
+            serial_read_byte(stream[pos++]);
+            continue;
+        }
+        size_t len = (max_chunk >= stream_len) ? stream_len : 1 + rng() % max_chunk;
+        if (len > stream_len - pos) {
+            len = stream_len - pos;
+        }
+        serial_read_bytes(stream + pos, len);
+        pos += len;
+    }
+
+    bool ok = true;
+    if (nreceived != nexpected) {
+        fprintf(stderr, "%s: %d reports, expected %d\n", name, nreceived, nexpected);
+        return false;
+    }
+    for (int i = 0; i < nexpected; i++) {
+        if ((received[i].len != expected[i].len) || (memcmp(received[i].data, expected[i].data, expected[i].len) != 0)) {
+            fprintf(stderr, "%s: report %d differs\n", name, i);
+            ok = false;
+            break;
+        }
+    }
+    const transport_stats_t* s = &rx_stats[TRANSPORT_UART];
+    if (s->bytes != stream_len) {
+        fprintf(stderr, "%s: counted %u bytes of %zu\n", name, s->bytes, stream_len);
+        ok = false;
+    }
+    if ((reference != NULL) && (memcmp(s, reference, sizeof(*s)) != 0)) {
+        fprintf(stderr, "%s: statistics differ from byte by byte decoding\n", name);
+        ok = false;
+    }
+    if ((s->crc_errors == 0) || (s->framing_errors == 0)) {
+        fprintf(stderr, "%s: the bad frames weren't noticed\n", name);
+        ok = false;
+    }
+    report_queue_clear();
+    packet_forget_source(TRANSPORT_UART, 0);
+    if (report_pool_available() != REPORT_POOL_BUFFERS) {
+        fprintf(stderr, "%s: report buffers weren't released\n", name);
+        ok = false;
+    }
+    return ok;
+}
+
+int main() {
+    build_stream();
+
+    bool ok = run("byte by byte", 0, NULL);
+    transport_stats_t reference = rx_stats[TRANSPORT_UART];
+    ok = run("chunks of up to 3", 3, &reference) && ok;
+    ok = run("chunks of up to 64", 64, &reference) && ok;
+    ok = run("chunks of up to 1000", 1000, &reference) && ok;
+    ok = run("all at once", STREAM_SIZE, &reference) && ok;
+
+    if (!ok) {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
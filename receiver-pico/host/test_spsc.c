@@ -0,0 +1,111 @@
+// Threaded stress test of the SPSC ring used to hand reports from core 0
+// to core 1: one producer and one consumer thread, every element has to
+// arrive exactly once, in order and intact.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc.h"
+
+#define CAPACITY 16
+#define ITEMS 2000000
+
+typedef struct {
+    uint32_t seq;
+    uint8_t payload[60];
+} item_t;
+
+static item_t buffer[CAPACITY];
+static spsc_t q;
+
+static void fill(item_t* item, uint32_t seq) {
+    item->seq = seq;
+    memset(item->payload, seq & 0xFF, sizeof(item->payload));
+}
+
+static void* producer(void* arg) {
+    for (uint32_t seq = 0; seq < ITEMS;) {
+        if (seq & 1) {
+            item_t item;
+            fill(&item, seq);
+            if (spsc_push(&q, &item)) {
+                seq++;
+            } else {
+                sched_yield();
+            }
+        } else {
+            item_t* slot = spsc_alloc(&q);
+            if (slot != NULL) {
+                fill(slot, seq);
+                spsc_commit(&q);
+                seq++;
+            } else {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool check(const item_t* item, uint32_t seq) {
+    if (item->seq != seq) {
+        fprintf(stderr, "expected item %u, got %u\n", seq, item->seq);
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(item->payload); i++) {
+        if (item->payload[i] != (seq & 0xFF)) {
+            fprintf(stderr, "item %u corrupted\n", seq);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void* consumer(void* arg) {
+    for (uint32_t seq = 0; seq < ITEMS;) {
+        if (seq & 1) {
+            item_t item;
+            if (spsc_pop(&q, &item)) {
+                if (!check(&item, seq)) {
+                    exit(1);
+                }
+                seq++;
+            } else {
+                sched_yield();
+            }
+        } else {
+            item_t* item = spsc_front(&q);
+            if (item != NULL) {
+                if (!check(item, seq)) {
+                    exit(1);
+                }
+                spsc_release(&q);
+                seq++;
+            } else {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t producer_thread;
+    pthread_t consumer_thread;
+
+    spsc_init(&q, buffer, sizeof(item_t), CAPACITY);
+    pthread_create(&consumer_thread, NULL, consumer, NULL);
+    pthread_create(&producer_thread, NULL, producer, NULL);
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+
+    if (spsc_front(&q) != NULL) {
+        fprintf(stderr, "ring not empty at the end\n");
+        return 1;
+    }
+    printf("%d items passed through\n", ITEMS);
+    return 0;
+}
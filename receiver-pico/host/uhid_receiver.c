@@ -0,0 +1,420 @@
+// Runs the receiver's packet path as a Linux HID device through /dev/uhid,
+// so transmitters can be tried out end to end on one machine with the
+// kernel's HID stack, evdev, SDL and games on the other side, without
+// flashing a Pico:
+//
+//   sudo ./uhid_receiver -v
+//   ./gamepad_test.py --serial-port /dev/pts/5
+//   ./gamepad_test.py --address 127.0.0.1
+//
+// Every HID interface of the emulated device, except the one for the
+// configuration tool, becomes a uhid device with the descriptors the
+// firmware would enumerate with. The devices are destroyed and created
+// again when the receiver re-enumerates for another descriptor. Reports
+// reach the kernel as soon as the receiver hands them to TinyUSB; there
+// is no polling interval to wait for, unlike on USB.
+//
+// Options:
+//   -d NUM    descriptor to start with (default 0)
+//   -c        composite mode, one device per supported descriptor
+//   -p        no pseudo-terminal
+//   -u        no UDP socket
+//   -v        print every report with a timestamp
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uhid.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pico/time.h"
+#include "tusb.h"
+
+#include "host_pty.h"
+#include "host_stubs.h"
+
+#include "descriptors.h"
+#include "globals.h"
+#include "packet.h"
+#include "stats.h"
+
+#define OUR_PORT 42734
+#define MAX_DATAGRAM_SIZE 1024
+#define LOOP_TIMEOUT_MS 10
+
+#define DEVICE_NAME "HID Receiver"
+
+typedef struct {
+    int fd;
+    uint8_t instance;
+} uhid_device_t;
+
+// Senders, told apart by address and port, like on the Pico.
+typedef struct {
+    bool used;
+    struct sockaddr_in addr;
+    uint32_t last_heard_us;
+} peer_t;
+
+static uhid_device_t devices[NINSTANCES];
+static int ndevices = 0;
+static bool devices_created = false;
+
+static peer_t peers[NET_MAX_PEERS];
+
+static bool verbose = false;
+static volatile bool running = true;
+
+static void on_signal(int sig) {
+    running = false;
+}
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool uhid_write(int fd, const struct uhid_event* ev) {
+    ssize_t n = write(fd, ev, sizeof(*ev));
+    if (n != sizeof(*ev)) {
+        perror("uhid write");
+        return false;
+    }
+    return true;
+}
+
+static bool create_device(uint8_t instance, uint16_t report_descriptor_len) {
+    const uint8_t* report_descriptor = tud_hid_descriptor_report_cb(instance);
+    if ((report_descriptor == NULL) || (report_descriptor_len > HID_MAX_DESCRIPTOR_SIZE)) {
+        printf("no usable report descriptor for interface %u\n", instance);
+        return false;
+    }
+    const tusb_desc_device_t* desc = (const tusb_desc_device_t*) tud_descriptor_device_cb();
+
+    int fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        perror("/dev/uhid");
+        return false;
+    }
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char*) ev.u.create2.name, sizeof(ev.u.create2.name), DEVICE_NAME);
+    snprintf((char*) ev.u.create2.phys, sizeof(ev.u.create2.phys), "uhid_receiver/input%u", instance);
+    ev.u.create2.rd_size = report_descriptor_len;
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = desc->idVendor;
+    ev.u.create2.product = desc->idProduct;
+    ev.u.create2.version = desc->bcdDevice;
+    memcpy(ev.u.create2.rd_data, report_descriptor, report_descriptor_len);
+    if (!uhid_write(fd, &ev)) {
+        close(fd);
+        return false;
+    }
+
+    printf("interface %u: %04x:%04x, %u byte report descriptor\n", instance, desc->idVendor, desc->idProduct, report_descriptor_len);
+    devices[ndevices].fd = fd;
+    devices[ndevices].instance = instance;
+    ndevices++;
+    return true;
+}
+
+// One device for every HID interface in the configuration descriptor,
+// with the report descriptor length taken from its HID descriptor.
+static void create_devices() {
+    const uint8_t* p = tud_descriptor_configuration_cb(0);
+    const uint8_t* end = p + (p[2] | (p[3] << 8));
+    uint8_t instance = NO_DESCRIPTOR;
+    while ((p < end) && (p[0] != 0)) {
+        if (p[1] == TUSB_DESC_INTERFACE) {
+            instance = p[2];
+        } else if ((p[1] == HID_DESC_TYPE_HID) && (instance != CONFIG_INSTANCE) && (instance < NINSTANCES)) {
+            create_device(instance, p[7] | (p[8] << 8));
+        }
+        p += p[0];
+    }
+}
+
+static void destroy_devices() {
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    for (int i = 0; i < ndevices; i++) {
+        uhid_write(devices[i].fd, &ev);
+        close(devices[i].fd);
+    }
+    ndevices = 0;
+}
+
+// The devices follow the receiver's USB connection: they go away when it
+// drops off the bus to re-enumerate and come back with the new descriptors.
+static void sync_devices() {
+    if (host_usb_connected && !devices_created) {
+        create_devices();
+        devices_created = true;
+    } else if (!host_usb_connected && devices_created) {
+        printf("re-enumerating\n");
+        destroy_devices();
+        devices_created = false;
+    }
+}
+
+static void on_report(uint8_t report_id, const uint8_t* report, uint16_t len) {
+    sync_devices();
+    uint8_t instance = host_last_report_instance;
+    for (int i = 0; i < ndevices; i++) {
+        if (devices[i].instance != instance) {
+            continue;
+        }
+        struct uhid_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.type = UHID_INPUT2;
+        uint16_t size = 0;
+        if (report_id != 0) {
+            ev.u.input2.data[size++] = report_id;
+        }
+        memcpy(ev.u.input2.data + size, report, len);
+        ev.u.input2.size = size + len;
+        uhid_write(devices[i].fd, &ev);
+    }
+    if (verbose) {
+        printf("%.6f interface %u report %u:", now_s(), instance, report_id);
+        for (uint16_t i = 0; i < len; i++) {
+            printf(" %02x", report[i]);
+        }
+        printf("\n");
+    }
+}
+
+static void handle_uhid_event(uhid_device_t* device) {
+    struct uhid_event ev;
+    ssize_t n = read(device->fd, &ev, sizeof(ev));
+    if (n <= 0) {
+        if ((n < 0) && (errno != EAGAIN)) {
+            perror("uhid read");
+        }
+        return;
+    }
+
+    struct uhid_event reply;
+    memset(&reply, 0, sizeof(reply));
+    switch (ev.type) {
+        case UHID_START:
+            printf("interface %u: started\n", device->instance);
+            break;
+        case UHID_OPEN:
+            printf("interface %u: opened\n", device->instance);
+            break;
+        case UHID_CLOSE:
+            printf("interface %u: closed\n", device->instance);
+            break;
+        case UHID_OUTPUT:
+            if (verbose) {
+                printf("%.6f interface %u output report, %u bytes\n", now_s(), device->instance, ev.u.output.size);
+            }
+            break;
+        // The kernel waits for an answer to these, so they always get one.
+        case UHID_GET_REPORT:
+            reply.type = UHID_GET_REPORT_REPLY;
+            reply.u.get_report_reply.id = ev.u.get_report.id;
+            reply.u.get_report_reply.err = EIO;
+            uhid_write(device->fd, &reply);
+            break;
+        case UHID_SET_REPORT:
+            reply.type = UHID_SET_REPORT_REPLY;
+            reply.u.set_report_reply.id = ev.u.set_report.id;
+            reply.u.set_report_reply.err = 0;
+            uhid_write(device->fd, &reply);
+            break;
+        default:
+            break;
+    }
+}
+
+static int open_udp() {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(OUR_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if ((fd < 0) || (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)) {
+        perror("UDP socket");
+        exit(1);
+    }
+    return fd;
+}
+
+static uint8_t find_peer(const struct sockaddr_in* addr, uint32_t now, bool* new_peer) {
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < NET_MAX_PEERS; i++) {
+        if (peers[i].used && (peers[i].addr.sin_port == addr->sin_port) &&
+            (peers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr)) {
+            peers[i].last_heard_us = now;
+            *new_peer = false;
+            return i;
+        }
+        if (!peers[oldest].used) {
+            continue;
+        }
+        if (!peers[i].used || (now - peers[i].last_heard_us > now - peers[oldest].last_heard_us)) {
+            oldest = i;
+        }
+    }
+    peers[oldest].used = true;
+    peers[oldest].addr = *addr;
+    peers[oldest].last_heard_us = now;
+    *new_peer = true;
+    return oldest;
+}
+
+static void handle_udp(int fd) {
+    static uint8_t buffer[MAX_DATAGRAM_SIZE];
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    ssize_t n;
+    while (addr_len = sizeof(addr), (n = recvfrom(fd, buffer, sizeof(buffer), MSG_TRUNC, (struct sockaddr*) &addr, &addr_len)) >= 0) {
+        uint32_t now = time_us_32();
+        bool new_peer;
+        uint8_t peer = find_peer(&addr, now, &new_peer);
+        if (new_peer) {
+            packet_forget_source(TRANSPORT_UDP, peer);
+        }
+        packet_set_source(TRANSPORT_UDP, peer, now);
+        if (n > sizeof(buffer)) {
+            printf("datagram too long (%zd bytes)\n", n);
+            rx_stats[TRANSPORT_UDP].packets++;
+            rx_stats[TRANSPORT_UDP].bytes += n;
+            rx_stats[TRANSPORT_UDP].invalid_packets++;
+            continue;
+        }
+        handle_received_packet(buffer, n);
+    }
+}
+
+static bool handle_serial(int fd) {
+    uint8_t buffer[1024];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n > 0) {
+        packet_set_source(TRANSPORT_UART, 0, time_us_32());
+        serial_read_bytes(buffer, n);
+    } else if ((n < 0) && (errno != EAGAIN) && (errno != EIO)) {
+        perror("read");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint8_t descriptor_number = 0;
+    bool composite = false;
+    bool use_pty = true;
+    bool use_udp = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:cpuv")) != -1) {
+        switch (opt) {
+            case 'd':
+                descriptor_number = strtoul(optarg, NULL, 10);
+                if (descriptor_number >= NOUR_DESCRIPTORS) {
+                    fprintf(stderr, "descriptor number must be below %u\n", NOUR_DESCRIPTORS);
+                    return 2;
+                }
+                break;
+            case 'c':
+                composite = true;
+                break;
+            case 'p':
+                use_pty = false;
+                break;
+            case 'u':
+                use_udp = false;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d NUM] [-c] [-p] [-u] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    host_stubs_reset();
+    host_report_hook = on_report;
+    our_descriptor_number = descriptor_number;
+    usb_descriptor_number = descriptor_number;
+    composite_mode = composite;
+
+    // Slot 0 and 1 are the inputs, the rest follow the uhid devices.
+    struct pollfd pfds[2 + NINSTANCES];
+    int serial_fd = -1;
+    int transmitter_fd = -1;
+    int udp_fd = -1;
+    if (use_pty) {
+        char path[64];
+        serial_fd = host_pty_open(path, sizeof(path), &transmitter_fd);
+        printf("serial on %s\n", path);
+    }
+    if (use_udp) {
+        udp_fd = open_udp();
+        printf("UDP on port %u\n", OUR_PORT);
+    }
+    fflush(stdout);
+
+    sync_devices();
+    if (ndevices == 0) {
+        return 1;
+    }
+
+    while (running) {
+        pfds[0] = (struct pollfd){ .fd = serial_fd, .events = POLLIN };
+        pfds[1] = (struct pollfd){ .fd = udp_fd, .events = POLLIN };
+        for (int i = 0; i < ndevices; i++) {
+            pfds[2 + i] = (struct pollfd){ .fd = devices[i].fd, .events = POLLIN };
+        }
+        int nfds = 2 + ndevices;
+        if (poll(pfds, nfds, LOOP_TIMEOUT_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if ((pfds[0].revents & POLLIN) && !handle_serial(serial_fd)) {
+            break;
+        }
+        if (pfds[1].revents & POLLIN) {
+            handle_udp(udp_fd);
+        }
+        // A report may have re-created the devices in the meantime.
+        for (int i = 0; i < nfds - 2; i++) {
+            if ((i < ndevices) && (devices[i].fd == pfds[2 + i].fd) && (pfds[2 + i].revents & POLLIN)) {
+                handle_uhid_event(&devices[i]);
+            }
+        }
+
+        outgoing_reports_task();
+        sync_devices();
+        fflush(stdout);
+    }
+
+    destroy_devices();
+    return 0;
+}
@@ -6,17 +6,128 @@
 
 #include "bt.h"
 #include "btstack.h"
-#include "receiver.h"
+#include "packet.h"
+#include "pico/time.h"
+#include "stats.h"
+
+#if PICO_CYW43_ARCH_THREADSAFE_BACKGROUND
+#include "pico/cyw43_arch.h"
+#include "spsc.h"
+#endif
 
 #define RFCOMM_SERVER_CHANNEL 1
 
-static uint16_t rfcomm_channel_id;
+// Every connected device is a separate source for the packet parser.
+_Static_assert(BT_MAX_PEERS <= MAX_NR_RFCOMM_CHANNELS);
+
+// RFCOMM channel of each peer, 0 if the slot is free.
+static uint16_t rfcomm_channel_ids[BT_MAX_PEERS];
 static bool pairing_mode_enabled;
 
+static int find_peer(uint16_t rfcomm_cid) {
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        if (rfcomm_channel_ids[i] == rfcomm_cid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void set_pairing_mode(bool enabled) {
+    pairing_mode_enabled = enabled;
+    gap_discoverable_control(enabled);
+    gap_ssp_set_auto_accept(enabled);
+}
+
+#if PICO_CYW43_ARCH_THREADSAFE_BACKGROUND
+
+// BTstack runs from the CYW43 interrupt here, so received data is copied
+// into a ring and decoded in bt_task() on the main loop, and calls into
+// BTstack from the main loop take the async context lock. A disconnect
+// goes through the ring as well, as an empty chunk.
+
+#define RX_CHUNK_SIZE 57
+#define RX_QUEUE_CAPACITY 32
+
+typedef struct {
+    uint32_t timestamp_us;
+    uint16_t len;
+    uint8_t peer;
+    uint8_t data[RX_CHUNK_SIZE];
+} rx_chunk_t;
+
+static spsc_t rx_queue;
+static rx_chunk_t rx_queue_buffer[RX_QUEUE_CAPACITY];
+
+static void queue_peer_closed(uint8_t peer) {
+    rx_chunk_t* chunk = spsc_alloc(&rx_queue);
+    if (chunk == NULL) {
+        rx_queue_drops[TRANSPORT_BT]++;
+        return;
+    }
+    chunk->peer = peer;
+    chunk->len = 0;
+    spsc_commit(&rx_queue);
+}
+
+static void queue_rx_data(uint8_t peer, const uint8_t* data, uint16_t size) {
+    uint32_t now = time_us_32();
+    while (size > 0) {
+        rx_chunk_t* chunk = spsc_alloc(&rx_queue);
+        if (chunk == NULL) {
+            rx_queue_drops[TRANSPORT_BT]++;
+            return;
+        }
+        chunk->timestamp_us = now;
+        chunk->peer = peer;
+        chunk->len = (size < RX_CHUNK_SIZE) ? size : RX_CHUNK_SIZE;
+        memcpy(chunk->data, data, chunk->len);
+        spsc_commit(&rx_queue);
+        data += chunk->len;
+        size -= chunk->len;
+    }
+}
+
+void bt_task() {
+    rx_chunk_t* chunk;
+    while ((chunk = spsc_front(&rx_queue)) != NULL) {
+        if (chunk->len == 0) {
+            packet_forget_source(TRANSPORT_BT, chunk->peer);
+        } else {
+            packet_set_source(TRANSPORT_BT, chunk->peer, chunk->timestamp_us);
+            serial_read_bytes(chunk->data, chunk->len);
+        }
+        spsc_release(&rx_queue);
+    }
+}
+
+#define BTSTACK_LOCK() async_context_acquire_lock_blocking(cyw43_arch_async_context())
+#define BTSTACK_UNLOCK() async_context_release_lock(cyw43_arch_async_context())
+
+#else
+
+void bt_task() {
+}
+
+#define BTSTACK_LOCK()
+#define BTSTACK_UNLOCK()
+
+#endif
+
+static void peer_closed(uint8_t peer) {
+#if PICO_CYW43_ARCH_THREADSAFE_BACKGROUND
+    queue_peer_closed(peer);
+#else
+    packet_forget_source(TRANSPORT_BT, peer);
+#endif
+}
+
 static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
     bd_addr_t event_addr;
     uint8_t rfcomm_channel_nr;
+    uint16_t rfcomm_cid;
     uint16_t mtu;
+    int peer;
 
     switch (packet_type) {
         case HCI_EVENT_PACKET:
@@ -32,37 +143,57 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packe
                 case RFCOMM_EVENT_INCOMING_CONNECTION:
                     rfcomm_event_incoming_connection_get_bd_addr(packet, event_addr);
                     rfcomm_channel_nr = rfcomm_event_incoming_connection_get_server_channel(packet);
-                    rfcomm_channel_id = rfcomm_event_incoming_connection_get_rfcomm_cid(packet);
+                    rfcomm_cid = rfcomm_event_incoming_connection_get_rfcomm_cid(packet);
                     printf("RFCOMM_EVENT_INCOMING_CONNECTION %s channel %u\n", bd_addr_to_str(event_addr), rfcomm_channel_nr);
-                    rfcomm_accept_connection(rfcomm_channel_id);
+                    peer = find_peer(0);
+                    if (peer < 0) {
+                        printf("too many connections\n");
+                        rfcomm_decline_connection(rfcomm_cid);
+                        break;
+                    }
+                    rfcomm_channel_ids[peer] = rfcomm_cid;
+                    rfcomm_accept_connection(rfcomm_cid);
                     break;
                 case RFCOMM_EVENT_CHANNEL_OPENED:
+                    rfcomm_cid = rfcomm_event_channel_opened_get_rfcomm_cid(packet);
                     if (rfcomm_event_channel_opened_get_status(packet)) {
                         printf("RFCOMM_EVENT_CHANNEL_OPENED failed 0x%02x\n", rfcomm_event_channel_opened_get_status(packet));
+                        peer = find_peer(rfcomm_cid);
+                        if (peer >= 0) {
+                            rfcomm_channel_ids[peer] = 0;
+                        }
                     } else {
-                        rfcomm_channel_id = rfcomm_event_channel_opened_get_rfcomm_cid(packet);
                         mtu = rfcomm_event_channel_opened_get_max_frame_size(packet);
-                        printf("RFCOMM_EVENT_CHANNEL_OPENED success %u, mtu %u\n", rfcomm_channel_id, mtu);
+                        printf("RFCOMM_EVENT_CHANNEL_OPENED success %u, mtu %u\n", rfcomm_cid, mtu);
                     }
                     break;
                 case RFCOMM_EVENT_CHANNEL_CLOSED:
                     printf("RFCOMM_EVENT_CHANNEL_CLOSED\n");
-                    rfcomm_channel_id = 0;
+                    peer = find_peer(rfcomm_event_channel_closed_get_rfcomm_cid(packet));
+                    if (peer >= 0) {
+                        rfcomm_channel_ids[peer] = 0;
+                        peer_closed(peer);
+                    }
                     break;
                 case GAP_EVENT_PAIRING_COMPLETE:
                     printf("GAP_EVENT_PAIRING_COMPLETE\n");
-                    bt_set_pairing_mode(false);
+                    set_pairing_mode(false);
                     break;
                 default:
                     break;
             }
             break;
         case RFCOMM_DATA_PACKET:
-            for (int i = 0; i < size; i++) {
-                // printf("%02x ", packet[i]);
-                serial_read_byte(packet[i], 0);
+            peer = find_peer(channel);
+            if (peer < 0) {
+                break;
             }
-            // printf("\n");
+#if PICO_CYW43_ARCH_THREADSAFE_BACKGROUND
+            queue_rx_data(peer, packet, size);
+#else
+            packet_set_source(TRANSPORT_BT, peer, time_us_32());
+            serial_read_bytes(packet, size);
+#endif
             break;
         default:
             break;
@@ -96,19 +227,25 @@ static void spp_service_setup(void) {
 }
 
 void bt_init() {
+#if PICO_CYW43_ARCH_THREADSAFE_BACKGROUND
+    spsc_init(&rx_queue, rx_queue_buffer, sizeof(rx_chunk_t), RX_QUEUE_CAPACITY);
+#endif
+
+    BTSTACK_LOCK();
     spp_service_setup();
 
-    bt_set_pairing_mode(false);
+    set_pairing_mode(false);
     gap_ssp_set_io_capability(SSP_IO_CAPABILITY_DISPLAY_YES_NO);
     gap_set_local_name("HID Receiver 00:00:00:00:00:00");
 
     hci_power_control(HCI_POWER_ON);
+    BTSTACK_UNLOCK();
 }
 
 void bt_set_pairing_mode(bool enabled) {
-    pairing_mode_enabled = enabled;
-    gap_discoverable_control(enabled);
-    gap_ssp_set_auto_accept(enabled);
+    BTSTACK_LOCK();
+    set_pairing_mode(enabled);
+    BTSTACK_UNLOCK();
 }
 
 bool bt_get_pairing_mode() {
@@ -116,10 +253,17 @@ bool bt_get_pairing_mode() {
 }
 
 bool bt_is_connected() {
-    return rfcomm_channel_id != 0;
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        if (rfcomm_channel_ids[i] != 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void bt_forget_all_devices() {
+    BTSTACK_LOCK();
     gap_delete_all_link_keys();
+    BTSTACK_UNLOCK();
 }
 #endif
@@ -6,6 +6,8 @@
 #include <stdbool.h>
 
 void bt_init();
+// Decodes data received since the last call when BTstack runs in the background.
+void bt_task();
 bool bt_is_connected();
 void bt_set_pairing_mode(bool enable);
 bool bt_get_pairing_mode();
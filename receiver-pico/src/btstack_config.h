@@ -43,8 +43,8 @@
 #define MAX_NR_HFP_CONNECTIONS 1
 #define MAX_NR_L2CAP_CHANNELS 4
 #define MAX_NR_L2CAP_SERVICES 3
-#define MAX_NR_RFCOMM_CHANNELS 1
-#define MAX_NR_RFCOMM_MULTIPLEXERS 1
+#define MAX_NR_RFCOMM_CHANNELS 2
+#define MAX_NR_RFCOMM_MULTIPLEXERS 2
 #define MAX_NR_RFCOMM_SERVICES 1
 #define MAX_NR_SERVICE_RECORD_ITEMS 4
 #define MAX_NR_SM_LOOKUP_ENTRIES 3
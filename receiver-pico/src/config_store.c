@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "config_store.h"
+
+#include "crc.h"
+
+#define SLOTS_PER_SECTOR (CONFIG_STORE_SECTOR_SIZE / CONFIG_STORE_RECORD_SIZE)
+#define NSLOTS (CONFIG_STORE_SECTORS * SLOTS_PER_SECTOR)
+#define NO_SECTOR -1
+
+// The sector after the one being written is erased ahead of time, which
+// must never be the one holding the newest record.
+_Static_assert(CONFIG_STORE_SECTORS >= 3);
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;  // higher is newer
+    uint16_t len;
+    uint8_t data[CONFIG_STORE_MAX_DATA];
+    uint32_t crc;
+} record_t;
+
+_Static_assert(sizeof(record_t) == CONFIG_STORE_RECORD_SIZE);
+
+static const config_store_flash_t* flash;
+static int newest;  // slot of the newest valid record, -1 if there is none
+static int next_slot;
+static int pending_erase = NO_SECTOR;
+
+static const record_t* slot_record(int slot) {
+    return (const record_t*) (flash->contents + slot * CONFIG_STORE_RECORD_SIZE);
+}
+
+static bool record_valid(const record_t* record) {
+    return (record->seq != 0xFFFFFFFF) &&
+           (record->len <= CONFIG_STORE_MAX_DATA) &&
+           (crc32((const uint8_t*) record, sizeof(record_t) - 4) == record->crc);
+}
+
+static bool blank(const uint8_t* p, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool slot_blank(int slot) {
+    return blank((const uint8_t*) slot_record(slot), CONFIG_STORE_RECORD_SIZE);
+}
+
+static bool sector_blank(int sector) {
+    return blank(flash->contents + sector * CONFIG_STORE_SECTOR_SIZE, CONFIG_STORE_SECTOR_SIZE);
+}
+
+// The first blank slot from slot to the end of its sector, skipping
+// anything a power loss left half written. Otherwise the start of the
+// following sector, which may still have to be erased.
+static int find_slot(int slot) {
+    int sector_end = (slot / SLOTS_PER_SECTOR + 1) * SLOTS_PER_SECTOR;
+    for (; slot < sector_end; slot++) {
+        if (slot_blank(slot)) {
+            return slot;
+        }
+    }
+    return sector_end % NSLOTS;
+}
+
+static void find_pending_erase() {
+    int sector = (next_slot / SLOTS_PER_SECTOR + 1) % CONFIG_STORE_SECTORS;
+    pending_erase = sector_blank(sector) ? NO_SECTOR : sector;
+}
+
+void config_store_init(const config_store_flash_t* config_store_flash) {
+    flash = config_store_flash;
+    newest = -1;
+    for (int slot = 0; slot < NSLOTS; slot++) {
+        const record_t* record = slot_record(slot);
+        if (record_valid(record) && ((newest < 0) || (record->seq > slot_record(newest)->seq))) {
+            newest = slot;
+        }
+    }
+    next_slot = find_slot((newest + 1) % NSLOTS);
+    find_pending_erase();
+}
+
+bool config_store_read(void* data, uint16_t len) {
+    if ((newest < 0) || (slot_record(newest)->len != len)) {
+        return false;
+    }
+    memcpy(data, slot_record(newest)->data, len);
+    return true;
+}
+
+bool config_store_write(const void* data, uint16_t len) {
+    static uint8_t page[CONFIG_STORE_PAGE_SIZE];
+
+    if (len > CONFIG_STORE_MAX_DATA) {
+        return false;
+    }
+
+    if (!slot_blank(next_slot)) {
+        // Only the start of a sector the erase ahead of us didn't get to
+        // yet, or a slot after a failed write, can be dirty.
+        next_slot = find_slot(next_slot);
+        if (!slot_blank(next_slot)) {
+            int sector = next_slot / SLOTS_PER_SECTOR;
+            flash->erase_sector(sector * CONFIG_STORE_SECTOR_SIZE);
+            if (pending_erase == sector) {
+                pending_erase = NO_SECTOR;
+            }
+        }
+    }
+
+    // Bits that are already 0 stay 0, so the rest of the page is
+    // programmed with 0xFF to leave the records next to this one alone.
+    memset(page, 0xFF, sizeof(page));
+    uint32_t offset = next_slot * CONFIG_STORE_RECORD_SIZE;
+    record_t* record = (record_t*) (page + offset % CONFIG_STORE_PAGE_SIZE);
+    record->seq = (newest < 0) ? 0 : slot_record(newest)->seq + 1;
+    record->len = len;
+    memset(record->data, 0, sizeof(record->data));
+    memcpy(record->data, data, len);
+    record->crc = crc32((const uint8_t*) record, sizeof(record_t) - 4);
+    flash->program_page(offset - offset % CONFIG_STORE_PAGE_SIZE, page);
+
+    if (!record_valid(slot_record(next_slot))) {
+        // Leave the bad slot behind.
+        next_slot = (next_slot + 1) % NSLOTS;
+        return false;
+    }
+    newest = next_slot;
+    next_slot = find_slot((newest + 1) % NSLOTS);
+    find_pending_erase();
+    return true;
+}
+
+bool config_store_erase_pending() {
+    return pending_erase != NO_SECTOR;
+}
+
+void config_store_task() {
+    if (pending_erase == NO_SECTOR) {
+        return;
+    }
+    flash->erase_sector(pending_erase * CONFIG_STORE_SECTOR_SIZE);
+    pending_erase = NO_SECTOR;
+}
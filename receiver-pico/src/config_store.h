@@ -0,0 +1,46 @@
+#ifndef _CONFIG_STORE_H_
+#define _CONFIG_STORE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Append-only log of config records spread over several flash sectors.
+// A write programs a single page holding the new record, older records
+// are left in place and the newest one with a valid CRC wins at boot.
+// Sectors are erased in turn, one ahead of the one being written, by
+// config_store_task() when a stall doesn't hurt, which spreads the wear
+// evenly. A write only has to erase by itself if it runs out of room
+// before that happens. Losing power in the middle of a write or an erase
+// leaves either the previous or the new record as the newest valid one.
+
+#define CONFIG_STORE_SECTORS 4
+#define CONFIG_STORE_SECTOR_SIZE 4096
+#define CONFIG_STORE_PAGE_SIZE 256
+#define CONFIG_STORE_RECORD_SIZE 128
+#define CONFIG_STORE_SIZE (CONFIG_STORE_SECTORS * CONFIG_STORE_SECTOR_SIZE)
+// Largest payload a record can hold.
+#define CONFIG_STORE_MAX_DATA (CONFIG_STORE_RECORD_SIZE - 10)
+
+typedef struct {
+    // CONFIG_STORE_SIZE bytes of memory mapped flash.
+    const uint8_t* contents;
+    // Offsets are relative to contents. erase_sector() sets a whole sector
+    // to 0xFF, program_page() clears bits in one page.
+    void (*erase_sector)(uint32_t offset);
+    void (*program_page)(uint32_t offset, const uint8_t* page);
+} config_store_flash_t;
+
+// Scans the log. Has to be called again after the flash changed behind
+// the store's back (a simulated power loss on the host).
+void config_store_init(const config_store_flash_t* flash);
+
+// Copies the newest record into data. Returns false if there is none or
+// its length isn't len.
+bool config_store_read(void* data, uint16_t len);
+bool config_store_write(const void* data, uint16_t len);
+
+// Whether a sector is waiting to be erased, and erasing it.
+bool config_store_erase_pending();
+void config_store_task();
+
+#endif
@@ -1,6 +1,9 @@
+#include <stdbool.h>
+#include <string.h>
+
 #include "crc.h"
 
-uint32_t crc_table[] = {
+static const uint32_t crc_table[] = {
     0x0, 0x77073096, 0xEE0E612C, 0x990951BA, 0x76DC419, 0x706AF48F, 0xE963A535,
     0x9E6495A3, 0xEDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x9B64C2B,
     0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2, 0xF3B97148,
@@ -46,12 +49,92 @@ uint32_t crc_table[] = {
     0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
-uint32_t crc32(const uint8_t* buf, int len) {
-    uint32_t c = 0xffffffffL;
+static uint32_t bytewise_update(uint32_t c, const uint8_t* buf, int len) {
     int n;
 
     for (n = 0; n < len; n++) {
         c = crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
     }
-    return c ^ 0xffffffffL;
+    return c;
+}
+
+uint32_t crc32_bytewise(const uint8_t* buf, int len) {
+    return bytewise_update(0xffffffffL, buf, len) ^ 0xffffffffL;
+}
+
+#ifdef CRC_SLICE_BY_8
+
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "slice-by-8 CRC assumes little endian");
+
+static uint32_t crc_tables[8][256];
+static bool crc_tables_initialized = false;
+
+static void crc_tables_init() {
+    for (int i = 0; i < 256; i++) {
+        crc_tables[0][i] = crc_table[i];
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t c = crc_tables[k - 1][i];
+            crc_tables[k][i] = crc_table[c & 0xff] ^ (c >> 8);
+        }
+    }
+    crc_tables_initialized = true;
+}
+
+static uint32_t slice_by_8_update(uint32_t c, const uint8_t* buf, int len) {
+    if (!crc_tables_initialized) {
+        crc_tables_init();
+    }
+
+    while (len >= 8) {
+        uint32_t one;
+        uint32_t two;
+        memcpy(&one, buf, 4);
+        memcpy(&two, buf + 4, 4);
+        one ^= c;
+        c = crc_tables[7][one & 0xff] ^
+            crc_tables[6][(one >> 8) & 0xff] ^
+            crc_tables[5][(one >> 16) & 0xff] ^
+            crc_tables[4][one >> 24] ^
+            crc_tables[3][two & 0xff] ^
+            crc_tables[2][(two >> 8) & 0xff] ^
+            crc_tables[1][(two >> 16) & 0xff] ^
+            crc_tables[0][two >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        c = crc_table[(c ^ *buf++) & 0xff] ^ (c >> 8);
+    }
+    return c;
+}
+
+uint32_t crc32_slice_by_8(const uint8_t* buf, int len) {
+    return slice_by_8_update(0xffffffffL, buf, len) ^ 0xffffffffL;
+}
+
+#endif
+
+// Not worth a DMA transfer, the pieces are short.
+uint32_t crc32_update(uint32_t crc, const uint8_t* buf, int len) {
+#ifdef CRC_SLICE_BY_8
+    return slice_by_8_update(crc ^ 0xffffffffL, buf, len) ^ 0xffffffffL;
+#else
+    return bytewise_update(crc ^ 0xffffffffL, buf, len) ^ 0xffffffffL;
+#endif
+}
+
+uint32_t crc32(const uint8_t* buf, int len) {
+#if defined(CRC_DMA_SNIFFER)
+    // Setting up a DMA transfer costs more than the table lookups for short buffers.
+    if (len >= CRC_DMA_MIN_LEN) {
+        return crc32_dma(buf, len);
+    }
+    return crc32_bytewise(buf, len);
+#elif defined(CRC_SLICE_BY_8)
+    return crc32_slice_by_8(buf, len);
+#else
+    return crc32_bytewise(buf, len);
+#endif
 }
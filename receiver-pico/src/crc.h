@@ -3,6 +3,26 @@
 
 #include <stdint.h>
 
+// CRC-32 (same as zlib/binascii.crc32). The backend is chosen at build time:
+// CRC_DMA_SNIFFER uses the RP2040/RP2350 DMA sniffer for buffers of at least
+// CRC_DMA_MIN_LEN bytes, CRC_SLICE_BY_8 uses 8 lookup tables, otherwise
+// the data is processed one byte at a time.
 uint32_t crc32(const uint8_t* buf, int len);
 
+// Continues a CRC over more data, like zlib's crc32(): start with 0 and
+// pass the previous result, crc32_update(crc32_update(0, a), b) is the CRC
+// of a followed by b. Always computed in software.
+uint32_t crc32_update(uint32_t crc, const uint8_t* buf, int len);
+
+uint32_t crc32_bytewise(const uint8_t* buf, int len);
+
+#ifdef CRC_SLICE_BY_8
+uint32_t crc32_slice_by_8(const uint8_t* buf, int len);
+#endif
+
+#ifdef CRC_DMA_SNIFFER
+#define CRC_DMA_MIN_LEN 16
+uint32_t crc32_dma(const uint8_t* buf, int len);
+#endif
+
 #endif
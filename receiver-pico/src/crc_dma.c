@@ -0,0 +1,38 @@
+#ifdef CRC_DMA_SNIFFER
+#include "hardware/dma.h"
+#include "pico/platform.h"
+
+#include "crc.h"
+
+static int dma_channel = -1;
+static uint8_t dma_sink;
+
+// The sniffer is a single shared unit, so only core 0 uses it, anything
+// running on the other core takes the table path.
+uint32_t crc32_dma(const uint8_t* buf, int len) {
+    if (get_core_num() != 0) {
+        return crc32_bytewise(buf, len);
+    }
+
+    if (dma_channel < 0) {
+        dma_channel = dma_claim_unused_channel(true);
+    }
+
+    dma_channel_config c = dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+
+    // CRC32R feeds the data bit-reversed, reversing and inverting the result
+    // gives the same value as the reflected table implementation.
+    dma_sniffer_enable(dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+    dma_hw->sniff_data = 0xffffffff;
+
+    dma_channel_configure(dma_channel, &c, &dma_sink, buf, len, true);
+    dma_channel_wait_for_finish_blocking(dma_channel);
+
+    return dma_hw->sniff_data;
+}
+#endif
@@ -0,0 +1,112 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "delta.h"
+
+#define DELTA_SLOTS 8
+#define MAX_REPORT_SIZE 64
+
+typedef struct {
+    bool valid;
+    uint8_t source;
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t seq;
+    uint8_t data[MAX_REPORT_SIZE];
+} delta_state_t;
+
+static delta_state_t states[DELTA_SLOTS];
+static uint8_t next_victim = 0;
+
+static delta_state_t* find_state(uint8_t source, uint8_t our_descriptor_number, uint8_t report_id) {
+    for (int i = 0; i < DELTA_SLOTS; i++) {
+        if (states[i].valid &&
+            (states[i].source == source) &&
+            (states[i].our_descriptor_number == our_descriptor_number) &&
+            (states[i].report_id == report_id)) {
+            return &states[i];
+        }
+    }
+    return NULL;
+}
+
+static delta_state_t* new_state() {
+    for (int i = 0; i < DELTA_SLOTS; i++) {
+        if (!states[i].valid) {
+            return &states[i];
+        }
+    }
+    delta_state_t* state = &states[next_victim];
+    next_victim = (next_victim + 1) % DELTA_SLOTS;
+    return state;
+}
+
+const uint8_t* delta_decode(uint8_t source, uint8_t our_descriptor_number, uint8_t report_id, uint8_t len, uint8_t seq, uint8_t flags, const uint8_t* body, uint16_t body_len) {
+    if (len > MAX_REPORT_SIZE) {
+        return NULL;
+    }
+
+    delta_state_t* state = find_state(source, our_descriptor_number, report_id);
+
+    if (flags & DELTA_FLAG_KEYFRAME) {
+        if (body_len != len) {
+            return NULL;
+        }
+        if (state == NULL) {
+            state = new_state();
+        }
+        state->valid = true;
+        state->source = source;
+        state->our_descriptor_number = our_descriptor_number;
+        state->report_id = report_id;
+        state->len = len;
+        state->seq = seq;
+        memcpy(state->data, body, len);
+        return state->data;
+    }
+
+    if ((state == NULL) || (state->len != len) || (seq != (uint8_t) (state->seq + 1))) {
+        // Our copy is stale, wait for the next keyframe.
+        if (state != NULL) {
+            state->valid = false;
+        }
+        return NULL;
+    }
+
+    // Validate all runs before touching the state so a bad frame can't leave it half-updated.
+    uint16_t pos = 0;
+    while (pos < body_len) {
+        if (pos + 2 > body_len) {
+            return NULL;
+        }
+        uint8_t offset = body[pos];
+        uint8_t count = body[pos + 1];
+        if ((offset + count > len) || (pos + 2 + count > body_len)) {
+            return NULL;
+        }
+        pos += 2 + count;
+    }
+
+    pos = 0;
+    while (pos < body_len) {
+        uint8_t offset = body[pos];
+        uint8_t count = body[pos + 1];
+        memcpy(state->data + offset, body + pos + 2, count);
+        pos += 2 + count;
+    }
+    state->seq = seq;
+    return state->data;
+}
+
+void delta_forget_source(uint8_t source) {
+    for (int i = 0; i < DELTA_SLOTS; i++) {
+        if (states[i].source == source) {
+            states[i].valid = false;
+        }
+    }
+}
+
+void delta_reset() {
+    memset(states, 0, sizeof(states));
+}
@@ -0,0 +1,20 @@
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdint.h>
+
+// Protocol version 2 frames carry either a full report (a keyframe) or only
+// the bytes that changed since the previous frame with the same report ID,
+// as a list of runs: offset, count, count bytes.
+
+#define DELTA_FLAG_KEYFRAME (1 << 0)
+
+// Returns the reconstructed report (len bytes) or NULL if the frame can't
+// be applied, for example because a frame was lost since the last keyframe.
+// Each source (see NSOURCES) has its own copies of the reports.
+const uint8_t* delta_decode(uint8_t source, uint8_t our_descriptor_number, uint8_t report_id, uint8_t len, uint8_t seq, uint8_t flags, const uint8_t* body, uint16_t body_len);
+
+void delta_forget_source(uint8_t source);
+void delta_reset();
+
+#endif
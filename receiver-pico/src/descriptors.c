@@ -5,6 +5,8 @@
 
 #define USB_VID 0xCAFE
 #define USB_PID 0xBAF5
+// A different product ID, so hosts don't mix up cached descriptors.
+#define USB_PID_COMPOSITE 0xBAF6
 
 typedef struct {
     const uint8_t* configuration_descriptor;
@@ -561,20 +563,35 @@ uint8_t const our_report_descriptor_xac_compat[] = {
 };
 
 uint8_t const config_report_descriptor[] = {
-    0x06, 0x00, 0xFF,         // Usage Page (Vendor Defined 0xFF00)
-    0x09, 0x22,               // Usage (0x22)
-    0xA1, 0x01,               // Collection (Application)
-    0x85, REPORT_ID_CONFIG,   //   Report ID (REPORT_ID_CONFIG)
-    0x09, 0x22,               //   Usage (0x22)
-    0x75, 0x08,               //   Report Size (8)
-    0x95, 0x3F,               //   Report Count (63)
-    0xB1, 0x02,               //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
-    0x85, REPORT_ID_COMMAND,  //   Report ID (REPORT_ID_COMMAND)
-    0x09, 0x22,               //   Usage (0x22)
-    0x75, 0x08,               //   Report Size (8)
-    0x95, 0x3F,               //   Report Count (63)
-    0xB1, 0x02,               //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
-    0xC0,                     // End Collection
+    0x06, 0x00, 0xFF,             // Usage Page (Vendor Defined 0xFF00)
+    0x09, 0x22,                   // Usage (0x22)
+    0xA1, 0x01,                   // Collection (Application)
+    0x85, REPORT_ID_CONFIG,       //   Report ID (REPORT_ID_CONFIG)
+    0x09, 0x22,                   //   Usage (0x22)
+    0x75, 0x08,                   //   Report Size (8)
+    0x95, 0x3F,                   //   Report Count (63)
+    0xB1, 0x02,                   //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+    0x85, REPORT_ID_COMMAND,      //   Report ID (REPORT_ID_COMMAND)
+    0x09, 0x22,                   //   Usage (0x22)
+    0x75, 0x08,                   //   Report Size (8)
+    0x95, 0x3F,                   //   Report Count (63)
+    0xB1, 0x02,                   //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+    0x85, REPORT_ID_LATENCY,      //   Report ID (REPORT_ID_LATENCY)
+    0x09, 0x22,                   //   Usage (0x22)
+    0x75, 0x08,                   //   Report Size (8)
+    0x95, 0x3F,                   //   Report Count (63)
+    0xB1, 0x02,                   //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+    0x85, REPORT_ID_STATS,        //   Report ID (REPORT_ID_STATS)
+    0x09, 0x22,                   //   Usage (0x22)
+    0x75, 0x08,                   //   Report Size (8)
+    0x95, 0x3F,                   //   Report Count (63)
+    0xB1, 0x02,                   //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+    0x85, REPORT_ID_FRAME_PHASE,  //   Report ID (REPORT_ID_FRAME_PHASE)
+    0x09, 0x22,                   //   Usage (0x22)
+    0x75, 0x08,                   //   Report Size (8)
+    0x95, 0x3F,                   //   Report Count (63)
+    0xB1, 0x02,                   //   Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+    0xC0,                         // End Collection
 };
 
 const uint8_t configuration_descriptor0[] = {
@@ -613,6 +630,16 @@ const uint8_t configuration_descriptor5[] = {
     TUD_HID_DESCRIPTOR(1, 0, HID_ITF_PROTOCOL_NONE, sizeof(config_report_descriptor), 0x83, CFG_TUD_HID_EP_BUFSIZE, 1),
 };
 
+// Interfaces in the order of composite_descriptors, the configuration
+// interface keeps its usual place.
+const uint8_t configuration_descriptor_composite[] = {
+    TUD_CONFIG_DESCRIPTOR(1, 4, 0, TUD_CONFIG_DESC_LEN + 3 * TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN, 0, 100),
+    TUD_HID_DESCRIPTOR(0, 0, HID_ITF_PROTOCOL_KEYBOARD, sizeof(our_report_descriptor_kb_mouse), 0x81, CFG_TUD_HID_EP_BUFSIZE, 1),
+    TUD_HID_DESCRIPTOR(1, 0, HID_ITF_PROTOCOL_NONE, sizeof(config_report_descriptor), 0x83, CFG_TUD_HID_EP_BUFSIZE, 1),
+    TUD_HID_DESCRIPTOR(2, 0, HID_ITF_PROTOCOL_NONE, sizeof(our_report_descriptor_absolute), 0x84, CFG_TUD_HID_EP_BUFSIZE, 1),
+    TUD_HID_INOUT_DESCRIPTOR(3, 0, HID_ITF_PROTOCOL_NONE, sizeof(our_report_descriptor_horipad), 0x05, 0x85, CFG_TUD_HID_EP_BUFSIZE, 1),
+};
+
 our_descriptor_t our_descriptors[NOUR_DESCRIPTORS] = {
     {
         .configuration_descriptor = configuration_descriptor0,
@@ -645,7 +672,7 @@ our_descriptor_t our_descriptors[NOUR_DESCRIPTORS] = {
         .pid = 0x9400,
     },
     {
-        .configuration_descriptor = configuration_descriptor4,
+        .configuration_descriptor = configuration_descriptor5,
         .report_descriptor = our_report_descriptor_xac_compat,
         .vid = USB_VID,
         .pid = USB_PID,
@@ -659,23 +686,33 @@ char const* string_desc_arr[] = {
 };
 
 uint8_t const* tud_descriptor_device_cb(void) {
-    desc_device.idVendor = our_descriptors[our_descriptor_number].vid;
-    desc_device.idProduct = our_descriptors[our_descriptor_number].pid;
+    if (composite_mode) {
+        desc_device.idVendor = USB_VID;
+        desc_device.idProduct = USB_PID_COMPOSITE;
+    } else {
+        desc_device.idVendor = our_descriptors[usb_descriptor_number].vid;
+        desc_device.idProduct = our_descriptors[usb_descriptor_number].pid;
+    }
     return (uint8_t const*) &desc_device;
 }
 
 uint8_t const* tud_hid_descriptor_report_cb(uint8_t itf) {
-    if (itf == 0) {
-        return our_descriptors[our_descriptor_number].report_descriptor;
-    } else if (itf == 1) {
+    if (itf == CONFIG_INSTANCE) {
         return config_report_descriptor;
+    } else if (composite_mode && (itf < NINSTANCES)) {
+        return our_descriptors[composite_descriptors[itf]].report_descriptor;
+    } else if (itf == 0) {
+        return our_descriptors[usb_descriptor_number].report_descriptor;
     }
 
     return NULL;
 }
 
 uint8_t const* tud_descriptor_configuration_cb(uint8_t index) {
-    return our_descriptors[our_descriptor_number].configuration_descriptor;
+    if (composite_mode) {
+        return configuration_descriptor_composite;
+    }
+    return our_descriptors[usb_descriptor_number].configuration_descriptor;
 }
 
 static uint16_t _desc_str[32];
@@ -3,7 +3,18 @@
 
 #define NOUR_DESCRIPTORS 6
 
+// HID instances: the emulated device is 0, the configuration interface 1.
+// In composite mode the keyboard/mouse, absolute mouse and Switch gamepad
+// devices are all there at once, on instances 0, 2 and 3 (see
+// composite_descriptors).
+#define CONFIG_INSTANCE 1
+#define NINSTANCES 4
+#define NO_DESCRIPTOR 0xFF
+
 #define REPORT_ID_CONFIG 1
 #define REPORT_ID_COMMAND 2
+#define REPORT_ID_LATENCY 3
+#define REPORT_ID_STATS 4
+#define REPORT_ID_FRAME_PHASE 5
 
 #endif
@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "gamepad.h"
+
+#define NONE GAMEPAD_NONE
+
+// Hat switch values for up/down/left/right (bits 0-3) pressed, 8 stands
+// for centered and opposite directions cancel out.
+static const uint8_t hat_directions[16] = { 8, 0, 4, 8, 6, 7, 5, 6, 2, 1, 3, 2, 8, 0, 4, 8 };
+
+// One entry per emulated gamepad in our_descriptors[], test_gamepad checks
+// them against the report descriptors.
+static const gamepad_layout_t layouts[] = {
+    // Switch gamepad: 14 buttons, hat, X Y Z Rz
+    {
+        .our_descriptor_number = 2,
+        .report_id = 0,
+        .len = 8,
+        .buttons = {
+            [GAMEPAD_SOUTH] = 1,
+            [GAMEPAD_EAST] = 2,
+            [GAMEPAD_WEST] = 0,
+            [GAMEPAD_NORTH] = 3,
+            [GAMEPAD_L1] = 4,
+            [GAMEPAD_R1] = 5,
+            [GAMEPAD_L2] = 6,
+            [GAMEPAD_R2] = 7,
+            [GAMEPAD_SELECT] = 8,
+            [GAMEPAD_START] = 9,
+            [GAMEPAD_L3] = 10,
+            [GAMEPAD_R3] = 11,
+            [GAMEPAD_DPAD_UP] = NONE,
+            [GAMEPAD_DPAD_DOWN] = NONE,
+            [GAMEPAD_DPAD_LEFT] = NONE,
+            [GAMEPAD_DPAD_RIGHT] = NONE,
+            [GAMEPAD_HOME] = 12,
+            [GAMEPAD_CAPTURE] = 13,
+        },
+        .axes = { 3, 4, 5, 6, NONE, NONE },
+        .axis_min = 0,
+        .hat = 16,
+        // What the transmitters have always sent for centered.
+        .hat_null = 15,
+    },
+    // PS4 arcade stick: X Y Z Rz, hat, 14 buttons, Rx Ry as analog triggers
+    {
+        .our_descriptor_number = 3,
+        .report_id = 1,
+        .len = 63,
+        .buttons = {
+            [GAMEPAD_SOUTH] = 37,
+            [GAMEPAD_EAST] = 38,
+            [GAMEPAD_WEST] = 36,
+            [GAMEPAD_NORTH] = 39,
+            [GAMEPAD_L1] = 40,
+            [GAMEPAD_R1] = 41,
+            [GAMEPAD_L2] = 42,
+            [GAMEPAD_R2] = 43,
+            [GAMEPAD_SELECT] = 44,
+            [GAMEPAD_START] = 45,
+            [GAMEPAD_L3] = 46,
+            [GAMEPAD_R3] = 47,
+            [GAMEPAD_DPAD_UP] = NONE,
+            [GAMEPAD_DPAD_DOWN] = NONE,
+            [GAMEPAD_DPAD_LEFT] = NONE,
+            [GAMEPAD_DPAD_RIGHT] = NONE,
+            [GAMEPAD_HOME] = 48,
+            [GAMEPAD_CAPTURE] = 49,
+        },
+        .axes = { 0, 1, 2, 3, 7, 8 },
+        .axis_min = 0,
+        .hat = 32,
+        .hat_null = 8,
+    },
+    // Stadia controller: hat, 15 buttons, X Y Z Rz, brake and accelerator
+    {
+        .our_descriptor_number = 4,
+        .report_id = 3,
+        .len = 10,
+        .buttons = {
+            [GAMEPAD_SOUTH] = 22,
+            [GAMEPAD_EAST] = 21,
+            [GAMEPAD_WEST] = 20,
+            [GAMEPAD_NORTH] = 19,
+            [GAMEPAD_L1] = 18,
+            [GAMEPAD_R1] = 17,
+            [GAMEPAD_L2] = 11,
+            [GAMEPAD_R2] = 10,
+            [GAMEPAD_SELECT] = 14,
+            [GAMEPAD_START] = 13,
+            [GAMEPAD_L3] = 16,
+            [GAMEPAD_R3] = 15,
+            [GAMEPAD_DPAD_UP] = NONE,
+            [GAMEPAD_DPAD_DOWN] = NONE,
+            [GAMEPAD_DPAD_LEFT] = NONE,
+            [GAMEPAD_DPAD_RIGHT] = NONE,
+            [GAMEPAD_HOME] = 12,
+            [GAMEPAD_CAPTURE] = 9,
+        },
+        .axes = { 3, 4, 5, 6, 7, 8 },
+        // The sticks' logical minimum is 1.
+        .axis_min = 1,
+        .hat = 0,
+        .hat_null = 8,
+    },
+    // XAC/Flex compatible: X Y Z Rz, hat, 12 buttons
+    {
+        .our_descriptor_number = 5,
+        .report_id = 0,
+        .len = 6,
+        .buttons = {
+            [GAMEPAD_SOUTH] = 36,
+            [GAMEPAD_EAST] = 37,
+            [GAMEPAD_WEST] = 38,
+            [GAMEPAD_NORTH] = 39,
+            [GAMEPAD_L1] = 40,
+            [GAMEPAD_R1] = 41,
+            [GAMEPAD_L2] = 46,
+            [GAMEPAD_R2] = 47,
+            [GAMEPAD_SELECT] = 42,
+            [GAMEPAD_START] = 43,
+            [GAMEPAD_L3] = 44,
+            [GAMEPAD_R3] = 45,
+            [GAMEPAD_DPAD_UP] = NONE,
+            [GAMEPAD_DPAD_DOWN] = NONE,
+            [GAMEPAD_DPAD_LEFT] = NONE,
+            [GAMEPAD_DPAD_RIGHT] = NONE,
+            [GAMEPAD_HOME] = NONE,
+            [GAMEPAD_CAPTURE] = NONE,
+        },
+        .axes = { 0, 1, 2, 3, NONE, NONE },
+        .axis_min = 0,
+        .hat = 32,
+        .hat_null = 8,
+    },
+};
+
+const gamepad_layout_t* gamepad_layout(uint8_t our_descriptor_number) {
+    for (unsigned int i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        if (layouts[i].our_descriptor_number == our_descriptor_number) {
+            return &layouts[i];
+        }
+    }
+    return NULL;
+}
+
+void gamepad_pack(const gamepad_layout_t* layout, const uint8_t* report, uint8_t* out) {
+    uint32_t buttons = report[0] | (report[1] << 8) | (report[2] << 16) | ((uint32_t) report[3] << 24);
+
+    memset(out, 0, layout->len);
+    for (int i = 0; i < GAMEPAD_BUTTONS; i++) {
+        uint8_t bit = layout->buttons[i];
+        if ((buttons & (1 << i)) && (bit != NONE)) {
+            out[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+
+    if (layout->hat != NONE) {
+        uint8_t hat = hat_directions[(buttons >> GAMEPAD_DPAD_UP) & 0x0F];
+        if (hat == 8) {
+            hat = layout->hat_null;
+        }
+        out[layout->hat / 8] |= hat << (layout->hat % 8);
+    }
+
+    // Sticks are signed, centered at 0, triggers unsigned. Both keep their
+    // top 8 bits.
+    for (int i = 0; i < GAMEPAD_AXES; i++) {
+        uint8_t offset = layout->axes[i];
+        if (offset == NONE) {
+            continue;
+        }
+        uint8_t value = report[5 + 2 * i];
+        if (i < GAMEPAD_L2_AXIS) {
+            value ^= 0x80;
+            if (value < layout->axis_min) {
+                value = layout->axis_min;
+            }
+        }
+        out[offset] = value;
+    }
+}
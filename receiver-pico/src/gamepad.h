@@ -0,0 +1,78 @@
+#ifndef _GAMEPAD_H_
+#define _GAMEPAD_H_
+
+#include <stdint.h>
+
+// A gamepad report that doesn't depend on the emulated device. Transmitters
+// send it as report ID 0 for GAMEPAD_DESCRIPTOR and the receiver packs it
+// into the report of whichever gamepad it emulates, so the same stream
+// drives all of them. All fields are little-endian:
+//
+//   uint32 buttons    bit n is GAMEPAD_BUTTON n
+//   int16  lx, ly     left stick, 0 centered, positive is right/down
+//   int16  rx, ry     right stick
+//   uint16 l2, r2     analog triggers, 0 released
+//
+// Buttons are numbered like the W3C Gamepad API's standard mapping, by
+// position rather than label: GAMEPAD_SOUTH is B on a Switch controller
+// and cross on a PlayStation one.
+
+#define GAMEPAD_DESCRIPTOR 0x80
+#define GAMEPAD_REPORT_ID 0
+#define GAMEPAD_REPORT_SIZE 16
+
+#define GAMEPAD_SOUTH 0
+#define GAMEPAD_EAST 1
+#define GAMEPAD_WEST 2
+#define GAMEPAD_NORTH 3
+#define GAMEPAD_L1 4
+#define GAMEPAD_R1 5
+#define GAMEPAD_L2 6
+#define GAMEPAD_R2 7
+#define GAMEPAD_SELECT 8
+#define GAMEPAD_START 9
+#define GAMEPAD_L3 10
+#define GAMEPAD_R3 11
+#define GAMEPAD_DPAD_UP 12
+#define GAMEPAD_DPAD_DOWN 13
+#define GAMEPAD_DPAD_LEFT 14
+#define GAMEPAD_DPAD_RIGHT 15
+#define GAMEPAD_HOME 16
+#define GAMEPAD_CAPTURE 17
+#define GAMEPAD_BUTTONS 18
+
+#define GAMEPAD_LX 0
+#define GAMEPAD_LY 1
+#define GAMEPAD_RX 2
+#define GAMEPAD_RY 3
+#define GAMEPAD_L2_AXIS 4
+#define GAMEPAD_R2_AXIS 5
+#define GAMEPAD_AXES 6
+
+// Where the emulated gamepad's report has each of the canonical report's
+// fields. Positions are in bits for buttons and the hat switch and in
+// bytes for axes, GAMEPAD_NONE if the device doesn't have the field.
+// Buttons are one bit, axes one byte, the hat switch a nibble that holds
+// hat_null when no direction is pressed.
+#define GAMEPAD_NONE 0xFF
+
+typedef struct {
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t buttons[GAMEPAD_BUTTONS];
+    uint8_t axes[GAMEPAD_AXES];
+    // Smallest value the sticks go down to.
+    uint8_t axis_min;
+    uint8_t hat;
+    uint8_t hat_null;
+} gamepad_layout_t;
+
+// Returns the layout for an emulated device, NULL if it isn't a gamepad.
+const gamepad_layout_t* gamepad_layout(uint8_t our_descriptor_number);
+
+// Packs a canonical report into layout's report, out has to hold
+// layout->len bytes.
+void gamepad_pack(const gamepad_layout_t* layout, const uint8_t* report, uint8_t* out);
+
+#endif
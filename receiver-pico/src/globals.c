@@ -1,3 +1,7 @@
 #include "globals.h"
 
 uint8_t our_descriptor_number;
+uint8_t usb_descriptor_number;
+
+bool composite_mode;
+const uint8_t composite_descriptors[NINSTANCES] = { 0, NO_DESCRIPTOR, 1, 2 };
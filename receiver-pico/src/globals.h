@@ -1,8 +1,20 @@
 #ifndef _GLOBALS_H_
 #define _GLOBALS_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "descriptors.h"
+
+// Device the incoming reports are for, on the core that receives them.
 extern uint8_t our_descriptor_number;
+// Device the USB host sees, on the core that runs the USB stack. Follows
+// our_descriptor_number by re-enumerating.
+extern uint8_t usb_descriptor_number;
+
+// Set at boot. Several emulated devices at once, no switching between them.
+extern bool composite_mode;
+// The emulated device on each HID instance in composite mode.
+extern const uint8_t composite_descriptors[NINSTANCES];
 
 #endif
@@ -0,0 +1,97 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "latency.h"
+
+#include "descriptors.h"
+
+// Every endpoint can have a report in flight.
+static bool in_flight[NINSTANCES];
+static uint32_t in_flight_arrival_us[NINSTANCES];
+
+static uint32_t samples;
+static uint32_t max_us;
+static uint64_t sum_us;
+static uint16_t buckets[LATENCY_BUCKETS];
+
+static uint32_t last_sof_us;
+static frame_phase_t phase;
+
+static int bucket_for(uint32_t latency_us) {
+    int bucket = 0;
+    uint32_t limit = LATENCY_BUCKET0_US;
+    while ((latency_us >= limit) && (bucket < LATENCY_BUCKETS - 1)) {
+        limit <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Halves all counters when one of them is about to overflow.
+static void histogram_add(uint16_t* histogram, int nbuckets, int bucket) {
+    if (histogram[bucket] == UINT16_MAX) {
+        for (int i = 0; i < nbuckets; i++) {
+            histogram[i] /= 2;
+        }
+    }
+    histogram[bucket]++;
+}
+
+static int phase_bucket(uint32_t timestamp_us) {
+    int32_t since_sof = (int32_t) (timestamp_us - last_sof_us);
+    int32_t in_frame = ((since_sof % 1000) + 1000) % 1000;
+    return in_frame / FRAME_PHASE_BUCKET_US;
+}
+
+void latency_sof(uint32_t timestamp_us) {
+    last_sof_us = timestamp_us;
+    phase.sofs++;
+}
+
+void latency_report_sent(uint8_t instance, uint32_t arrival_us) {
+    in_flight[instance] = true;
+    in_flight_arrival_us[instance] = arrival_us;
+}
+
+void latency_report_complete(uint8_t instance) {
+    if (!in_flight[instance]) {
+        return;
+    }
+    in_flight[instance] = false;
+
+    uint32_t arrival_us = in_flight_arrival_us[instance];
+    uint32_t now = time_us_32();
+    uint32_t latency_us = now - arrival_us;
+    histogram_add(buckets, LATENCY_BUCKETS, bucket_for(latency_us));
+    samples++;
+    sum_us += latency_us;
+    if (latency_us > max_us) {
+        max_us = latency_us;
+    }
+
+    if (phase.sofs > 0) {
+        histogram_add(phase.arrival, FRAME_PHASE_BUCKETS, phase_bucket(arrival_us));
+        histogram_add(phase.complete, FRAME_PHASE_BUCKETS, phase_bucket(now));
+    }
+}
+
+void latency_get(latency_histogram_t* histogram) {
+    histogram->samples = samples;
+    histogram->max_us = max_us;
+    histogram->mean_us = (samples > 0) ? (sum_us / samples) : 0;
+    memcpy(histogram->buckets, buckets, sizeof(buckets));
+}
+
+void latency_get_frame_phase(frame_phase_t* frame_phase) {
+    *frame_phase = phase;
+}
+
+void latency_reset() {
+    samples = 0;
+    max_us = 0;
+    sum_us = 0;
+    memset(buckets, 0, sizeof(buckets));
+    memset(&phase, 0, sizeof(phase));
+}
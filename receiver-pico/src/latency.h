@@ -0,0 +1,49 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+// Histogram of the time between a packet arriving at the receiver and the
+// host reading the resulting report from the IN endpoint. Bucket 0 counts
+// latencies below LATENCY_BUCKET0_US, bucket n (n > 0) the ones in
+// [LATENCY_BUCKET0_US << (n - 1), LATENCY_BUCKET0_US << n), the last
+// bucket everything above that. Buckets are 16-bit, when one fills up
+// they're all halved, which keeps the shape of the distribution.
+// Everything here runs on the core that runs the USB stack.
+
+#define LATENCY_BUCKETS 22
+#define LATENCY_BUCKET0_US 8
+
+typedef struct {
+    uint32_t samples;
+    uint32_t max_us;
+    uint32_t mean_us;
+    uint16_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+// Where in the 1 ms USB frame, relative to the start of frame callback,
+// reports arrived and were read by the host. Bucket n covers
+// [n * FRAME_PHASE_BUCKET_US, (n + 1) * FRAME_PHASE_BUCKET_US).
+#define FRAME_PHASE_BUCKETS 8
+#define FRAME_PHASE_BUCKET_US 125
+
+typedef struct {
+    uint32_t sofs;
+    uint16_t arrival[FRAME_PHASE_BUCKETS];
+    uint16_t complete[FRAME_PHASE_BUCKETS];
+} frame_phase_t;
+
+// A report containing data that arrived at arrival_us (time_us_32()) was
+// handed to the USB stack for HID instance instance.
+void latency_report_sent(uint8_t instance, uint32_t arrival_us);
+// The host read it.
+void latency_report_complete(uint8_t instance);
+
+// Called from tud_sof_cb().
+void latency_sof(uint32_t timestamp_us);
+
+void latency_get(latency_histogram_t* histogram);
+void latency_get_frame_phase(frame_phase_t* frame_phase);
+void latency_reset();
+
+#endif
@@ -0,0 +1,149 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "pico/time.h"
+
+#include "link.h"
+
+#include "crc.h"
+#include "slip.h"
+#include "stats.h"
+#include "uart_rx.h"
+
+static uart_inst_t* link_uart;
+static uint32_t default_rate;
+static uint32_t max_rate;
+static uint32_t current_rate;
+
+// Set after switching until the first valid frame arrives at the new rate.
+static bool on_trial;
+static uint32_t switched_at_us;
+static uint32_t packets_at_switch;
+
+static uint32_t window_start_us;
+static uint32_t errors_at_window_start;
+static uint32_t last_status_us;
+
+static uint32_t uart_errors() {
+    return rx_stats[TRANSPORT_UART].crc_errors + rx_stats[TRANSPORT_UART].framing_errors + uart_rx_framing_errors();
+}
+
+static void put_escaped(uint8_t c) {
+    if (c == END) {
+        uart_putc_raw(link_uart, ESC);
+        uart_putc_raw(link_uart, ESC_END);
+    } else if (c == ESC) {
+        uart_putc_raw(link_uart, ESC);
+        uart_putc_raw(link_uart, ESC_ESC);
+    } else {
+        uart_putc_raw(link_uart, c);
+    }
+}
+
+// Same framing as what we receive: SLIP with a CRC32 trailer.
+static void send_frame(const uint8_t* data, uint16_t len) {
+    uint32_t crc = crc32(data, len);
+    uart_putc_raw(link_uart, END);
+    for (int i = 0; i < len; i++) {
+        put_escaped(data[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        put_escaped((crc >> (i * 8)) & 0xFF);
+    }
+    uart_putc_raw(link_uart, END);
+}
+
+static void send_status(uint32_t baudrate) {
+    link_status_t status = {
+        .protocol_version = PROTOCOL_VERSION_LINK,
+        .command = LINK_COMMAND_STATUS,
+        .baudrate = baudrate,
+        .packets = rx_stats[TRANSPORT_UART].packets,
+        .crc_errors = rx_stats[TRANSPORT_UART].crc_errors,
+        .framing_errors = rx_stats[TRANSPORT_UART].framing_errors + uart_rx_framing_errors(),
+    };
+    send_frame((const uint8_t*) &status, sizeof(status));
+    last_status_us = time_us_32();
+}
+
+// The status goes out at the old rate, so the transmitter hears it before
+// both sides switch.
+static void switch_rate(uint32_t baudrate) {
+    send_status(baudrate);
+    uart_tx_wait_blocking(link_uart);
+    uart_rx_set_baudrate(baudrate);
+    current_rate = baudrate;
+    on_trial = (baudrate != default_rate);
+    switched_at_us = time_us_32();
+    packets_at_switch = rx_stats[TRANSPORT_UART].packets;
+    window_start_us = switched_at_us;
+    errors_at_window_start = uart_errors();
+    printf("serial link at %" PRIu32 " baud\n", baudrate);
+}
+
+void link_init(uart_inst_t* uart, uint32_t default_baudrate, uint32_t max_baudrate) {
+    link_uart = uart;
+    default_rate = default_baudrate;
+    max_rate = max_baudrate;
+    current_rate = default_baudrate;
+    on_trial = false;
+}
+
+void link_handle_packet(const uint8_t* data, uint16_t len) {
+    if (len != sizeof(link_packet_t)) {
+        rx_stats[TRANSPORT_UART].invalid_packets++;
+        return;
+    }
+    const link_packet_t* msg = (const link_packet_t*) data;
+    switch (msg->command) {
+        case LINK_COMMAND_PROPOSE:
+            if ((msg->baudrate < default_rate) || (msg->baudrate > max_rate)) {
+                // Declined, stay where we are.
+                send_status(current_rate);
+            } else if (msg->baudrate != current_rate) {
+                switch_rate(msg->baudrate);
+            } else {
+                send_status(current_rate);
+            }
+            break;
+        case LINK_COMMAND_STATUS_REQUEST:
+            send_status(current_rate);
+            break;
+        default:
+            rx_stats[TRANSPORT_UART].invalid_packets++;
+            break;
+    }
+}
+
+void link_task() {
+    if (current_rate == default_rate) {
+        return;
+    }
+    uint32_t now = time_us_32();
+
+    if (on_trial) {
+        if (rx_stats[TRANSPORT_UART].packets != packets_at_switch) {
+            on_trial = false;
+        } else if (now - switched_at_us >= LINK_TRIAL_US) {
+            printf("nothing received at %" PRIu32 " baud\n", current_rate);
+            switch_rate(default_rate);
+            return;
+        }
+    }
+
+    if (now - window_start_us >= LINK_ERROR_WINDOW_US) {
+        uint32_t errors = uart_errors();
+        if (errors - errors_at_window_start > LINK_MAX_ERRORS) {
+            printf("too many errors at %" PRIu32 " baud\n", current_rate);
+            switch_rate(default_rate);
+            return;
+        }
+        window_start_us = now;
+        errors_at_window_start = errors;
+    }
+
+    if (now - last_status_us >= LINK_STATUS_INTERVAL_US) {
+        send_status(current_rate);
+    }
+}
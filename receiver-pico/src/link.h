@@ -0,0 +1,53 @@
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include <stdint.h>
+
+#include "hardware/uart.h"
+
+// Serial link speed negotiation. The transmitter proposes a baud rate in
+// a protocol version 5 packet, the receiver answers with the rate it is
+// going to use (on its TX pin, at the old rate) and switches. If no valid
+// frame arrives at the new rate within LINK_TRIAL_US, or CRC and framing
+// errors pile up later, the receiver announces the default rate and goes
+// back to it. While at another rate than the default it repeats its
+// status every LINK_STATUS_INTERVAL_US, so a transmitter that stops
+// hearing it can fall back as well.
+
+#define PROTOCOL_VERSION_LINK 5
+
+#define LINK_COMMAND_PROPOSE 0         // transmitter: switch to baudrate
+#define LINK_COMMAND_STATUS_REQUEST 1  // transmitter: send a status
+#define LINK_COMMAND_STATUS 2          // receiver: link_status_t
+
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t command;
+    uint32_t baudrate;
+} link_packet_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t command;
+    uint32_t baudrate;
+    // The UART's counters from transport_stats_t, so the transmitter can
+    // measure the error rate at the current speed.
+    uint32_t packets;
+    uint32_t crc_errors;
+    uint32_t framing_errors;
+} link_status_t;
+
+#define LINK_TRIAL_US 1000000
+#define LINK_STATUS_INTERVAL_US 250000
+// More bad frames than this within LINK_ERROR_WINDOW_US mean the link
+// can't take the speed.
+#define LINK_ERROR_WINDOW_US 100000
+#define LINK_MAX_ERRORS 8
+
+// uart is the one uart_rx receives on, replies go out on its TX pin.
+void link_init(uart_inst_t* uart, uint32_t default_baudrate, uint32_t max_baudrate);
+// Protocol version 5 packets received over the UART.
+void link_handle_packet(const uint8_t* data, uint16_t len);
+void link_task();
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "merge.h"
+
+#include "packet.h"
+
+#define MAX_REPORT_SIZE 64
+#define AXIS_CENTER 0x80
+// Hat switches report 0-7 for the eight directions, anything above is
+// centered.
+#define HAT_MAX_DIRECTION 7
+
+#define BYTE(n) (1ULL << (n))
+#define BYTES(n, count) (((1ULL << (count)) - 1) << (n))
+#define INT16(n) BYTES(n, 2)
+
+typedef struct {
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    // One bit per byte offset.
+    uint64_t button_bytes;    // bitmaps of buttons or keys
+    uint64_t axis_bytes;      // unsigned, centered at AXIS_CENTER
+    uint64_t hat_bytes;
+    uint64_t relative_bytes;  // movement since the last report, never merged
+} merge_layout_t;
+
+static const merge_layout_t layouts[] = {
+    // mouse and keyboard: relative mouse, keyboard, consumer control
+    { 0, 1, BYTE(0), 0, 0, INT16(1) | INT16(3) | INT16(5) | INT16(7) },
+    { 0, 2, BYTES(0, 16), 0, 0, 0 },
+    { 0, 3, BYTE(0), 0, 0, 0 },
+    // absolute mouse and keyboard: absolute X/Y, relative scroll
+    { 1, 1, BYTE(0), 0, 0, INT16(5) | INT16(7) },
+    { 1, 2, BYTES(0, 16), 0, 0, 0 },
+    { 1, 3, BYTE(0), 0, 0, 0 },
+    // Switch gamepad
+    { 2, 0, BYTE(0) | BYTE(1), BYTES(3, 4), BYTE(2), 0 },
+};
+
+#define NLAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+typedef struct {
+    bool valid;
+    uint8_t len;
+    uint32_t updated_us;
+    uint8_t data[MAX_REPORT_SIZE];
+} source_state_t;
+
+// Latest state from every source, for each report in layouts.
+static source_state_t states[NLAYOUTS][NSOURCES];
+static uint8_t policy = MERGE_POLICY_LATEST;
+
+void merge_set_policy(uint8_t merge_policy) {
+    policy = merge_policy;
+}
+
+static int find_layout(uint8_t our_descriptor_number, uint8_t report_id) {
+    for (unsigned int i = 0; i < NLAYOUTS; i++) {
+        if ((layouts[i].our_descriptor_number == our_descriptor_number) &&
+            (layouts[i].report_id == report_id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t merge_byte(const merge_layout_t* layout, int i, const uint8_t* data, const source_state_t* active[], int nactive) {
+    uint64_t bit = BYTE(i);
+
+    if (layout->relative_bytes & bit) {
+        return data[i];
+    }
+    if (layout->button_bytes & bit) {
+        uint8_t value = 0;
+        for (int s = 0; s < nactive; s++) {
+            value |= active[s]->data[i];
+        }
+        return value;
+    }
+    if (layout->hat_bytes & bit) {
+        for (int s = 0; s < nactive; s++) {
+            if (active[s]->data[i] <= HAT_MAX_DIRECTION) {
+                return active[s]->data[i];
+            }
+        }
+        return data[i];
+    }
+    if (layout->axis_bytes & bit) {
+        if (policy == MERGE_POLICY_COMBINE) {
+            int32_t value = AXIS_CENTER;
+            for (int s = 0; s < nactive; s++) {
+                value += active[s]->data[i] - AXIS_CENTER;
+            }
+            return (value < 0) ? 0 : (value > 0xFF) ? 0xFF : value;
+        }
+        for (int s = 0; s < nactive; s++) {
+            if (active[s]->data[i] != AXIS_CENTER) {
+                return active[s]->data[i];
+            }
+        }
+        return AXIS_CENTER;
+    }
+    return (policy == MERGE_POLICY_COMBINE) ? data[i] : active[0]->data[i];
+}
+
+const uint8_t* merge_report(uint8_t source, uint8_t our_descriptor_number, uint8_t report_id, const uint8_t* data, uint8_t len, uint32_t now_us) {
+    static uint8_t merged[MAX_REPORT_SIZE];
+
+    if ((policy == MERGE_POLICY_LATEST) || (source >= NSOURCES) || (len > MAX_REPORT_SIZE)) {
+        return data;
+    }
+    int l = find_layout(our_descriptor_number, report_id);
+    if (l < 0) {
+        return data;
+    }
+
+    source_state_t* state = &states[l][source];
+    state->valid = true;
+    state->len = len;
+    state->updated_us = now_us;
+    memcpy(state->data, data, len);
+
+    // In priority order, which is the order of the sources.
+    const source_state_t* active[NSOURCES];
+    int nactive = 0;
+    for (int s = 0; s < NSOURCES; s++) {
+        const source_state_t* other = &states[l][s];
+        if (other->valid && (other->len == len) &&
+            ((s == source) || (now_us - other->updated_us < MERGE_SOURCE_TIMEOUT_US))) {
+            active[nactive++] = other;
+        }
+    }
+    if (nactive == 1) {
+        return data;
+    }
+
+    for (int i = 0; i < len; i++) {
+        merged[i] = merge_byte(&layouts[l], i, data, active, nactive);
+    }
+    return merged;
+}
+
+void merge_forget_source(uint8_t source) {
+    if (source >= NSOURCES) {
+        return;
+    }
+    for (unsigned int l = 0; l < NLAYOUTS; l++) {
+        states[l][source].valid = false;
+    }
+}
+
+void merge_reset() {
+    memset(states, 0, sizeof(states));
+}
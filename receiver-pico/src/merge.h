@@ -0,0 +1,35 @@
+#ifndef _MERGE_H_
+#define _MERGE_H_
+
+#include <stdint.h>
+
+// Combines the states several sources (see NSOURCES) send for the same
+// report, so more than one input generator can drive one device without
+// an aggregation step on the PC. Only reports with a known layout are
+// merged, and only with sources heard from in the last
+// MERGE_SOURCE_TIMEOUT_US, anything else is forwarded as it arrived.
+
+// Each report as it arrives, the other sources are ignored.
+#define MERGE_POLICY_LATEST 0
+// Buttons and keys pressed on any source, stick deflections added up.
+// Anything else is taken from the report that just arrived.
+#define MERGE_POLICY_COMBINE 1
+// Buttons and keys pressed on any source, anything else from the first
+// source in the order of NSOURCES (UART, Bluetooth, UDP) that isn't
+// centered, or that has a state at all for fields without a center.
+#define MERGE_POLICY_PRIORITY 2
+
+// Senders that only send on change have to repeat their state more often
+// than this to stay part of the merge.
+#define MERGE_SOURCE_TIMEOUT_US 1000000
+
+void merge_set_policy(uint8_t policy);
+
+// Returns the report to forward in place of data (len bytes), which may be
+// data itself.
+const uint8_t* merge_report(uint8_t source, uint8_t our_descriptor_number, uint8_t report_id, const uint8_t* data, uint8_t len, uint32_t now_us);
+
+void merge_forget_source(uint8_t source);
+void merge_reset();
+
+#endif
@@ -0,0 +1,158 @@
+#ifdef NETWORK_ENABLED
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+
+#include "net.h"
+#include "packet.h"
+#include "spsc.h"
+#include "stats.h"
+
+#define OUR_PORT 42734
+
+// Datagrams waiting for net_task(). The pbufs are queued as they are, so
+// this is kept at half of PBUF_POOL_SIZE to leave the driver buffers for
+// everything else.
+#define RX_QUEUE_CAPACITY 32
+
+// Largest datagram we accept, a full batch of reports fits easily.
+#define MAX_DATAGRAM_SIZE 1024
+
+typedef struct {
+    struct pbuf* p;
+    uint32_t timestamp_us;
+    uint8_t peer;
+    // First datagram from a peer that took over the slot from another one.
+    bool new_peer;
+} rx_datagram_t;
+
+// Senders, told apart by address and port. When all slots are taken the
+// one not heard from for the longest goes to the new sender.
+typedef struct {
+    bool used;
+    ip_addr_t addr;
+    u16_t port;
+    uint32_t last_heard_us;
+} peer_t;
+
+static struct udp_pcb* pcb;
+static bool wifi_connected = false;
+
+static peer_t peers[NET_MAX_PEERS];
+
+static spsc_t rx_queue;
+static rx_datagram_t rx_queue_buffer[RX_QUEUE_CAPACITY];
+
+static uint8_t find_peer(const ip_addr_t* addr, u16_t port, uint32_t now, bool* new_peer) {
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < NET_MAX_PEERS; i++) {
+        if (peers[i].used && (peers[i].port == port) && ip_addr_cmp(&peers[i].addr, addr)) {
+            peers[i].last_heard_us = now;
+            *new_peer = false;
+            return i;
+        }
+        if (!peers[oldest].used) {
+            continue;
+        }
+        if (!peers[i].used || (now - peers[i].last_heard_us > now - peers[oldest].last_heard_us)) {
+            oldest = i;
+        }
+    }
+    peers[oldest].used = true;
+    ip_addr_copy(peers[oldest].addr, *addr);
+    peers[oldest].port = port;
+    peers[oldest].last_heard_us = now;
+    *new_peer = true;
+    return oldest;
+}
+
+// With pico_cyw43_arch_lwip_threadsafe_background this runs from the CYW43
+// interrupt, so it only timestamps the datagram and queues it. Parsing
+// happens in net_task(), which keeps everything downstream of the parser
+// on the main loop.
+static void net_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    rx_datagram_t d = { p, time_us_32() };
+    d.peer = find_peer(addr, port, d.timestamp_us, &d.new_peer);
+    if (!spsc_push(&rx_queue, &d)) {
+        if (d.new_peer) {
+            // So the next datagram still clears what the slot's previous
+            // owner left behind.
+            peers[d.peer].used = false;
+        }
+        rx_queue_drops[TRANSPORT_UDP]++;
+        pbuf_free(p);
+    }
+}
+
+void net_init(const char* ssid, const char* password) {
+    spsc_init(&rx_queue, rx_queue_buffer, sizeof(rx_datagram_t), RX_QUEUE_CAPACITY);
+
+    cyw43_arch_enable_sta_mode();
+    if (strlen(ssid) > 0) {
+        cyw43_arch_wifi_connect_async(ssid, password, CYW43_AUTH_WPA2_AES_PSK);
+    }
+
+    cyw43_arch_lwip_begin();
+    pcb = udp_new();
+    udp_bind(pcb, IP_ANY_TYPE, OUR_PORT);
+    udp_recv(pcb, net_recv, NULL);
+    cyw43_arch_lwip_end();
+}
+
+static void handle_datagram(struct pbuf* p) {
+    static uint8_t buffer[MAX_DATAGRAM_SIZE];
+
+    if (p->len == p->tot_len) {
+        // Common case, the whole datagram is in one pbuf.
+        handle_received_packet(p->payload, p->len);
+    } else if (p->tot_len <= sizeof(buffer)) {
+        uint16_t len = pbuf_copy_partial(p, buffer, p->tot_len, 0);
+        handle_received_packet(buffer, len);
+    } else {
+        printf("datagram too long (%u bytes)\n", p->tot_len);
+        rx_stats[TRANSPORT_UDP].packets++;
+        rx_stats[TRANSPORT_UDP].bytes += p->tot_len;
+        rx_stats[TRANSPORT_UDP].invalid_packets++;
+    }
+}
+
+void net_task() {
+    wifi_connected = CYW43_LINK_UP == cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+
+    if (pcb == NULL) {
+        return;
+    }
+
+    // Everything that arrived since the last call is parsed in one go and
+    // the pbufs go back to lwIP together, so the lock is taken once.
+    struct pbuf* done[RX_QUEUE_CAPACITY];
+    int ndone = 0;
+    rx_datagram_t* d;
+    while ((ndone < RX_QUEUE_CAPACITY) && ((d = spsc_front(&rx_queue)) != NULL)) {
+        if (d->new_peer) {
+            packet_forget_source(TRANSPORT_UDP, d->peer);
+        }
+        packet_set_source(TRANSPORT_UDP, d->peer, d->timestamp_us);
+        handle_datagram(d->p);
+        done[ndone++] = d->p;
+        spsc_release(&rx_queue);
+    }
+
+    if (ndone > 0) {
+        cyw43_arch_lwip_begin();
+        for (int i = 0; i < ndone; i++) {
+            pbuf_free(done[i]);
+        }
+        cyw43_arch_lwip_end();
+    }
+}
+
+bool net_is_connected() {
+    return wifi_connected;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _NET_H_
+#define _NET_H_
+
+#ifdef NETWORK_ENABLED
+
+#include <stdbool.h>
+
+void net_init(const char* ssid, const char* password);
+// Hands the datagrams queued since the last call to the packet parser.
+void net_task();
+bool net_is_connected();
+
+#endif
+
+#endif
@@ -0,0 +1,758 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/time.h"
+#include "tusb.h"
+
+#include "packet.h"
+
+#include "crc.h"
+#include "delta.h"
+#include "descriptors.h"
+#include "gamepad.h"
+#include "globals.h"
+#include "latency.h"
+#include "link.h"
+#include "merge.h"
+#include "receiver.h"
+#include "report_pool.h"
+#include "report_queue.h"
+#include "sequence.h"
+#include "slip.h"
+#include "spsc.h"
+#include "stats.h"
+
+#define PROTOCOL_VERSION 1
+#define PROTOCOL_VERSION_DELTA 2
+#define PROTOCOL_VERSION_BATCH 3
+#define PROTOCOL_VERSION_SEQUENCED 4
+
+#define BATCH_MAX_RECORDS 8
+// The newest packet plus up to 7 copies of earlier ones.
+#define SEQUENCED_MAX_RECORDS 8
+
+#define SERIAL_MAX_PACKET_SIZE 512
+
+// What canonical gamepad reports turn into when the emulated device isn't
+// a gamepad: the Switch gamepad.
+#define DEFAULT_GAMEPAD_DESCRIPTOR 2
+
+// How long the device stays off the bus when switching to another
+// descriptor, long enough for the host to notice it's gone.
+#define REENUMERATE_DISCONNECT_US 100000
+
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t our_descriptor_number;
+    uint8_t len;
+    uint8_t report_id;
+    uint8_t data[0];
+} packet_t;
+
+// Same as packet_t up to report_id, len is the length of the reconstructed
+// report, data holds either the full report or runs of changed bytes.
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t our_descriptor_number;
+    uint8_t len;
+    uint8_t report_id;
+    uint8_t seq;
+    uint8_t flags;
+    uint8_t data[0];
+} delta_packet_t;
+
+// Several reports for the same descriptor, count records follow the header.
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t our_descriptor_number;
+    uint8_t count;
+    uint8_t data[0];
+} batch_packet_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t report_id;
+    uint8_t len;
+    uint8_t data[0];
+} batch_record_t;
+
+// Sequence number and send time (sender's clock, microseconds), followed
+// by count records, each holding a complete packet of another version.
+// The first record is the newest, record i was first sent with seq - i.
+typedef struct __attribute__((packed)) {
+    uint8_t protocol_version;
+    uint8_t count;
+    uint32_t seq;
+    uint32_t timestamp_us;
+    uint8_t data[0];
+} sequenced_packet_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t len;
+    uint8_t data[0];
+} sequenced_record_t;
+
+#ifdef DUAL_CORE
+// Reports validated on core 0, on their way to the USB stack on core 1.
+typedef struct {
+    uint32_t arrival_us;
+    uint8_t transport;
+    uint8_t instance;
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    report_ref_t report;
+} usb_report_t;
+
+#define USB_REPORTS_CAPACITY 16
+static usb_report_t usb_reports_buffer[USB_REPORTS_CAPACITY];
+static spsc_t usb_reports = {
+    .buffer = (uint8_t*) usb_reports_buffer,
+    .elem_size = sizeof(usb_report_t),
+    .capacity = USB_REPORTS_CAPACITY,
+};
+#endif
+
+// Where the data currently being fed in came from and when it arrived,
+// and when the packet being handled arrived.
+static uint8_t transport;
+static uint8_t source;
+static uint32_t arrival_us;
+static uint32_t packet_arrival_us;
+// The pool buffer the packet being handled was decoded into, if any.
+static uint8_t packet_buffer = NO_BUFFER;
+
+static uint8_t source_number(uint8_t source_transport, uint8_t peer) {
+    switch (source_transport) {
+        case TRANSPORT_BT:
+            return SOURCE_BT(peer);
+        case TRANSPORT_UDP:
+            return SOURCE_UDP(peer);
+        default:
+            return SOURCE_UART;
+    }
+}
+
+void packet_set_source(uint8_t source_transport, uint8_t peer, uint32_t timestamp_us) {
+    transport = source_transport;
+    source = source_number(source_transport, peer);
+    arrival_us = timestamp_us;
+}
+
+static bool sof_aligned = false;
+
+void packet_set_sof_aligned(bool enabled) {
+    sof_aligned = enabled;
+}
+
+static bool reenumerating = false;
+static uint32_t disconnected_at_us;
+
+// Reports for another device than the one the host sees: drop off the bus
+// and come back with the new descriptors, which the descriptor callbacks
+// return from now on. Whatever is still queued for the old device is lost.
+static void start_reenumeration(uint8_t descriptor_number) {
+    tud_disconnect();
+    usb_descriptor_number = descriptor_number;
+    report_queue_clear();
+    reenumerating = true;
+    disconnected_at_us = time_us_32();
+}
+
+static void reenumerate_task() {
+    if (reenumerating && (time_us_32() - disconnected_at_us >= REENUMERATE_DISCONNECT_US)) {
+        reenumerating = false;
+        tud_connect();
+    }
+}
+
+// The HID interface reports for a device go out on. In composite mode every
+// supported device has its own, otherwise there is just the one.
+static uint8_t report_instance(uint8_t descriptor_number) {
+    if (!composite_mode) {
+        return 0;
+    }
+    for (uint8_t instance = 0; instance < NINSTANCES; instance++) {
+        if (composite_descriptors[instance] == descriptor_number) {
+            return instance;
+        }
+    }
+    return NO_DESCRIPTOR;
+}
+
+// Takes over the reference to the report.
+static void submit_report(uint8_t instance, uint8_t descriptor_number, uint8_t report_id, const report_ref_t* report, uint32_t report_arrival_us, uint8_t report_transport) {
+    if (!composite_mode && (descriptor_number != usb_descriptor_number)) {
+        start_reenumeration(descriptor_number);
+    }
+    if (!sof_aligned && !reenumerating && report_queue_empty(instance) && tud_hid_n_ready(instance) &&
+        tud_hid_n_report(instance, report_id, report->data, report->len)) {
+        report_queue_sent(instance, descriptor_number, report_id, report);
+        latency_report_sent(instance, report_arrival_us);
+    } else if (!report_queue_push(instance, descriptor_number, report_id, report, report_arrival_us)) {
+        usb_queue_drops[report_transport]++;
+    }
+}
+
+static void drain_usb_reports() {
+#ifdef DUAL_CORE
+    usb_report_t* report;
+    while ((report = spsc_front(&usb_reports)) != NULL) {
+        submit_report(report->instance, report->our_descriptor_number, report->report_id, &report->report, report->arrival_us, report->transport);
+        spsc_release(&usb_reports);
+    }
+#endif
+}
+
+static void send_queued_report(uint8_t instance) {
+    uint8_t report_id;
+    const uint8_t* data;
+    uint8_t len;
+    uint32_t report_arrival_us;
+
+    if (!reenumerating && tud_hid_n_ready(instance) && report_queue_peek(instance, &report_id, &data, &len, &report_arrival_us)) {
+        if (tud_hid_n_report(instance, report_id, data, len)) {
+            report_queue_pop(instance);
+            latency_report_sent(instance, report_arrival_us);
+        }
+    }
+}
+
+static void send_queued_reports() {
+    for (uint8_t instance = 0; instance < NINSTANCES; instance++) {
+        if (instance != CONFIG_INSTANCE) {
+            send_queued_report(instance);
+        }
+    }
+}
+
+void outgoing_reports_task() {
+    reenumerate_task();
+    drain_usb_reports();
+    if (!sof_aligned) {
+        send_queued_reports();
+    }
+}
+
+void tud_sof_cb(uint32_t frame_count) {
+    latency_sof(time_us_32());
+    if (sof_aligned) {
+        drain_usb_reports();
+        send_queued_reports();
+    }
+}
+
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len) {
+    if ((instance == CONFIG_INSTANCE) || (instance >= NINSTANCES)) {
+        return;
+    }
+    latency_report_complete(instance);
+    report_queue_complete(instance);
+    // Refill the endpoint right away, without waiting for the main loop or
+    // the next SOF. In SOF aligned mode only if the next report can't get
+    // any fresher by waiting.
+    drain_usb_reports();
+    if (!sof_aligned || report_queue_peek_final(instance)) {
+        send_queued_report(instance);
+    }
+}
+
+static void dispatch_gamepad_report(const uint8_t* data);
+
+// The report's bytes are in buffer, or in memory of its own with NO_BUFFER,
+// in which case they're copied into the pool.
+static void dispatch_report(uint8_t descriptor_number, uint8_t report_id, const uint8_t* data, uint8_t len, uint8_t buffer) {
+    if (descriptor_number == GAMEPAD_DESCRIPTOR) {
+        dispatch_gamepad_report(data);
+        return;
+    }
+    const uint8_t* merged = merge_report(source, descriptor_number, report_id, data, len, packet_arrival_us);
+    if (merged != data) {
+        data = merged;
+        buffer = NO_BUFFER;
+    }
+    uint8_t instance = report_instance(descriptor_number);
+    if (!composite_mode && (descriptor_number != our_descriptor_number)) {
+        rx_stats[transport].descriptor_switches++;
+        switch_our_descriptor(descriptor_number);
+    }
+#ifdef DUAL_CORE
+    usb_report_t* report = spsc_alloc(&usb_reports);
+    if (report == NULL) {
+        printf("overflow!\n");
+        rx_stats[transport].queue_drops++;
+        return;
+    }
+    report->arrival_us = packet_arrival_us;
+    report->transport = transport;
+    report->instance = instance;
+    report->our_descriptor_number = descriptor_number;
+    report->report_id = report_id;
+    if (!report_pool_hold(&report->report, data, len, buffer)) {
+        printf("overflow!\n");
+        rx_stats[transport].queue_drops++;
+        return;
+    }
+    spsc_commit(&usb_reports);
+#else
+    report_ref_t report;
+    if (!report_pool_hold(&report, data, len, buffer)) {
+        printf("overflow!\n");
+        rx_stats[transport].queue_drops++;
+        return;
+    }
+    submit_report(instance, descriptor_number, report_id, &report, packet_arrival_us, transport);
+#endif
+}
+
+// The emulated gamepad canonical reports are packed for: the device the
+// receiver emulates if it's a gamepad, otherwise DEFAULT_GAMEPAD_DESCRIPTOR.
+// In composite mode the gamepad that has an interface.
+static const gamepad_layout_t* gamepad_target() {
+    if (composite_mode) {
+        for (uint8_t instance = 0; instance < NINSTANCES; instance++) {
+            const gamepad_layout_t* layout = gamepad_layout(composite_descriptors[instance]);
+            if (layout != NULL) {
+                return layout;
+            }
+        }
+        return NULL;
+    }
+    const gamepad_layout_t* layout = gamepad_layout(our_descriptor_number);
+    return (layout != NULL) ? layout : gamepad_layout(DEFAULT_GAMEPAD_DESCRIPTOR);
+}
+
+// Packs a canonical gamepad report straight into a pool buffer.
+static void dispatch_gamepad_report(const uint8_t* data) {
+    const gamepad_layout_t* layout = gamepad_target();
+    uint8_t buffer = report_pool_alloc();
+    if (buffer == NO_BUFFER) {
+        printf("overflow!\n");
+        rx_stats[transport].queue_drops++;
+        return;
+    }
+    uint8_t* report = report_pool_data(buffer);
+    gamepad_pack(layout, data, report);
+    dispatch_report(layout->our_descriptor_number, layout->report_id, report, layout->len, buffer);
+    report_pool_unref(buffer);
+}
+
+// In composite mode, devices that don't have an interface of their own
+// can't be forwarded.
+static bool report_valid(uint8_t descriptor_number, uint8_t report_id, uint16_t len) {
+    if (descriptor_number == GAMEPAD_DESCRIPTOR) {
+        return (report_id == GAMEPAD_REPORT_ID) && (len == GAMEPAD_REPORT_SIZE) && (gamepad_target() != NULL);
+    }
+    return (len <= 64) &&
+           (descriptor_number < NOUR_DESCRIPTORS) &&
+           (report_instance(descriptor_number) != NO_DESCRIPTOR) &&
+           !((report_id == 0) && (len >= 64));
+}
+
+static void handle_delta_packet(const uint8_t* data, uint16_t len) {
+    if (len < sizeof(delta_packet_t)) {
+        printf("packet to small\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    delta_packet_t* msg = (delta_packet_t*) data;
+    if (!report_valid(msg->our_descriptor_number, msg->report_id, msg->len)) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    const uint8_t* report = delta_decode(source, msg->our_descriptor_number, msg->report_id, msg->len,
+                                         msg->seq, msg->flags, msg->data, len - sizeof(delta_packet_t));
+    if (report == NULL) {
+        printf("waiting for keyframe\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    dispatch_report(msg->our_descriptor_number, msg->report_id, report, msg->len, NO_BUFFER);
+}
+
+// All records are validated before any of them is dispatched, so a
+// malformed batch is dropped whole. With DUAL_CORE so is a batch the ring
+// to core 1 doesn't have room for. Past that each record is dispatched on
+// its own and can still be dropped (and counted in queue_drops) when the
+// pool runs out of buffers or the report queue is full, so a batch that
+// arrives while they are can be forwarded in part.
+static void handle_batch_packet(const uint8_t* data, uint16_t len) {
+    batch_packet_t* msg = (batch_packet_t*) data;
+    if ((msg->count == 0) || (msg->count > BATCH_MAX_RECORDS)) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    uint16_t pos = sizeof(batch_packet_t);
+    for (int i = 0; i < msg->count; i++) {
+        if (pos + sizeof(batch_record_t) > len) {
+            printf("ignoring packet\n");
+            rx_stats[transport].invalid_packets++;
+            return;
+        }
+        batch_record_t* record = (batch_record_t*) (data + pos);
+        pos += sizeof(batch_record_t) + record->len;
+        if ((pos > len) || !report_valid(msg->our_descriptor_number, record->report_id, record->len)) {
+            printf("ignoring packet\n");
+            rx_stats[transport].invalid_packets++;
+            return;
+        }
+    }
+    if (pos != len) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+#ifdef DUAL_CORE
+    if (spsc_free(&usb_reports) < msg->count) {
+        printf("overflow!\n");
+        rx_stats[transport].queue_drops += msg->count;
+        return;
+    }
+#endif
+
+    pos = sizeof(batch_packet_t);
+    for (int i = 0; i < msg->count; i++) {
+        batch_record_t* record = (batch_record_t*) (data + pos);
+        dispatch_report(msg->our_descriptor_number, record->report_id, record->data, record->len, packet_buffer);
+        pos += sizeof(batch_record_t) + record->len;
+    }
+}
+
+static void handle_packet(const uint8_t* data, uint16_t len, uint32_t timestamp_us);
+
+static void handle_sequenced_packet(const uint8_t* data, uint16_t len) {
+    if (len < sizeof(sequenced_packet_t)) {
+        printf("packet to small\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    sequenced_packet_t* msg = (sequenced_packet_t*) data;
+    const uint8_t* records[SEQUENCED_MAX_RECORDS];
+    uint16_t lens[SEQUENCED_MAX_RECORDS];
+    if ((msg->count == 0) || (msg->count > SEQUENCED_MAX_RECORDS)) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    uint16_t pos = sizeof(sequenced_packet_t);
+    for (int i = 0; i < msg->count; i++) {
+        if (pos + sizeof(sequenced_record_t) > len) {
+            printf("ignoring packet\n");
+            rx_stats[transport].invalid_packets++;
+            return;
+        }
+        sequenced_record_t* record = (sequenced_record_t*) (data + pos);
+        pos += sizeof(sequenced_record_t) + record->len;
+        if ((pos > len) || (record->len == 0) || (record->data[0] == PROTOCOL_VERSION_SEQUENCED)) {
+            printf("ignoring packet\n");
+            rx_stats[transport].invalid_packets++;
+            return;
+        }
+        records[i] = record->data;
+        lens[i] = record->len;
+    }
+    if (pos != len) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+
+    uint8_t fresh = sequence_check(source, transport, msg->seq, msg->timestamp_us, packet_arrival_us, msg->count);
+    uint32_t arrival = packet_arrival_us;
+    for (int i = fresh - 1; i >= 0; i--) {
+        handle_packet(records[i], lens[i], arrival);
+    }
+}
+
+static void handle_packet(const uint8_t* data, uint16_t len, uint32_t timestamp_us) {
+    packet_arrival_us = timestamp_us;
+    if (len < sizeof(packet_t)) {
+        printf("packet to small\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    packet_t* msg = (packet_t*) data;
+    if (msg->protocol_version == PROTOCOL_VERSION_DELTA) {
+        handle_delta_packet(data, len);
+        return;
+    }
+    if (msg->protocol_version == PROTOCOL_VERSION_BATCH) {
+        handle_batch_packet(data, len);
+        return;
+    }
+    if (msg->protocol_version == PROTOCOL_VERSION_SEQUENCED) {
+        handle_sequenced_packet(data, len);
+        return;
+    }
+    if (msg->protocol_version == PROTOCOL_VERSION_LINK) {
+        // Only the UART's speed can be negotiated.
+        if (transport == TRANSPORT_UART) {
+            link_handle_packet(data, len);
+        } else {
+            rx_stats[transport].invalid_packets++;
+        }
+        return;
+    }
+    len = len - sizeof(packet_t);
+    if ((msg->protocol_version != PROTOCOL_VERSION) ||
+        (msg->len != len) ||
+        !report_valid(msg->our_descriptor_number, msg->report_id, len)) {
+        printf("ignoring packet\n");
+        rx_stats[transport].invalid_packets++;
+        return;
+    }
+    dispatch_report(msg->our_descriptor_number, msg->report_id, msg->data, len, packet_buffer);
+}
+
+// Datagrams aren't in pool buffers, the reports in them are copied out
+// before the pbuf is freed. Holding on to pbufs instead would starve
+// lwIP's receive pool while the host is slow to read.
+void handle_received_packet(const uint8_t* data, uint16_t len) {
+    rx_stats[transport].packets++;
+    rx_stats[transport].bytes += len;
+    packet_buffer = NO_BUFFER;
+    handle_packet(data, len, arrival_us);
+}
+
+// Only serial and Bluetooth data is SLIP encoded, and their sources come
+// first.
+#define SLIP_SOURCES (1 + BT_MAX_PEERS)
+
+typedef struct {
+    // Frames are decoded straight into a pool buffer, so the reports in
+    // them are queued without being copied. NULL until the first byte of
+    // a frame arrives. A frame that outgrows the pool buffer is moved to
+    // long_frame, and its reports are copied into the pool when they're
+    // dispatched, the same as when the pool had no buffer to spare.
+    uint8_t* frame;
+    uint16_t capacity;
+    uint8_t pool_buffer;
+    uint8_t long_frame[SERIAL_MAX_PACKET_SIZE];
+    uint16_t bytes_read;
+    // The CRC is computed as the frame comes in, over the first crc_len
+    // bytes of frame. It trails bytes_read by the 4 bytes that may turn
+    // out to be the CRC itself.
+    uint16_t crc_len;
+    uint32_t crc;
+    bool escaped;
+    // Set when a frame didn't fit in long_frame, the rest of it is skipped.
+    bool discarding;
+    // When the first byte of the frame being decoded arrived.
+    uint32_t frame_start_us;
+} slip_decoder_t;
+
+static slip_decoder_t decoders[SLIP_SOURCES];
+
+// Bytes the CRC is allowed to fall behind by, so it isn't updated in
+// pieces too small for the table lookups to pay off.
+#define CRC_MIN_STEP 32
+
+static void start_frame(slip_decoder_t* d) {
+    d->bytes_read = 0;
+    d->crc_len = 0;
+    d->crc = 0;
+    d->frame_start_us = arrival_us;
+}
+
+static void get_frame_buffer(slip_decoder_t* d) {
+    d->pool_buffer = report_pool_alloc();
+    if (d->pool_buffer != NO_BUFFER) {
+        d->frame = report_pool_data(d->pool_buffer);
+        d->capacity = REPORT_POOL_BUFFER_SIZE;
+    } else {
+        d->frame = d->long_frame;
+        d->capacity = SERIAL_MAX_PACKET_SIZE;
+    }
+}
+
+// Lets go of the pool buffer, if the frame is in one.
+static void put_frame_buffer(slip_decoder_t* d) {
+    report_pool_unref(d->pool_buffer);
+    d->pool_buffer = NO_BUFFER;
+    d->frame = NULL;
+}
+
+// Moves a frame that doesn't fit in the pool buffer to long_frame. Returns
+// false if it's there already.
+static bool grow_frame(slip_decoder_t* d) {
+    if (d->frame == d->long_frame) {
+        return false;
+    }
+    memcpy(d->long_frame, d->frame, d->bytes_read);
+    report_pool_bytes_copied += d->bytes_read;
+    put_frame_buffer(d);
+    d->frame = d->long_frame;
+    d->capacity = SERIAL_MAX_PACKET_SIZE;
+    return true;
+}
+
+static void frame_too_long(slip_decoder_t* d) {
+    printf("packet too long\n");
+    rx_stats[transport].framing_errors++;
+    d->discarding = true;
+}
+
+// Brings the CRC up to all but the last 4 bytes read.
+static void update_crc(slip_decoder_t* d) {
+    d->crc = crc32_update(d->crc, d->frame + d->crc_len, d->bytes_read - 4 - d->crc_len);
+    d->crc_len = d->bytes_read - 4;
+}
+
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+#define HAS_ZERO_BYTE(x) (((x) - ONES) & ~(x) & HIGHS)
+
+// Copies bytes into the frame up to the next END or ESC, checking and
+// copying a word at a time. Returns how many were copied, which is less
+// than there were if the frame is full.
+static uint16_t copy_run(slip_decoder_t* d, const uint8_t* data, uint16_t len) {
+    uint16_t room = d->capacity - d->bytes_read;
+    if (len > room) {
+        len = room;
+    }
+    uint8_t* dst = d->frame + d->bytes_read;
+    uint16_t i = 0;
+    while (i + 4 <= len) {
+        uint32_t w;
+        memcpy(&w, data + i, 4);
+        if (HAS_ZERO_BYTE(w ^ (END * ONES)) || HAS_ZERO_BYTE(w ^ (ESC * ONES))) {
+            break;
+        }
+        memcpy(dst + i, &w, 4);
+        i += 4;
+    }
+    while ((i < len) && (data[i] != END) && (data[i] != ESC)) {
+        dst[i] = data[i];
+        i++;
+    }
+    d->bytes_read += i;
+    return i;
+}
+
+// The byte after an ESC.
+static void append_escaped(slip_decoder_t* d, uint8_t c) {
+    switch (c) {
+        case ESC_END:
+            c = END;
+            break;
+        case ESC_ESC:
+            c = ESC;
+            break;
+        default:
+            // this shouldn't happen
+            rx_stats[transport].framing_errors++;
+            break;
+    }
+    if ((d->bytes_read == d->capacity) && !grow_frame(d)) {
+        frame_too_long(d);
+        return;
+    }
+    d->frame[d->bytes_read++] = c;
+}
+
+static void end_frame(slip_decoder_t* d) {
+    if (d->bytes_read > 4) {
+        update_crc(d);
+        uint32_t received_crc = 0;
+        for (int i = 0; i < 4; i++) {
+            received_crc = (received_crc << 8) | d->frame[d->bytes_read - 1 - i];
+        }
+        if (d->crc == received_crc) {
+            rx_stats[transport].packets++;
+            packet_buffer = d->pool_buffer;
+            handle_packet(d->frame, d->bytes_read - 4, d->frame_start_us);
+            packet_buffer = NO_BUFFER;
+        } else {
+            printf("CRC error\n");
+            rx_stats[transport].crc_errors++;
+        }
+    } else if (d->bytes_read > 0) {
+        rx_stats[transport].framing_errors++;
+    }
+    // The buffer is reused for the next frame unless reports in it are
+    // still queued. A long frame gets a pool buffer again next time.
+    if (report_pool_shared(d->pool_buffer) || (d->frame == d->long_frame)) {
+        put_frame_buffer(d);
+    }
+    start_frame(d);
+}
+
+// Decodes a whole chunk at once: runs of plain bytes are copied in bulk
+// and the CRC follows along, so a frame is ready to be handled as soon as
+// its END arrives.
+void serial_read_bytes(const uint8_t* data, uint16_t len) {
+    if (source >= SLIP_SOURCES) {
+        return;
+    }
+    slip_decoder_t* d = &decoders[source];
+    rx_stats[transport].bytes += len;
+
+    if ((d->bytes_read == 0) && !d->escaped) {
+        d->frame_start_us = arrival_us;
+    }
+
+    const uint8_t* end = data + len;
+    while (data < end) {
+        if (d->discarding) {
+            const uint8_t* p = memchr(data, END, end - data);
+            if (p == NULL) {
+                return;
+            }
+            d->discarding = false;
+            d->escaped = false;
+            put_frame_buffer(d);
+            start_frame(d);
+            data = p + 1;
+            continue;
+        }
+
+        if (d->frame == NULL) {
+            get_frame_buffer(d);
+        }
+
+        if (d->escaped) {
+            d->escaped = false;
+            append_escaped(d, *data++);
+            continue;
+        }
+
+        uint16_t n = copy_run(d, data, end - data);
+        data += n;
+        if (d->bytes_read >= d->crc_len + 4 + CRC_MIN_STEP) {
+            update_crc(d);
+        }
+        if (data == end) {
+            break;
+        }
+        if (*data == END) {
+            data++;
+            end_frame(d);
+        } else if (*data != ESC) {
+            if (!grow_frame(d)) {
+                frame_too_long(d);
+            }
+        } else if (data + 1 < end) {
+            append_escaped(d, data[1]);
+            data += 2;
+        } else {
+            d->escaped = true;
+            data++;
+        }
+    }
+}
+
+void serial_read_byte(uint8_t c) {
+    serial_read_bytes(&c, 1);
+}
+
+void packet_forget_source(uint8_t source_transport, uint8_t peer) {
+    uint8_t s = source_number(source_transport, peer);
+    if (s < SLIP_SOURCES) {
+        put_frame_buffer(&decoders[s]);
+        memset(&decoders[s], 0, sizeof(slip_decoder_t));
+    }
+    delta_forget_source(s);
+    sequence_forget_source(s);
+    merge_forget_source(s);
+}
@@ -0,0 +1,37 @@
+#ifndef _PACKET_H_
+#define _PACKET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every sender gets its own decoder state, so several of them can be
+// active at once: the UART, each Bluetooth connection and each UDP peer.
+#define BT_MAX_PEERS 2
+#define NET_MAX_PEERS 4
+#define SOURCE_UART 0
+#define SOURCE_BT(peer) (1 + (peer))
+#define SOURCE_UDP(peer) (1 + BT_MAX_PEERS + (peer))
+#define NSOURCES (1 + BT_MAX_PEERS + NET_MAX_PEERS)
+
+// Transport (TRANSPORT_*), which of its peers and arrival time
+// (time_us_32()) of the data passed to the functions below until the
+// next call.
+void packet_set_source(uint8_t transport, uint8_t peer, uint32_t timestamp_us);
+// Drops everything remembered about a peer that went away, or whose slot
+// goes to a new one: a half received frame, delta and sequence state and
+// what it contributes to merged reports.
+void packet_forget_source(uint8_t transport, uint8_t peer);
+
+void handle_received_packet(const uint8_t* data, uint16_t len);
+// Feeds a chunk of a SLIP encoded stream (UART or Bluetooth), as it came
+// in: a DMA buffer, an RFCOMM packet. Frames may span several calls.
+void serial_read_bytes(const uint8_t* data, uint16_t len);
+// The same for a single byte.
+void serial_read_byte(uint8_t c);
+void outgoing_reports_task();
+
+// In SOF aligned mode reports are held back and merged until the start of
+// the next USB frame, so the host gets the freshest state when it polls.
+void packet_set_sof_aligned(bool enabled);
+
+#endif
@@ -7,14 +7,14 @@
 
 #include "hardware/flash.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
-#include "hardware/watchdog.h"
 
 #include "pico/stdio.h"
 
-#ifdef NETWORK_ENABLED
-#include "lwip/pbuf.h"
-#include "lwip/udp.h"
+#ifdef DUAL_CORE
+#include "pico/flash.h"
+#include "pico/multicore.h"
 #endif
 
 #if (defined(NETWORK_ENABLED) || defined(BLUETOOTH_ENABLED))
@@ -24,32 +24,51 @@
 #include "receiver.h"
 
 #include "bt.h"
+#include "config_store.h"
 #include "crc.h"
 #include "descriptors.h"
 #include "globals.h"
-
-#define PERSISTED_CONFIG_SIZE 4096
-#define CONFIG_OFFSET_IN_FLASH (PICO_FLASH_SIZE_BYTES - 16384)
-#define FLASH_CONFIG_IN_MEMORY (((uint8_t*) XIP_BASE) + CONFIG_OFFSET_IN_FLASH)
-
-#ifdef NETWORK_ENABLED
-#define OUR_PORT 42734
-#endif
+#include "latency.h"
+#include "link.h"
+#include "merge.h"
+#include "net.h"
+#include "packet.h"
+#include "spsc.h"
+#include "stats.h"
+#include "uart_rx.h"
+
+// The config log sits right below the two sectors BTstack keeps its link
+// keys in. Older firmware kept a single config_t in the third of its
+// sectors, which is picked up if the log is empty.
+#define CONFIG_STORE_OFFSET_IN_FLASH (PICO_FLASH_SIZE_BYTES - 2 * FLASH_SECTOR_SIZE - CONFIG_STORE_SIZE)
+#define FLASH_CONFIG_STORE_IN_MEMORY (((uint8_t*) XIP_BASE) + CONFIG_STORE_OFFSET_IN_FLASH)
+#define LEGACY_CONFIG_OFFSET_IN_FLASH (PICO_FLASH_SIZE_BYTES - 16384)
+#define LEGACY_FLASH_CONFIG_IN_MEMORY (((uint8_t*) XIP_BASE) + LEGACY_CONFIG_OFFSET_IN_FLASH)
 
 #define CONFIG_VERSION 2
-#define PROTOCOL_VERSION 1
 
 #define SERIAL_UART uart1
 #define SERIAL_BAUDRATE 921600
 #define SERIAL_TX_PIN 4
 #define SERIAL_RX_PIN 5
-#define SERIAL_MAX_PACKET_SIZE 512
 
 #define COMMAND_PAIR_NEW_DEVICE 1
 #define COMMAND_FORGET_ALL_DEVICES 2
+#define COMMAND_RESET_LATENCY_HISTOGRAM 3
+
+// A descriptor switch is written to flash once the device type has stayed
+// the same for this long, so alternating between profiles doesn't stall
+// for a flash write (or wear it) every time.
+#define PERSIST_DESCRIPTOR_DELAY_US 10000000
+
+// Erasing a sector of the config log stalls everything for tens of
+// milliseconds, so it waits until no packets arrived for this long.
+#define CONFIG_ERASE_IDLE_US 1000000
 
 #define BLUETOOTH_ENABLED_FLAG_MASK (1 << 0)
 #define WIFI_ENABLED_FLAG_MASK (1 << 1)
+#define SOF_ALIGNED_FLAG_MASK (1 << 2)
+#define COMPOSITE_FLAG_MASK (1 << 3)
 
 typedef struct __attribute__((packed)) {
     uint8_t config_version;
@@ -57,11 +76,14 @@ typedef struct __attribute__((packed)) {
     char wifi_ssid[20];
     char wifi_password[24];
     uint8_t flags;
-    uint8_t reserved[12];
+    uint8_t merge_policy;  // MERGE_POLICY_*
+    uint8_t reserved[11];
     uint32_t crc;
 } config_t;
 
 _Static_assert(sizeof(config_t) == 63);
+_Static_assert(sizeof(config_t) <= CONFIG_STORE_MAX_DATA);
+_Static_assert((CONFIG_STORE_SECTOR_SIZE == FLASH_SECTOR_SIZE) && (CONFIG_STORE_PAGE_SIZE == FLASH_PAGE_SIZE));
 
 typedef struct __attribute__((packed)) {
     uint8_t config_version;
@@ -73,27 +95,54 @@ typedef struct __attribute__((packed)) {
 _Static_assert(sizeof(command_t) == 63);
 
 typedef struct __attribute__((packed)) {
-    uint8_t protocol_version;
-    uint8_t our_descriptor_number;
-    uint8_t len;
-    uint8_t report_id;
-    uint8_t data[0];
-} packet_t;
+    uint8_t config_version;
+    uint8_t nbuckets;
+    uint8_t reserved;
+    uint32_t samples;
+    uint32_t max_us;
+    uint32_t mean_us;
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint32_t crc;
+} latency_report_t;
 
-typedef struct {
-    uint8_t report_id;
-    uint8_t len;
-    uint8_t data[64];
-} outgoing_report_t;
+_Static_assert(sizeof(latency_report_t) == 63);
 
-#ifdef NETWORK_ENABLED
+typedef struct __attribute__((packed)) {
+    uint8_t config_version;
+    uint8_t transport;
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t crc_errors;
+    uint32_t framing_errors;
+    uint32_t invalid_packets;
+    uint32_t queue_drops;
+    uint32_t uart_overruns;
+    uint32_t descriptor_switches;
+    uint32_t uptime_ms;
+    uint32_t late_packets;
+    uint32_t recovered_packets;
+    uint8_t reserved[13];
+    uint32_t crc;
+} stats_report_t;
 
-struct udp_pcb* pcb;
-ip_addr_t server_address;
+_Static_assert(sizeof(stats_report_t) == 63);
 
-bool wifi_connected = false;
+typedef struct __attribute__((packed)) {
+    uint8_t config_version;
+    uint8_t nbuckets;
+    uint8_t sof_aligned;
+    uint32_t sofs;
+    uint16_t arrival[FRAME_PHASE_BUCKETS];
+    uint16_t complete[FRAME_PHASE_BUCKETS];
+    uint8_t reserved[20];
+    uint32_t crc;
+} frame_phase_report_t;
 
-#endif
+_Static_assert(sizeof(frame_phase_report_t) == 63);
+
+// Which transport's counters a GET_REPORT for REPORT_ID_STATS returns,
+// chosen with a SET_REPORT.
+static uint8_t stats_transport = TRANSPORT_UART;
 
 config_t config = {
     .config_version = CONFIG_VERSION,
@@ -101,159 +150,163 @@ config_t config = {
     .wifi_ssid = "",
     .wifi_password = "",
     .flags = BLUETOOTH_ENABLED_FLAG_MASK,  // Bluetooth enabled by default, WiFi disabled
+    .merge_policy = MERGE_POLICY_LATEST,
     .reserved = { 0 },
     .crc = 0,
 };
 
-#define OR_BUFSIZE 8
-outgoing_report_t outgoing_reports[OR_BUFSIZE];
-uint8_t or_head = 0;
-uint8_t or_tail = 0;
-uint8_t or_items = 0;
+#ifdef DUAL_CORE
+// Things the USB core asks the transport core to do, because they touch
+// BTstack, write to flash or change the config, which core 0 reads
+// without any locking.
+#define CORE0_REQUEST_SET_CONFIG 0
+#define CORE0_REQUEST_COMMAND 1
 
-void queue_outgoing_report(uint8_t report_id, uint8_t* data, uint8_t len) {
-    if (or_items == OR_BUFSIZE) {
-        printf("overflow!\n");
-        return;
-    }
-    outgoing_reports[or_tail].report_id = report_id;
-    outgoing_reports[or_tail].len = len;
-    memcpy(outgoing_reports[or_tail].data, data, len);
-    or_tail = (or_tail + 1) % OR_BUFSIZE;
-    or_items++;
-}
+typedef struct {
+    uint8_t request;
+    uint8_t command;
+    config_t config;
+} core0_request_t;
+
+#define CORE0_REQUESTS_CAPACITY 8
+core0_request_t core0_requests_buffer[CORE0_REQUESTS_CAPACITY];
+spsc_t core0_requests;
+
+// Core 1 still reads the config itself, to answer the configuration tool,
+// so core 0 takes this lock around every change and core 1 around its copy.
+// Never held across a flash write: flash_safe_execute() has to pause core 1,
+// which can't happen while it spins here with interrupts off.
+static spin_lock_t* config_lock;
+#endif
 
-void persist_config() {
-    static uint8_t buffer[PERSISTED_CONFIG_SIZE];
+static uint32_t lock_config() {
+#ifdef DUAL_CORE
+    return spin_lock_blocking(config_lock);
+#else
+    return 0;
+#endif
+}
 
-    config.crc = crc32((uint8_t*) &config, sizeof(config_t) - 4);
-    memset(buffer, 0, sizeof(buffer));
-    memcpy(buffer, &config, sizeof(config_t));
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_erase(CONFIG_OFFSET_IN_FLASH, PERSISTED_CONFIG_SIZE);
-    flash_range_program(CONFIG_OFFSET_IN_FLASH, buffer, PERSISTED_CONFIG_SIZE);
-    restore_interrupts(ints);
+static void unlock_config(uint32_t saved_irq) {
+#ifdef DUAL_CORE
+    spin_unlock(config_lock, saved_irq);
+#else
+    (void) saved_irq;
+#endif
 }
 
-void handle_received_packet(const uint8_t* data, uint16_t len) {
-    if (len < sizeof(packet_t)) {
-        printf("packet to small\n");
-        return;
-    }
-    packet_t* msg = (packet_t*) data;
-    len = len - sizeof(packet_t);
-    if ((msg->protocol_version != PROTOCOL_VERSION) ||
-        (msg->len != len) ||
-        (len > 64) ||
-        (msg->our_descriptor_number >= NOUR_DESCRIPTORS) ||
-        ((msg->report_id == 0) && (len >= 64))) {
-        printf("ignoring packet\n");
-        return;
-    }
-    if (msg->our_descriptor_number != our_descriptor_number) {
-        config.our_descriptor_number = msg->our_descriptor_number;
-        persist_config();
-        watchdog_reboot(0, 0, 0);
-    }
-    if (tud_hid_n_ready(0)) {
-        tud_hid_n_report(0, msg->report_id, msg->data, len);
+typedef struct {
+    uint32_t offset;
+    const uint8_t* page;  // NULL to erase the sector at offset
+} flash_op_t;
+
+static void flash_op_unsafe(void* param) {
+    flash_op_t* op = param;
+    if (op->page == NULL) {
+        flash_range_erase(CONFIG_STORE_OFFSET_IN_FLASH + op->offset, FLASH_SECTOR_SIZE);
     } else {
-        queue_outgoing_report(msg->report_id, msg->data, len);
+        flash_range_program(CONFIG_STORE_OFFSET_IN_FLASH + op->offset, op->page, FLASH_PAGE_SIZE);
     }
 }
 
-void serial_init() {
-    uart_init(SERIAL_UART, SERIAL_BAUDRATE);
-    uart_set_translate_crlf(SERIAL_UART, false);
-    gpio_set_function(SERIAL_TX_PIN, GPIO_FUNC_UART);
-    gpio_set_function(SERIAL_RX_PIN, GPIO_FUNC_UART);
+static void run_flash_op(flash_op_t* op) {
+#ifdef DUAL_CORE
+    // Core 1 runs from flash too, so it has to be paused for the write.
+    if (flash_safe_execute(flash_op_unsafe, op, UINT32_MAX) != PICO_OK) {
+        printf("flash write failed\n");
+    }
+#else
+    uint32_t ints = save_and_disable_interrupts();
+    flash_op_unsafe(op);
+    restore_interrupts(ints);
+#endif
 }
 
-#define END 0300     /* indicates end of packet */
-#define ESC 0333     /* indicates byte stuffing */
-#define ESC_END 0334 /* ESC ESC_END means END data byte */
-#define ESC_ESC 0335 /* ESC ESC_ESC means ESC data byte */
+static void config_flash_erase_sector(uint32_t offset) {
+    flash_op_t op = { offset, NULL };
+    run_flash_op(&op);
+}
 
-void serial_read_byte(uint8_t c, uint8_t port) {
-    static uint8_t buffer[2][SERIAL_MAX_PACKET_SIZE];
-    static uint16_t bytes_read[2] = { 0, 0 };
-    static bool escaped[2] = { false, false };
+static void config_flash_program_page(uint32_t offset, const uint8_t* page) {
+    flash_op_t op = { offset, page };
+    run_flash_op(&op);
+}
 
-    bytes_read[port] %= sizeof(buffer);
+static const config_store_flash_t config_flash = {
+    .contents = FLASH_CONFIG_STORE_IN_MEMORY,
+    .erase_sector = config_flash_erase_sector,
+    .program_page = config_flash_program_page,
+};
 
-    if (escaped[port]) {
-        switch (c) {
-            case ESC_END:
-                buffer[port][bytes_read[port]++] = END;
-                break;
-            case ESC_ESC:
-                buffer[port][bytes_read[port]++] = ESC;
-                break;
-            default:
-                // this shouldn't happen
-                buffer[port][bytes_read[port]++] = c;
-                break;
-        }
-        escaped[port] = false;
-    } else {
-        switch (c) {
-            case END:
-                if (bytes_read[port] > 4) {
-                    uint32_t crc = crc32(buffer[port], bytes_read[port] - 4);
-                    uint32_t received_crc = 0;
-                    for (int i = 0; i < 4; i++) {
-                        received_crc = (received_crc << 8) | buffer[port][bytes_read[port] - 1 - i];
-                    }
-                    if (crc == received_crc) {
-                        handle_received_packet(buffer[port], bytes_read[port] - 4);
-                        bytes_read[port] = 0;
-                        return;
-                    } else {
-                        printf("CRC error\n");
-                    }
-                }
-                bytes_read[port] = 0;
-                break;
-            case ESC:
-                escaped[port] = true;
-                break;
-            default:
-                buffer[port][bytes_read[port]++] = c;
-                break;
-        }
-    }
-}
+static bool persist_pending = false;
+static uint32_t persist_requested_at_us;
 
-void serial_task() {
-    while (uart_is_readable(SERIAL_UART)) {
-        char c = uart_getc(SERIAL_UART);
-        serial_read_byte(c, 0);
+void persist_config() {
+    persist_pending = false;
+    uint32_t crc = crc32((uint8_t*) &config, sizeof(config_t) - 4);
+    uint32_t saved_irq = lock_config();
+    config.crc = crc;
+    unlock_config(saved_irq);
+    if (!config_store_write(&config, sizeof(config_t))) {
+        printf("flash write failed\n");
     }
 }
 
-#ifdef NETWORK_ENABLED
-
-void net_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
-    handle_received_packet(p->payload, p->len);
-    pbuf_free(p);
+// The USB side re-enumerates when it gets the first report for the new
+// descriptor, the radios and everything else keep running.
+void switch_our_descriptor(uint8_t descriptor_number) {
+    our_descriptor_number = descriptor_number;
+    uint32_t saved_irq = lock_config();
+    config.our_descriptor_number = descriptor_number;
+    unlock_config(saved_irq);
+    persist_pending = true;
+    persist_requested_at_us = time_us_32();
 }
 
-void net_init() {
-    cyw43_arch_enable_sta_mode();
-    if (strlen(config.wifi_ssid) > 0) {
-        cyw43_arch_wifi_connect_async(config.wifi_ssid, config.wifi_password, CYW43_AUTH_WPA2_AES_PSK);
+static void deferred_persist_task() {
+    if (persist_pending && (time_us_32() - persist_requested_at_us >= PERSIST_DESCRIPTOR_DELAY_US)) {
+        persist_config();
     }
+}
 
-    pcb = udp_new();
-    udp_bind(pcb, IP_ANY_TYPE, OUR_PORT);
-    udp_recv(pcb, net_recv, NULL);
+static void config_erase_task() {
+    static uint32_t prev_packets = 0;
+    static uint32_t last_packet_us = 0;
+
+    uint32_t packets = 0;
+    for (int i = 0; i < NTRANSPORTS; i++) {
+        packets += rx_stats[i].packets;
+    }
+    if (packets != prev_packets) {
+        prev_packets = packets;
+        last_packet_us = time_us_32();
+        return;
+    }
+    if (config_store_erase_pending() && (time_us_32() - last_packet_us >= CONFIG_ERASE_IDLE_US)) {
+        config_store_task();
+    }
 }
 
-void net_task() {
-    wifi_connected = CYW43_LINK_UP == cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+void serial_init() {
+    uart_init(SERIAL_UART, SERIAL_BAUDRATE);
+    uart_set_translate_crlf(SERIAL_UART, false);
+    gpio_set_function(SERIAL_TX_PIN, GPIO_FUNC_UART);
+    uart_rx_init(SERIAL_UART, SERIAL_RX_PIN, SERIAL_BAUDRATE);
+    link_init(SERIAL_UART, SERIAL_BAUDRATE, UART_RX_MAX_BAUDRATE);
 }
 
-#endif
+void serial_task() {
+    const uint8_t* data;
+    uint32_t timestamp_us;
+    uint16_t len;
+
+    while ((len = uart_rx_peek(&data, &timestamp_us)) > 0) {
+        packet_set_source(TRANSPORT_UART, 0, timestamp_us);
+        serial_read_bytes(data, len);
+        uart_rx_consume(len);
+    }
+    link_task();
+}
 
 bool config_ok(config_t* c) {
     if (crc32((uint8_t*) c, sizeof(config_t) - 4) != c->crc) {
@@ -265,6 +318,16 @@ bool config_ok(config_t* c) {
     return true;
 }
 
+bool stats_report_ok(stats_report_t* report) {
+    if (crc32((uint8_t*) report, sizeof(stats_report_t) - 4) != report->crc) {
+        return false;
+    }
+    if (report->config_version != CONFIG_VERSION) {
+        return false;
+    }
+    return true;
+}
+
 bool command_ok(command_t* command) {
     if (crc32((uint8_t*) command, sizeof(command_t) - 4) != command->crc) {
         return false;
@@ -277,31 +340,186 @@ bool command_ok(command_t* command) {
 
 void config_init() {
     config.crc = crc32((uint8_t*) &config, sizeof(config_t) - 4);
-    if (!config_ok((config_t*) FLASH_CONFIG_IN_MEMORY)) {
+    config_store_init(&config_flash);
+
+    config_t stored;
+    if (config_store_read(&stored, sizeof(config_t)) && config_ok(&stored)) {
+        memcpy(&config, &stored, sizeof(config_t));
         return;
     }
-    memcpy(&config, FLASH_CONFIG_IN_MEMORY, sizeof(config_t));
+    if (config_ok((config_t*) LEGACY_FLASH_CONFIG_IN_MEMORY)) {
+        memcpy(&config, LEGACY_FLASH_CONFIG_IN_MEMORY, sizeof(config_t));
+        persist_config();
+    }
 }
 
-uint16_t tud_hid_get_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen) {
-    if (itf == 1) {
-        if (reqlen != sizeof(config_t)) {
-            return 0;
+// new_config has been checked with config_ok().
+static void set_config(const config_t* new_config) {
+    // The password is never sent back to the configuration tool, so an
+    // empty one means keep the current one.
+    char wifi_password[sizeof(config.wifi_password)];
+    memcpy(wifi_password, config.wifi_password, sizeof(wifi_password));
+    uint32_t saved_irq = lock_config();
+    memcpy(&config, new_config, sizeof(config_t));
+    config.wifi_ssid[sizeof(config.wifi_ssid) - 1] = 0;
+    config.wifi_password[sizeof(config.wifi_password) - 1] = 0;
+    if (strlen(config.wifi_password) == 0) {
+        memcpy(config.wifi_password, wifi_password, sizeof(config.wifi_password));
+    }
+    unlock_config(saved_irq);
+    persist_config();
+}
+
+void handle_command(uint8_t command) {
+    printf("command: %d\n", command);
+    switch (command) {
+        case COMMAND_PAIR_NEW_DEVICE:
+#ifdef BLUETOOTH_ENABLED
+            bt_set_pairing_mode(true);
+#endif
+            break;
+        case COMMAND_FORGET_ALL_DEVICES:
+#ifdef BLUETOOTH_ENABLED
+            bt_forget_all_devices();
+#endif
+            break;
+        default:
+            printf("unknown command\n");
+            break;
+    }
+}
+
+#ifdef DUAL_CORE
+void core0_requests_task() {
+    core0_request_t request;
+    while (spsc_pop(&core0_requests, &request)) {
+        switch (request.request) {
+            case CORE0_REQUEST_SET_CONFIG:
+                set_config(&request.config);
+                break;
+            case CORE0_REQUEST_COMMAND:
+                handle_command(request.command);
+                break;
         }
+    }
+}
+
+// Waits for room instead of dropping the request. The control transfer it
+// came with isn't acknowledged until then, so the host is held up rather
+// than told it worked.
+static void push_core0_request(const core0_request_t* request) {
+    while (!spsc_push(&core0_requests, request)) {
+        tight_loop_contents();
+    }
+}
 
-        memcpy(buffer, &config, reqlen);
-        config_t* c = (config_t*) buffer;
-        memset(c->wifi_password, 0, sizeof(c->wifi_password));
-        c->crc = crc32((uint8_t*) c, sizeof(config_t) - 4);
+// Core 1 runs the USB device stack and submits reports handed over by core 0.
+void core1_main() {
+    flash_safe_execute_core_init();
+    tusb_init();
+    tud_sof_cb_enable(true);
+    while (true) {
+        tud_task();
+        outgoing_reports_task();
+    }
+}
+#endif
 
-        return reqlen;
+uint16_t tud_hid_get_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen) {
+    if (itf == CONFIG_INSTANCE) {
+        switch (report_id) {
+            case REPORT_ID_CONFIG: {
+                if (reqlen != sizeof(config_t)) {
+                    return 0;
+                }
+
+                uint32_t saved_irq = lock_config();
+                memcpy(buffer, &config, reqlen);
+                unlock_config(saved_irq);
+                config_t* c = (config_t*) buffer;
+                memset(c->wifi_password, 0, sizeof(c->wifi_password));
+                c->crc = crc32((uint8_t*) c, sizeof(config_t) - 4);
+
+                return reqlen;
+            }
+            case REPORT_ID_LATENCY: {
+                if (reqlen != sizeof(latency_report_t)) {
+                    return 0;
+                }
+
+                latency_histogram_t histogram;
+                latency_get(&histogram);
+                latency_report_t* r = (latency_report_t*) buffer;
+                memset(r, 0, sizeof(latency_report_t));
+                r->config_version = CONFIG_VERSION;
+                r->nbuckets = LATENCY_BUCKETS;
+                r->samples = histogram.samples;
+                r->max_us = histogram.max_us;
+                r->mean_us = histogram.mean_us;
+                memcpy(r->buckets, histogram.buckets, sizeof(r->buckets));
+                r->crc = crc32((uint8_t*) r, sizeof(latency_report_t) - 4);
+
+                return reqlen;
+            }
+            case REPORT_ID_FRAME_PHASE: {
+                if (reqlen != sizeof(frame_phase_report_t)) {
+                    return 0;
+                }
+
+                frame_phase_t phase;
+                latency_get_frame_phase(&phase);
+                frame_phase_report_t* r = (frame_phase_report_t*) buffer;
+                memset(r, 0, sizeof(frame_phase_report_t));
+                r->config_version = CONFIG_VERSION;
+                r->nbuckets = FRAME_PHASE_BUCKETS;
+                r->sof_aligned = !!(config.flags & SOF_ALIGNED_FLAG_MASK);
+                r->sofs = phase.sofs;
+                memcpy(r->arrival, phase.arrival, sizeof(r->arrival));
+                memcpy(r->complete, phase.complete, sizeof(r->complete));
+                r->crc = crc32((uint8_t*) r, sizeof(frame_phase_report_t) - 4);
+
+                return reqlen;
+            }
+            case REPORT_ID_STATS: {
+                if (reqlen != sizeof(stats_report_t)) {
+                    return 0;
+                }
+
+                transport_stats_t stats;
+                stats_get(stats_transport, &stats);
+                if (stats_transport == TRANSPORT_UART) {
+                    stats.uart_overruns = uart_rx_overruns();
+                    stats.framing_errors += uart_rx_framing_errors();
+                }
+                stats_report_t* r = (stats_report_t*) buffer;
+                memset(r, 0, sizeof(stats_report_t));
+                r->config_version = CONFIG_VERSION;
+                r->transport = stats_transport;
+                r->packets = stats.packets;
+                r->bytes = stats.bytes;
+                r->crc_errors = stats.crc_errors;
+                r->framing_errors = stats.framing_errors;
+                r->invalid_packets = stats.invalid_packets;
+                r->queue_drops = stats.queue_drops;
+                r->uart_overruns = stats.uart_overruns;
+                r->descriptor_switches = stats.descriptor_switches;
+                r->uptime_ms = time_us_64() / 1000;
+                r->late_packets = stats.late_packets;
+                r->recovered_packets = stats.recovered_packets;
+                r->crc = crc32((uint8_t*) r, sizeof(stats_report_t) - 4);
+
+                return reqlen;
+            }
+            default:
+                return 0;
+        }
     }
 
     return 0;
 }
 
 void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize) {
-    if (itf == 1) {
+    if (itf == CONFIG_INSTANCE) {
         switch (report_id) {
             case REPORT_ID_CONFIG:
                 if (bufsize != sizeof(config_t)) {
@@ -310,14 +528,13 @@ void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t rep
                 if (!config_ok((config_t*) buffer)) {
                     return;
                 }
-                memcpy(&config, buffer, bufsize);
-                config.wifi_ssid[sizeof(config.wifi_ssid) - 1] = 0;
-                config.wifi_password[sizeof(config.wifi_password) - 1] = 0;
-                if ((strlen(config.wifi_password) == 0) &&
-                    config_ok((config_t*) FLASH_CONFIG_IN_MEMORY)) {
-                    memcpy(config.wifi_password, ((config_t*) FLASH_CONFIG_IN_MEMORY)->wifi_password, sizeof(config.wifi_password));
-                }
-                persist_config();
+#ifdef DUAL_CORE
+                core0_request_t config_request = { .request = CORE0_REQUEST_SET_CONFIG };
+                memcpy(&config_request.config, buffer, sizeof(config_t));
+                push_core0_request(&config_request);
+#else
+                set_config((config_t*) buffer);
+#endif
                 break;
             case REPORT_ID_COMMAND:
                 if (bufsize != sizeof(command_t)) {
@@ -327,22 +544,26 @@ void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t rep
                 if (!command_ok(command)) {
                     return;
                 }
-                printf("command: %d\n", command->command);
-                switch (command->command) {
-                    case COMMAND_PAIR_NEW_DEVICE:
-#ifdef BLUETOOTH_ENABLED
-                        bt_set_pairing_mode(true);
-#endif
-                        break;
-                    case COMMAND_FORGET_ALL_DEVICES:
-#ifdef BLUETOOTH_ENABLED
-                        bt_forget_all_devices();
+                // The histogram belongs to the core that runs the USB stack, which is this one.
+                if (command->command == COMMAND_RESET_LATENCY_HISTOGRAM) {
+                    latency_reset();
+                    break;
+                }
+#ifdef DUAL_CORE
+                push_core0_request(&(core0_request_t){ .request = CORE0_REQUEST_COMMAND, .command = command->command });
+#else
+                handle_command(command->command);
 #endif
-                        break;
-                    default:
-                        printf("unknown command\n");
-                        break;
+                break;
+            case REPORT_ID_STATS:
+                if (bufsize != sizeof(stats_report_t)) {
+                    return;
+                }
+                stats_report_t* request = (stats_report_t*) buffer;
+                if (!stats_report_ok(request) || (request->transport >= NTRANSPORTS)) {
+                    return;
                 }
+                stats_transport = request->transport;
                 break;
             default:
                 printf("unknown report ID\n");
@@ -360,6 +581,10 @@ int main(void) {
     if (our_descriptor_number >= NOUR_DESCRIPTORS) {
         our_descriptor_number = 0;
     }
+    usb_descriptor_number = our_descriptor_number;
+    composite_mode = config.flags & COMPOSITE_FLAG_MASK;
+    packet_set_sof_aligned(config.flags & SOF_ALIGNED_FLAG_MASK);
+    merge_set_policy(config.merge_policy);
     serial_init();
 #if (defined(NETWORK_ENABLED) || defined(BLUETOOTH_ENABLED))
     cyw43_arch_init();
@@ -367,7 +592,7 @@ int main(void) {
 #ifdef NETWORK_ENABLED
     // Only initialize WiFi if enabled in config
     if (config.flags & WIFI_ENABLED_FLAG_MASK) {
-        net_init();
+        net_init(config.wifi_ssid, config.wifi_password);
     }
 #endif
 #ifdef BLUETOOTH_ENABLED
@@ -376,25 +601,37 @@ int main(void) {
         bt_init();
     }
 #endif
+#ifdef DUAL_CORE
+    spsc_init(&core0_requests, core0_requests_buffer, sizeof(core0_request_t), CORE0_REQUESTS_CAPACITY);
+    config_lock = spin_lock_init(spin_lock_claim_unused(true));
+    multicore_launch_core1(core1_main);
+#else
     tusb_init();
+    tud_sof_cb_enable(true);
+#endif
 
 #if (defined(NETWORK_ENABLED) || defined(BLUETOOTH_ENABLED))
     bool prev_led_state = false;
 #endif
 
     while (true) {
+#ifndef DUAL_CORE
         tud_task();
+#endif
 #if (defined(NETWORK_ENABLED) || defined(BLUETOOTH_ENABLED))
         cyw43_arch_poll();
 #endif
 #ifdef NETWORK_ENABLED
         net_task();
 #endif
+#ifdef BLUETOOTH_ENABLED
+        bt_task();
+#endif
 #if (defined(NETWORK_ENABLED) || defined(BLUETOOTH_ENABLED))
         bool led_on = false;
 #endif
 #ifdef NETWORK_ENABLED
-        led_on = led_on || wifi_connected;
+        led_on = led_on || net_is_connected();
 #endif
 #ifdef BLUETOOTH_ENABLED
         led_on = led_on || bt_is_connected();
@@ -409,11 +646,13 @@ int main(void) {
         }
 #endif
         serial_task();
-        if ((or_items > 0) && (tud_hid_n_ready(0))) {
-            tud_hid_n_report(0, outgoing_reports[or_head].report_id, outgoing_reports[or_head].data, outgoing_reports[or_head].len);
-            or_head = (or_head + 1) % OR_BUFSIZE;
-            or_items--;
-        }
+        deferred_persist_task();
+        config_erase_task();
+#ifdef DUAL_CORE
+        core0_requests_task();
+#else
+        outgoing_reports_task();
+#endif
     }
 
     return 0;
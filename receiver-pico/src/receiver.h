@@ -1,6 +1,8 @@
 #ifndef _RECEIVER_H_
 #define _RECEIVER_H_
 
-void serial_read_byte(uint8_t c, uint8_t port);
+#include <stdint.h>
+
+void switch_our_descriptor(uint8_t descriptor_number);
 
 #endif
@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "report_pool.h"
+
+#include "spsc.h"
+
+static uint8_t buffers[REPORT_POOL_BUFFERS][REPORT_POOL_BUFFER_SIZE] __attribute__((aligned(4)));
+static uint8_t refs[REPORT_POOL_BUFFERS];
+// Free buffers are found by scanning from where the last one was found.
+static uint8_t next_free = 0;
+
+uint32_t report_pool_bytes_copied = 0;
+
+#ifdef DUAL_CORE
+// More than the references the USB side can hold at once: the reports
+// in the core to core queue, the report queues, and the last sent and in
+// flight report of every slot.
+#define RELEASED_CAPACITY 128
+static uint8_t released_buffer[RELEASED_CAPACITY];
+static spsc_t released = {
+    .buffer = released_buffer,
+    .elem_size = 1,
+    .capacity = RELEASED_CAPACITY,
+};
+#endif
+
+// References the USB core let go of.
+static void drain_released() {
+#ifdef DUAL_CORE
+    uint8_t* buffer;
+    while ((buffer = spsc_front(&released)) != NULL) {
+        report_pool_unref(*buffer);
+        spsc_release(&released);
+    }
+#endif
+}
+
+uint8_t report_pool_alloc() {
+    drain_released();
+    for (int i = 0; i < REPORT_POOL_BUFFERS; i++) {
+        uint8_t n = (next_free + i) % REPORT_POOL_BUFFERS;
+        if (refs[n] == 0) {
+            refs[n] = 1;
+            next_free = (n + 1) % REPORT_POOL_BUFFERS;
+            return n + 1;
+        }
+    }
+    return NO_BUFFER;
+}
+
+uint8_t* report_pool_data(uint8_t buffer) {
+    return buffers[buffer - 1];
+}
+
+void report_pool_unref(uint8_t buffer) {
+    if ((buffer != NO_BUFFER) && (refs[buffer - 1] > 0)) {
+        refs[buffer - 1]--;
+    }
+}
+
+bool report_pool_shared(uint8_t buffer) {
+    return (buffer != NO_BUFFER) && (refs[buffer - 1] > 1);
+}
+
+uint8_t report_pool_available() {
+    drain_released();
+    uint8_t n = 0;
+    for (int i = 0; i < REPORT_POOL_BUFFERS; i++) {
+        if (refs[i] == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+bool report_pool_hold(report_ref_t* ref, const uint8_t* data, uint8_t len, uint8_t buffer) {
+    drain_released();
+    if ((buffer != NO_BUFFER) && (refs[buffer - 1] < UINT8_MAX)) {
+        refs[buffer - 1]++;
+        ref->data = (uint8_t*) data;
+        ref->len = len;
+        ref->buffer = buffer;
+        return true;
+    }
+    if (len > REPORT_POOL_BUFFER_SIZE) {
+        return false;
+    }
+    buffer = report_pool_alloc();
+    if (buffer == NO_BUFFER) {
+        return false;
+    }
+    ref->data = report_pool_data(buffer);
+    ref->len = len;
+    ref->buffer = buffer;
+    memcpy(ref->data, data, len);
+    report_pool_bytes_copied += len;
+    return true;
+}
+
+void report_pool_release(uint8_t buffer) {
+    if (buffer == NO_BUFFER) {
+        return;
+    }
+#ifdef DUAL_CORE
+    // Can't fail, see RELEASED_CAPACITY.
+    spsc_push(&released, &buffer);
+#else
+    report_pool_unref(buffer);
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef _REPORT_POOL_H_
+#define _REPORT_POOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed pool of reference counted buffers that reports live in on their
+// way from a transport to the IN endpoint. The SLIP decoder decodes frames
+// straight into one, and the reports in it are queued as references to
+// their bytes, so the only copy left is TinyUSB's into the endpoint.
+// Reports from anywhere else (UDP datagrams, delta decoder and merge
+// state) are copied into a buffer of their own once.
+//
+// Buffers are allocated, referenced and unreferenced only by the core that
+// receives packets. report_pool_release() is for the USB side, with
+// DUAL_CORE it hands the reference back to the receiving core, which puts
+// the buffer back in the pool the next time it needs one. (The RP2040 has
+// no atomic read-modify-write to share the counts between cores.)
+
+#define REPORT_POOL_BUFFERS 64
+#define REPORT_POOL_BUFFER_SIZE 128
+
+// Buffers are numbered from 1, so zeroed state holds no buffer.
+#define NO_BUFFER 0
+
+// len bytes at data, inside the given buffer.
+typedef struct {
+    uint8_t* data;
+    uint8_t len;
+    uint8_t buffer;
+} report_ref_t;
+
+// Returns a buffer with one reference, or NO_BUFFER if they're all in use.
+uint8_t report_pool_alloc();
+uint8_t* report_pool_data(uint8_t buffer);
+void report_pool_unref(uint8_t buffer);
+// Whether anything other than the one holding it refers to the buffer.
+bool report_pool_shared(uint8_t buffer);
+// Buffers nothing refers to.
+uint8_t report_pool_available();
+
+// Takes a reference to len bytes at data, which live in buffer. With
+// NO_BUFFER they're copied into a new one. Returns false if there is none.
+bool report_pool_hold(report_ref_t* ref, const uint8_t* data, uint8_t len, uint8_t buffer);
+// Lets go of a reference from the USB side.
+void report_pool_release(uint8_t buffer);
+
+// Bytes copied into pool buffers since the start, for the host benchmarks.
+extern uint32_t report_pool_bytes_copied;
+
+#endif
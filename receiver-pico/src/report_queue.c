@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "report_queue.h"
+
+#include "descriptors.h"
+
+#define REPORT_QUEUE_SLOTS 4
+#define REPORT_QUEUE_DEPTH 4
+#define MAX_REPORT_SIZE 64
+
+#define BYTE(n) (1ULL << (n))
+#define INT16(n) (1ULL << (n))
+
+typedef struct {
+    uint8_t our_descriptor_number;
+    uint8_t report_id;
+    // Bytes that hold buttons or keys, one bit per byte offset.
+    uint64_t edge_bytes;
+    // Offsets of relative 16-bit fields (mouse movement, scroll).
+    uint64_t relative_int16;
+} report_semantics_t;
+
+// Reports not listed here are treated as plain state with no edges.
+static const report_semantics_t report_semantics[] = {
+    // mouse and keyboard: relative mouse, keyboard, consumer control
+    { 0, 1, BYTE(0), INT16(1) | INT16(3) | INT16(5) | INT16(7) },
+    { 0, 2, 0xFFFF, 0 },
+    { 0, 3, BYTE(0), 0 },
+    // absolute mouse and keyboard: absolute X/Y, relative scroll
+    { 1, 1, BYTE(0), INT16(5) | INT16(7) },
+    { 1, 2, 0xFFFF, 0 },
+    { 1, 3, BYTE(0), 0 },
+    // Switch gamepad (hat in byte 2)
+    { 2, 0, BYTE(0) | BYTE(1) | BYTE(2), 0 },
+    // PS4 arcade stick (hat in the low nibble of byte 4)
+    { 3, 1, BYTE(4) | BYTE(5) | BYTE(6), 0 },
+    // Stadia controller (hat in the low nibble of byte 0)
+    { 4, 3, BYTE(0) | BYTE(1) | BYTE(2) | BYTE(9), 0 },
+    // XAC/Flex compatible
+    { 5, 0, BYTE(4) | BYTE(5), 0 },
+};
+
+static const report_semantics_t plain_state = { 0, 0, 0, 0 };
+
+typedef struct {
+    uint32_t seq;
+    uint32_t arrival_us;
+    report_ref_t report;
+} queued_report_t;
+
+typedef struct {
+    bool used;
+    uint8_t report_id;
+    const report_semantics_t* semantics;
+    uint8_t head;
+    uint8_t items;
+    queued_report_t reports[REPORT_QUEUE_DEPTH];
+    // Last report with this ID that the host has read.
+    report_ref_t last_sent;
+} report_slot_t;
+
+typedef struct {
+    report_slot_t slots[REPORT_QUEUE_SLOTS];
+    uint8_t total_items;
+    // The report the USB stack is sending, and the slot it came from
+    // (NULL if none).
+    report_ref_t in_flight;
+    report_slot_t* in_flight_slot;
+} report_queue_t;
+
+static report_queue_t queues[NINSTANCES];
+static uint32_t next_seq = 0;
+
+static const report_semantics_t* find_semantics(uint8_t our_descriptor_number, uint8_t report_id) {
+    for (unsigned int i = 0; i < sizeof(report_semantics) / sizeof(report_semantics[0]); i++) {
+        if ((report_semantics[i].our_descriptor_number == our_descriptor_number) &&
+            (report_semantics[i].report_id == report_id)) {
+            return &report_semantics[i];
+        }
+    }
+    return &plain_state;
+}
+
+// A slot that has nothing waiting or in flight can be taken over by
+// another report ID. All it loses is its last sent report, without which
+// the next report with its ID is compared against all zeros, so it's
+// queued rather than merged where it might not have had to be. Stray IDs
+// can't hold on to slots for good that way.
+static bool slot_idle(report_queue_t* q, report_slot_t* slot) {
+    return (slot->items == 0) && (q->in_flight_slot != slot);
+}
+
+static report_slot_t* find_slot(report_queue_t* q, uint8_t our_descriptor_number, uint8_t report_id) {
+    report_slot_t* free_slot = NULL;
+    report_slot_t* idle_slot = NULL;
+    for (int i = 0; i < REPORT_QUEUE_SLOTS; i++) {
+        if (q->slots[i].used) {
+            if (q->slots[i].report_id == report_id) {
+                return &q->slots[i];
+            }
+            if ((idle_slot == NULL) && slot_idle(q, &q->slots[i])) {
+                idle_slot = &q->slots[i];
+            }
+        } else if (free_slot == NULL) {
+            free_slot = &q->slots[i];
+        }
+    }
+    if ((free_slot == NULL) && (idle_slot != NULL)) {
+        report_pool_release(idle_slot->last_sent.buffer);
+        free_slot = idle_slot;
+    }
+    if (free_slot != NULL) {
+        free_slot->used = true;
+        free_slot->report_id = report_id;
+        free_slot->semantics = find_semantics(our_descriptor_number, report_id);
+        free_slot->head = 0;
+        free_slot->items = 0;
+        free_slot->last_sent.len = 0;
+        free_slot->last_sent.buffer = NO_BUFFER;
+    }
+    return free_slot;
+}
+
+static queued_report_t* slot_report(report_slot_t* slot, uint8_t n) {
+    return &slot->reports[(slot->head + n) % REPORT_QUEUE_DEPTH];
+}
+
+// Would replacing tail with new lose a press or a release that happened
+// between before and tail?
+static bool loses_edge(const report_semantics_t* semantics, const uint8_t* before, uint8_t before_len, const uint8_t* tail, const uint8_t* new, uint8_t len) {
+    for (int i = 0; i < len; i++) {
+        if (semantics->edge_bytes & BYTE(i)) {
+            uint8_t b = (i < before_len) ? before[i] : 0;
+            if ((b ^ tail[i]) & (tail[i] ^ new[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool edges_equal(const report_semantics_t* semantics, const uint8_t* a, const uint8_t* b, uint8_t len) {
+    for (int i = 0; i < len; i++) {
+        if ((semantics->edge_bytes & BYTE(i)) && (a[i] != b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int16_t saturating_add(int16_t a, int16_t b) {
+    int32_t sum = (int32_t) a + b;
+    if (sum > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (sum < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return sum;
+}
+
+// The report the host will have seen before the ones waiting in slot.
+static const report_ref_t* before_queued(report_queue_t* q, report_slot_t* slot) {
+    return (q->in_flight_slot == slot) ? &q->in_flight : &slot->last_sent;
+}
+
+// Replaces the newest waiting report with the new one, which keeps its
+// place in the queue and the arrival time. Relative movement of the
+// replaced report is added to the new one, whose bytes nothing else refers
+// to.
+static bool try_merge(report_queue_t* q, report_slot_t* slot, const report_ref_t* report) {
+    const report_semantics_t* semantics = slot->semantics;
+    queued_report_t* tail = slot_report(slot, slot->items - 1);
+    const uint8_t* old = tail->report.data;
+    uint8_t* data = report->data;
+    uint8_t len = report->len;
+
+    if (tail->report.len != len) {
+        return false;
+    }
+
+    const report_ref_t* before = before_queued(q, slot);
+    if (slot->items > 1) {
+        before = &slot_report(slot, slot->items - 2)->report;
+    }
+    if (loses_edge(semantics, before->data, before->len, old, data, len)) {
+        return false;
+    }
+
+    if (semantics->relative_int16 != 0) {
+        // Movement before and after a button change has to stay on its own side of it.
+        if (!edges_equal(semantics, old, data, len)) {
+            return false;
+        }
+        for (int i = 0; i + 1 < len; i++) {
+            if (semantics->relative_int16 & INT16(i)) {
+                int16_t a = old[i] | (old[i + 1] << 8);
+                int16_t b = data[i] | (data[i + 1] << 8);
+                int16_t sum = saturating_add(a, b);
+                data[i] = sum & 0xFF;
+                data[i + 1] = (sum >> 8) & 0xFF;
+                i++;
+            }
+        }
+    }
+    report_pool_release(tail->report.buffer);
+    tail->report = *report;
+    return true;
+}
+
+bool report_queue_push(uint8_t instance, uint8_t our_descriptor_number, uint8_t report_id, const report_ref_t* report, uint32_t arrival_us) {
+    if (report->len > MAX_REPORT_SIZE) {
+        report_pool_release(report->buffer);
+        return false;
+    }
+
+    report_queue_t* q = &queues[instance];
+    report_slot_t* slot = find_slot(q, our_descriptor_number, report_id);
+    if (slot == NULL) {
+        printf("overflow!\n");
+        report_pool_release(report->buffer);
+        return false;
+    }
+
+    if ((slot->items > 0) && try_merge(q, slot, report)) {
+        return true;
+    }
+
+    if (slot->items == REPORT_QUEUE_DEPTH) {
+        // Out of room for more edges, the newest state wins.
+        printf("overflow!\n");
+        queued_report_t* tail = slot_report(slot, slot->items - 1);
+        report_pool_release(tail->report.buffer);
+        tail->arrival_us = arrival_us;
+        tail->report = *report;
+        return false;
+    }
+
+    queued_report_t* queued = slot_report(slot, slot->items);
+    queued->seq = next_seq++;
+    queued->arrival_us = arrival_us;
+    queued->report = *report;
+    slot->items++;
+    q->total_items++;
+    return true;
+}
+
+static report_slot_t* oldest_slot(report_queue_t* q) {
+    report_slot_t* oldest = NULL;
+    for (int i = 0; i < REPORT_QUEUE_SLOTS; i++) {
+        if (q->slots[i].used && (q->slots[i].items > 0)) {
+            if ((oldest == NULL) ||
+                ((int32_t) (slot_report(&q->slots[i], 0)->seq - slot_report(oldest, 0)->seq) < 0)) {
+                oldest = &q->slots[i];
+            }
+        }
+    }
+    return oldest;
+}
+
+bool report_queue_peek(uint8_t instance, uint8_t* report_id, const uint8_t** data, uint8_t* len, uint32_t* arrival_us) {
+    report_queue_t* q = &queues[instance];
+    if (q->total_items == 0) {
+        return false;
+    }
+    report_slot_t* slot = oldest_slot(q);
+    queued_report_t* report = slot_report(slot, 0);
+    *report_id = slot->report_id;
+    *data = report->report.data;
+    *len = report->report.len;
+    *arrival_us = report->arrival_us;
+    return true;
+}
+
+bool report_queue_peek_final(uint8_t instance) {
+    report_queue_t* q = &queues[instance];
+    if (q->total_items == 0) {
+        return false;
+    }
+    return oldest_slot(q)->items > 1;
+}
+
+void report_queue_complete(uint8_t instance) {
+    report_queue_t* q = &queues[instance];
+    report_slot_t* slot = q->in_flight_slot;
+    if (slot == NULL) {
+        return;
+    }
+    report_pool_release(slot->last_sent.buffer);
+    slot->last_sent = q->in_flight;
+    q->in_flight_slot = NULL;
+}
+
+static void start_sending(report_queue_t* q, report_slot_t* slot, const report_ref_t* report) {
+    report_queue_complete(q - queues);
+    q->in_flight = *report;
+    q->in_flight_slot = slot;
+}
+
+void report_queue_pop(uint8_t instance) {
+    report_queue_t* q = &queues[instance];
+    if (q->total_items == 0) {
+        return;
+    }
+    report_slot_t* slot = oldest_slot(q);
+    start_sending(q, slot, &slot_report(slot, 0)->report);
+    slot->head = (slot->head + 1) % REPORT_QUEUE_DEPTH;
+    slot->items--;
+    q->total_items--;
+}
+
+void report_queue_sent(uint8_t instance, uint8_t our_descriptor_number, uint8_t report_id, const report_ref_t* report) {
+    report_queue_t* q = &queues[instance];
+    report_slot_t* slot = find_slot(q, our_descriptor_number, report_id);
+    if ((slot == NULL) || (report->len > MAX_REPORT_SIZE)) {
+        report_pool_release(report->buffer);
+        return;
+    }
+    start_sending(q, slot, report);
+}
+
+bool report_queue_empty(uint8_t instance) {
+    return queues[instance].total_items == 0;
+}
+
+void report_queue_clear() {
+    for (int instance = 0; instance < NINSTANCES; instance++) {
+        report_queue_t* q = &queues[instance];
+        for (int i = 0; i < REPORT_QUEUE_SLOTS; i++) {
+            report_slot_t* slot = &q->slots[i];
+            for (int n = 0; n < slot->items; n++) {
+                report_pool_release(slot_report(slot, n)->report.buffer);
+            }
+            report_pool_release(slot->last_sent.buffer);
+        }
+        if (q->in_flight_slot != NULL) {
+            report_pool_release(q->in_flight.buffer);
+        }
+    }
+    memset(queues, 0, sizeof(queues));
+}
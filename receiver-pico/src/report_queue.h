@@ -0,0 +1,44 @@
+#ifndef _REPORT_QUEUE_H_
+#define _REPORT_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "report_pool.h"
+
+// Reports waiting for the host to poll the IN endpoint. There is one slot
+// per report ID, which another ID can take over once the host has read
+// everything in it. A new report is merged into the one already waiting in its
+// slot (latest value wins, relative movement is summed) unless that would
+// lose a button/key press or release, in which case it's queued behind it.
+// Memory is fixed and the queueing latency is bounded by one poll interval
+// for everything but such edges. Each report keeps the arrival time of the
+// oldest packet merged into it.
+// Every HID instance has its own queue. our_descriptor_number tells which
+// emulated device the reports are for.
+// Reports are held as references to pool buffers. The queue takes over the
+// reference it is given and releases it when the report is superseded, or
+// when the host has read the report after it.
+
+// Returns false if a report had to be dropped to make room.
+bool report_queue_push(uint8_t instance, uint8_t our_descriptor_number, uint8_t report_id, const report_ref_t* report, uint32_t arrival_us);
+
+// Oldest waiting report. Returns false if there is none.
+bool report_queue_peek(uint8_t instance, uint8_t* report_id, const uint8_t** data, uint8_t* len, uint32_t* arrival_us);
+// The oldest report was handed to the USB stack.
+void report_queue_pop(uint8_t instance);
+// Whether the oldest waiting report can no longer change because newer
+// reports are queued behind it (new data is only merged into the newest).
+bool report_queue_peek_final(uint8_t instance);
+
+// For reports that bypassed the queue because the endpoint was free.
+void report_queue_sent(uint8_t instance, uint8_t our_descriptor_number, uint8_t report_id, const report_ref_t* report);
+// The host read the report last handed to the USB stack. Handing over
+// another one before that also counts, in case the callback never came.
+void report_queue_complete(uint8_t instance);
+
+bool report_queue_empty(uint8_t instance);
+// Empties all queues and releases everything they hold.
+void report_queue_clear();
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sequence.h"
+
+#include "packet.h"
+#include "stats.h"
+
+// A sequence number this far behind the last one means the sender
+// restarted rather than a datagram being late.
+#define RESYNC_WINDOW 1024
+
+// After this many stale datagrams in a row the sender's clock has probably
+// jumped, so the delay baseline is measured again.
+#define STALE_RESYNC_COUNT 8
+
+// Only the newest packet is applied after a resync, older copies could
+// replay a press that's long over.
+typedef struct {
+    bool valid;
+    uint32_t last_seq;
+    // Smallest delivery delay seen (arrival minus the sender's timestamp,
+    // including the unknown offset between the two clocks).
+    uint32_t base_delay;
+    uint8_t stale_in_a_row;
+} sequence_state_t;
+
+static sequence_state_t states[NSOURCES];
+
+static void resync(sequence_state_t* state, uint32_t seq, uint32_t delay) {
+    state->valid = true;
+    state->last_seq = seq;
+    state->base_delay = delay;
+    state->stale_in_a_row = 0;
+}
+
+uint8_t sequence_check(uint8_t source, uint8_t transport, uint32_t seq, uint32_t timestamp_us, uint32_t arrival_us, uint8_t count) {
+    sequence_state_t* state = &states[source];
+    uint32_t delay = arrival_us - timestamp_us;
+
+    if (!state->valid) {
+        resync(state, seq, delay);
+        return 1;
+    }
+
+    int32_t ahead = seq - state->last_seq;
+    if ((ahead <= 0) && (ahead > -RESYNC_WINDOW)) {
+        printf("late packet\n");
+        rx_stats[transport].late_packets++;
+        return 0;
+    }
+    if (ahead <= 0) {
+        resync(state, seq, delay);
+        return 1;
+    }
+
+    // The baseline follows faster deliveries down at once and creeps up by
+    // a microsecond per datagram, so clock drift doesn't accumulate.
+    int32_t extra_delay = delay - state->base_delay;
+    if (extra_delay < 0) {
+        state->base_delay = delay;
+    } else if (extra_delay > SEQUENCE_STALE_US) {
+        printf("stale packet\n");
+        rx_stats[transport].late_packets++;
+        if (++state->stale_in_a_row == STALE_RESYNC_COUNT) {
+            resync(state, seq, delay);
+            return 1;
+        }
+        return 0;
+    } else if (extra_delay > 0) {
+        state->base_delay++;
+    }
+    state->stale_in_a_row = 0;
+
+    uint8_t fresh = (ahead < count) ? ahead : count;
+    rx_stats[transport].recovered_packets += fresh - 1;
+    state->last_seq = seq;
+    return fresh;
+}
+
+void sequence_forget_source(uint8_t source) {
+    states[source].valid = false;
+}
+
+void sequence_reset() {
+    memset(states, 0, sizeof(states));
+}
@@ -0,0 +1,24 @@
+#ifndef _SEQUENCE_H_
+#define _SEQUENCE_H_
+
+#include <stdint.h>
+
+// Protocol version 4 frames wrap the newest packet and copies of the ones
+// sent before it in a header with a sequence number and the sender's
+// time. A datagram that arrives after a newer one, or much later than
+// usual, is dropped instead of being applied late, and the copies of the
+// previous packets fill in for lost datagrams without a round trip.
+
+// Datagrams delivered this much later than the fastest recent one are stale.
+#define SEQUENCE_STALE_US 50000
+
+// Returns how many of the count packets in a datagram (newest first) still
+// have to be applied, oldest of them first. 0 means drop the datagram.
+// Every source (see NSOURCES) is tracked separately, counters go to its
+// transport.
+uint8_t sequence_check(uint8_t source, uint8_t transport, uint32_t seq, uint32_t timestamp_us, uint32_t arrival_us, uint8_t count);
+
+void sequence_forget_source(uint8_t source);
+void sequence_reset();
+
+#endif
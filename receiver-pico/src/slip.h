@@ -0,0 +1,11 @@
+#ifndef _SLIP_H_
+#define _SLIP_H_
+
+// SLIP (RFC 1055) special characters, for the frames decoded in packet.c
+// and the link status frames link.c sends back.
+#define END 0300     /* indicates end of packet */
+#define ESC 0333     /* indicates byte stuffing */
+#define ESC_END 0334 /* ESC ESC_END means END data byte */
+#define ESC_ESC 0335 /* ESC ESC_ESC means ESC data byte */
+
+#endif
@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include "spsc.h"
+
+void spsc_init(spsc_t* q, void* buffer, uint32_t elem_size, uint32_t capacity) {
+    q->buffer = buffer;
+    q->elem_size = elem_size;
+    q->capacity = capacity;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+void* spsc_alloc(spsc_t* q) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail == q->capacity) {
+        return NULL;
+    }
+    return q->buffer + (head & (q->capacity - 1)) * q->elem_size;
+}
+
+void spsc_commit(spsc_t* q) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+bool spsc_push(spsc_t* q, const void* elem) {
+    void* slot = spsc_alloc(q);
+    if (slot == NULL) {
+        return false;
+    }
+    memcpy(slot, elem, q->elem_size);
+    spsc_commit(q);
+    return true;
+}
+
+uint32_t spsc_free(spsc_t* q) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return q->capacity - (head - tail);
+}
+
+void* spsc_front(spsc_t* q) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    return q->buffer + (tail & (q->capacity - 1)) * q->elem_size;
+}
+
+void spsc_release(spsc_t* q) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+bool spsc_pop(spsc_t* q, void* elem) {
+    void* slot = spsc_front(q);
+    if (slot == NULL) {
+        return false;
+    }
+    memcpy(elem, slot, q->elem_size);
+    spsc_release(q);
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef _SPSC_H_
+#define _SPSC_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Lock-free ring of fixed-size elements for exactly one producer and one
+// consumer, which may run on different cores. Capacity must be a power
+// of two.
+
+typedef struct {
+    uint8_t* buffer;
+    uint32_t elem_size;
+    uint32_t capacity;
+    atomic_uint_least32_t head;  // written only by the producer
+    atomic_uint_least32_t tail;  // written only by the consumer
+} spsc_t;
+
+void spsc_init(spsc_t* q, void* buffer, uint32_t elem_size, uint32_t capacity);
+
+// Producer side. spsc_alloc() returns the slot the next element goes into,
+// or NULL if the ring is full. spsc_commit() makes it visible to the consumer.
+void* spsc_alloc(spsc_t* q);
+void spsc_commit(spsc_t* q);
+bool spsc_push(spsc_t* q, const void* elem);
+// Number of elements the producer can add before the ring is full.
+uint32_t spsc_free(spsc_t* q);
+
+// Consumer side. spsc_front() returns the oldest element or NULL if the
+// ring is empty. spsc_release() frees its slot.
+void* spsc_front(spsc_t* q);
+void spsc_release(spsc_t* q);
+bool spsc_pop(spsc_t* q, void* elem);
+
+#endif
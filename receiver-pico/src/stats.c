@@ -0,0 +1,10 @@
+#include "stats.h"
+
+transport_stats_t rx_stats[NTRANSPORTS];
+uint32_t usb_queue_drops[NTRANSPORTS];
+uint32_t rx_queue_drops[NTRANSPORTS];
+
+void stats_get(uint8_t transport, transport_stats_t* stats) {
+    *stats = rx_stats[transport];
+    stats->queue_drops += usb_queue_drops[transport] + rx_queue_drops[transport];
+}
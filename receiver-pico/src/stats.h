@@ -0,0 +1,35 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+#define TRANSPORT_UART 0
+#define TRANSPORT_BT 1
+#define TRANSPORT_UDP 2
+#define NTRANSPORTS 3
+
+typedef struct {
+    uint32_t packets;         // passed the CRC check (UDP: datagrams received)
+    uint32_t bytes;           // as received, before SLIP decoding
+    uint32_t crc_errors;      // frames with a CRC mismatch
+    uint32_t framing_errors;  // SLIP/UART level: bad escapes, frames too short or too long
+    uint32_t invalid_packets; // good CRC, but rejected by handle_received_packet()
+    uint32_t queue_drops;     // reports or received data lost because a queue was full
+    uint32_t uart_overruns;   // UART only, bytes lost in the FIFO or ring buffer
+    uint32_t descriptor_switches;  // re-enumerations as a different device
+    uint32_t late_packets;    // sequenced packets dropped as reordered or stale
+    uint32_t recovered_packets;  // lost packets applied from the copies in a later one
+} transport_stats_t;
+
+// Updated where the data is received. In dual core mode queue drops on
+// the USB core are counted separately in usb_queue_drops, so that every
+// counter has one writer. Data dropped before parsing because a receive
+// queue filled by an interrupt handler was full is counted in
+// rx_queue_drops, for the same reason.
+extern transport_stats_t rx_stats[NTRANSPORTS];
+extern uint32_t usb_queue_drops[NTRANSPORTS];
+extern uint32_t rx_queue_drops[NTRANSPORTS];
+
+void stats_get(uint8_t transport, transport_stats_t* stats);
+
+#endif
@@ -8,7 +8,9 @@
 
 #define CFG_TUD_ENDPOINT0_SIZE 64
 
-#define CFG_TUD_HID 2
+// Emulated device and configuration interface, plus two more emulated
+// devices in composite mode.
+#define CFG_TUD_HID 4
 #define CFG_TUD_CDC 0
 #define CFG_TUD_MSC 0
 #define CFG_TUD_MIDI 0
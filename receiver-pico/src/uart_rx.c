@@ -0,0 +1,120 @@
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+#include "uart_rx.h"
+
+// Both must be powers of two.
+#define UART_RX_BUFSIZE 1024
+#define UART_RX_MAX_CHUNKS 64
+
+// Bytes are written by the RX interrupt handler and read from the main loop.
+// Each interrupt appends one chunk, which remembers where it ends and when
+// it arrived.
+static uint8_t buffer[UART_RX_BUFSIZE];
+static volatile uint32_t buffer_head = 0;
+static volatile uint32_t buffer_tail = 0;
+
+static volatile uint32_t chunk_end[UART_RX_MAX_CHUNKS];
+static volatile uint32_t chunk_timestamp[UART_RX_MAX_CHUNKS];
+static volatile uint32_t chunk_head = 0;
+static volatile uint32_t chunk_tail = 0;
+
+static volatile uint32_t overruns = 0;
+static volatile uint32_t framing_errors = 0;
+
+static uart_inst_t* rx_uart;
+
+static void uart_rx_irq_handler() {
+    uint32_t timestamp = time_us_32();
+    uint32_t head = buffer_head;
+    uart_hw_t* hw = uart_get_hw(rx_uart);
+
+    while (uart_is_readable(rx_uart)) {
+        uint32_t dr = hw->dr;
+        if (dr & UART_UARTDR_OE_BITS) {
+            overruns++;
+        }
+        if (dr & (UART_UARTDR_FE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_BE_BITS)) {
+            framing_errors++;
+        }
+        if (head - buffer_tail == UART_RX_BUFSIZE) {
+            overruns++;
+            continue;
+        }
+        buffer[head % UART_RX_BUFSIZE] = dr & 0xFF;
+        head++;
+    }
+
+    if (head == buffer_head) {
+        return;
+    }
+
+    __compiler_memory_barrier();
+
+    if (chunk_head - chunk_tail == UART_RX_MAX_CHUNKS) {
+        // Out of chunk slots, extend the newest chunk and keep its earlier timestamp.
+        chunk_end[(chunk_head - 1) % UART_RX_MAX_CHUNKS] = head;
+    } else {
+        chunk_end[chunk_head % UART_RX_MAX_CHUNKS] = head;
+        chunk_timestamp[chunk_head % UART_RX_MAX_CHUNKS] = timestamp;
+        __compiler_memory_barrier();
+        chunk_head++;
+    }
+    buffer_head = head;
+}
+
+void uart_rx_init(uart_inst_t* uart, uint rx_pin, uint32_t baudrate) {
+    rx_uart = uart;
+    uart_set_baudrate(uart, baudrate);
+    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+    uint irq = (uart == uart0) ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(irq, uart_rx_irq_handler);
+    irq_set_enabled(irq, true);
+    // Fires at the FIFO threshold and on the receive timeout, so short frames
+    // don't wait for the FIFO to fill.
+    uart_set_irq_enables(uart, true, false);
+}
+
+void uart_rx_set_baudrate(uint32_t baudrate) {
+    uart_set_baudrate(rx_uart, baudrate);
+}
+
+uint16_t uart_rx_peek(const uint8_t** data, uint32_t* timestamp_us) {
+    uint32_t tail = buffer_tail;
+
+    if (chunk_tail == chunk_head) {
+        return 0;
+    }
+    __compiler_memory_barrier();
+
+    uint32_t idx = chunk_tail % UART_RX_MAX_CHUNKS;
+    uint32_t end = chunk_end[idx];
+    uint32_t len = end - tail;
+    uint32_t until_wrap = UART_RX_BUFSIZE - (tail % UART_RX_BUFSIZE);
+    if (len > until_wrap) {
+        len = until_wrap;
+    }
+
+    *data = &buffer[tail % UART_RX_BUFSIZE];
+    *timestamp_us = chunk_timestamp[idx];
+    return len;
+}
+
+void uart_rx_consume(uint16_t len) {
+    uint32_t tail = buffer_tail + len;
+    __compiler_memory_barrier();
+    buffer_tail = tail;
+    if (tail == chunk_end[chunk_tail % UART_RX_MAX_CHUNKS]) {
+        chunk_tail++;
+    }
+}
+
+uint32_t uart_rx_overruns() {
+    return overruns;
+}
+
+uint32_t uart_rx_framing_errors() {
+    return framing_errors;
+}
@@ -0,0 +1,38 @@
+#ifndef _UART_RX_H_
+#define _UART_RX_H_
+
+#include <stdint.h>
+
+#include "hardware/uart.h"
+
+// Two implementations: the UART's own receiver, emptied by its interrupt
+// handler (uart_rx.c), or with SERIAL_PIO a PIO state machine feeding a
+// ring buffer through DMA (uart_rx_pio.c), which keeps up at several Mbaud
+// and while interrupts are off. Either way uart is set up by the caller
+// and its TX side is left alone.
+#ifdef SERIAL_PIO
+#define UART_RX_MAX_BAUDRATE 6000000
+#else
+#define UART_RX_MAX_BAUDRATE 3000000
+#endif
+
+void uart_rx_init(uart_inst_t* uart, uint rx_pin, uint32_t baudrate);
+// Changes the rate for both directions of uart.
+void uart_rx_set_baudrate(uint32_t baudrate);
+
+// Returns the number of contiguous received bytes available at *data. They
+// all arrived in the same interrupt, at *timestamp_us (time_us_32()). With
+// SERIAL_PIO they arrived between two checks of the DMA's progress, and
+// the timestamp is the later one.
+// Call uart_rx_consume() once they have been processed.
+uint16_t uart_rx_peek(const uint8_t** data, uint32_t* timestamp_us);
+void uart_rx_consume(uint16_t len);
+
+// Number of bytes lost because either the UART FIFO or the ring buffer
+// was full.
+uint32_t uart_rx_overruns();
+
+// Number of bytes received with a framing, parity or break error.
+uint32_t uart_rx_framing_errors();
+
+#endif
@@ -0,0 +1,224 @@
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+#include "uart_rx.h"
+
+#include "serial_rx.pio.h"
+
+// The DMA channel writes into the buffer as a ring, which has to be
+// aligned to its size.
+#define UART_RX_BUFSIZE_BITS 12
+#define UART_RX_BUFSIZE (1 << UART_RX_BUFSIZE_BITS)
+
+// The channel runs for this many bytes before its interrupt restarts it,
+// over an hour at the top rate on RP2040. On RP2350 the top four bits of
+// the transfer count register select the mode, so the count only has 28
+// bits there (still minutes), and all zeros above them is a normal
+// transfer.
+#ifdef DMA_CH0_TRANS_COUNT_MODE_BITS
+#define DMA_TRANSFER_COUNT DMA_CH0_TRANS_COUNT_COUNT_BITS
+#else
+#define DMA_TRANSFER_COUNT 0xFFFFFFFF
+#endif
+
+// How often a timer checks how far the DMA has got, which is what the
+// bytes' arrival times are taken from, so they're stamped at most this
+// late. The UART's interrupt stamps them up to its receive timeout (32
+// bit times) late, about 35 us at 921600 baud.
+#define SAMPLE_INTERVAL_US 100
+// Power of two. Only samples that saw new bytes are kept.
+#define SAMPLES 64
+
+// The CYW43 driver prefers pio1 for its SPI.
+#define RX_PIO pio0
+#define PIO_CYCLES_PER_BIT 8
+
+static uint8_t buffer[UART_RX_BUFSIZE] __attribute__((aligned(UART_RX_BUFSIZE)));
+
+static uart_inst_t* rx_uart;
+static uint sm;
+static uint program_offset;
+static int dma_channel;
+
+// Bytes received in earlier runs of the DMA channel.
+static volatile uint32_t received_before = 0;
+// Bytes consumed, and the part of the received ones the current chunk
+// covers with the time it was noticed.
+static uint32_t buffer_tail = 0;
+static uint32_t chunk_end = 0;
+static uint32_t chunk_timestamp;
+
+typedef struct {
+    uint32_t received;
+    uint32_t timestamp_us;
+} sample_t;
+
+// Written by the timer, newest at sample_head - 1.
+static sample_t samples[SAMPLES];
+static volatile uint32_t sample_head = 0;
+static repeating_timer_t sample_timer;
+
+static uint32_t overruns = 0;
+static volatile uint32_t framing_errors = 0;
+
+// The write address carries on from where the ring wrapped it, so the
+// offset in the buffer stays the byte count modulo the buffer size.
+static void dma_irq_handler() {
+    if (!(dma_hw->ints1 & (1u << dma_channel))) {
+        return;
+    }
+    dma_channel_acknowledge_irq1(dma_channel);
+    received_before += DMA_TRANSFER_COUNT;
+    dma_channel_set_trans_count(dma_channel, DMA_TRANSFER_COUNT, true);
+}
+
+static void pio_irq_handler() {
+    pio_interrupt_clear(RX_PIO, sm);
+    framing_errors++;
+}
+
+static uint32_t bytes_received() {
+    uint32_t before;
+    uint32_t remaining;
+    do {
+        before = received_before;
+        // Without the mode bits on RP2350.
+        remaining = dma_channel_hw_addr(dma_channel)->transfer_count & DMA_TRANSFER_COUNT;
+    } while (before != received_before);
+    return before + (DMA_TRANSFER_COUNT - remaining);
+}
+
+static bool sample_progress(repeating_timer_t* timer) {
+    uint32_t received = bytes_received();
+    uint32_t head = sample_head;
+    if ((head == 0) || (samples[(head - 1) % SAMPLES].received != received)) {
+        samples[head % SAMPLES].received = received;
+        samples[head % SAMPLES].timestamp_us = time_us_32();
+        __compiler_memory_barrier();
+        sample_head = head + 1;
+    }
+    return true;
+}
+
+// Where the chunk starting at buffer_tail ends and when its bytes arrived:
+// the first sample that saw the byte at buffer_tail covers the bytes up
+// to what it saw. Bytes no sample has seen yet arrived just now. The
+// samples are read before head, so none of them is past it. The timer
+// would have to run SAMPLES times while this loops to overwrite one. If
+// we're further behind than the samples go back, the bytes before the
+// oldest one get its time.
+static void find_chunk(uint32_t newest, uint32_t head) {
+    chunk_end = head;
+    chunk_timestamp = time_us_32();
+    uint32_t n = (newest < SAMPLES) ? newest : SAMPLES;
+    for (uint32_t i = 1; i <= n; i++) {
+        const sample_t* sample = &samples[(newest - i) % SAMPLES];
+        if ((int32_t) (sample->received - buffer_tail) <= 0) {
+            break;
+        }
+        chunk_end = sample->received;
+        chunk_timestamp = sample->timestamp_us;
+    }
+}
+
+static void set_clkdiv(uint32_t baudrate) {
+    pio_sm_set_clkdiv(RX_PIO, sm, (float) clock_get_hz(clk_sys) / (PIO_CYCLES_PER_BIT * baudrate));
+}
+
+void uart_rx_init(uart_inst_t* uart, uint rx_pin, uint32_t baudrate) {
+    rx_uart = uart;
+    uart_set_baudrate(uart, baudrate);
+
+    sm = pio_claim_unused_sm(RX_PIO, true);
+    program_offset = pio_add_program(RX_PIO, &serial_rx_program);
+    pio_sm_set_consecutive_pindirs(RX_PIO, sm, rx_pin, 1, false);
+    pio_gpio_init(RX_PIO, rx_pin);
+    gpio_pull_up(rx_pin);
+
+    pio_sm_config c = serial_rx_program_get_default_config(program_offset);
+    sm_config_set_in_pins(&c, rx_pin);
+    sm_config_set_jmp_pin(&c, rx_pin);
+    sm_config_set_in_shift(&c, true, false, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    pio_sm_init(RX_PIO, sm, program_offset, &c);
+    set_clkdiv(baudrate);
+
+    pio_set_irq0_source_enabled(RX_PIO, pis_interrupt0 + sm, true);
+    irq_set_exclusive_handler(PIO0_IRQ_0, pio_irq_handler);
+    irq_set_enabled(PIO0_IRQ_0, true);
+
+    dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config dc = dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_8);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_ring(&dc, true, UART_RX_BUFSIZE_BITS);
+    channel_config_set_dreq(&dc, pio_get_dreq(RX_PIO, sm, false));
+    // The byte is shifted in from the left, so it's the FIFO word's top byte.
+    dma_channel_configure(dma_channel, &dc, buffer, ((io_rw_8*) &RX_PIO->rxf[sm]) + 3, DMA_TRANSFER_COUNT, false);
+    dma_channel_set_irq1_enabled(dma_channel, true);
+    irq_add_shared_handler(DMA_IRQ_1, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+    dma_channel_start(dma_channel);
+
+    pio_sm_set_enabled(RX_PIO, sm, true);
+
+    add_repeating_timer_us(-SAMPLE_INTERVAL_US, sample_progress, NULL, &sample_timer);
+}
+
+void uart_rx_set_baudrate(uint32_t baudrate) {
+    uart_set_baudrate(rx_uart, baudrate);
+    // Start over from waiting for a start bit, a byte that was under way
+    // is garbage at the new rate anyway.
+    pio_sm_set_enabled(RX_PIO, sm, false);
+    set_clkdiv(baudrate);
+    pio_sm_restart(RX_PIO, sm);
+    pio_sm_clkdiv_restart(RX_PIO, sm);
+    pio_sm_exec(RX_PIO, sm, pio_encode_jmp(program_offset));
+    pio_sm_set_enabled(RX_PIO, sm, true);
+}
+
+uint16_t uart_rx_peek(const uint8_t** data, uint32_t* timestamp_us) {
+    if (buffer_tail == chunk_end) {
+        uint32_t newest = sample_head;
+        __compiler_memory_barrier();
+        uint32_t head = bytes_received();
+        if (head == buffer_tail) {
+            return 0;
+        }
+        if (head - buffer_tail > UART_RX_BUFSIZE) {
+            // The DMA lapped us. Skip ahead, leaving some room so what we
+            // hand out isn't overwritten right away.
+            uint32_t tail = head - UART_RX_BUFSIZE / 2;
+            overruns += tail - buffer_tail;
+            buffer_tail = tail;
+        }
+        find_chunk(newest, head);
+    }
+
+    uint32_t len = chunk_end - buffer_tail;
+    uint32_t until_wrap = UART_RX_BUFSIZE - (buffer_tail % UART_RX_BUFSIZE);
+    if (len > until_wrap) {
+        len = until_wrap;
+    }
+    *data = &buffer[buffer_tail % UART_RX_BUFSIZE];
+    *timestamp_us = chunk_timestamp;
+    return len;
+}
+
+void uart_rx_consume(uint16_t len) {
+    buffer_tail += len;
+}
+
+uint32_t uart_rx_overruns() {
+    return overruns;
+}
+
+uint32_t uart_rx_framing_errors() {
+    return framing_errors;
+}
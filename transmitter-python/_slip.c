@@ -0,0 +1,130 @@
+// C version of slip.encode_frame() and slip.encode_frames(), escaping and
+// computing the CRC in a single pass. Build with
+// "python3 setup.py build_ext --inplace".
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+static uint32_t crc_table[256];
+
+static void crc_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        crc_table[i] = c;
+    }
+}
+
+static inline uint8_t* put_escaped(uint8_t* out, uint8_t c) {
+    if (c == END) {
+        *out++ = ESC;
+        *out++ = ESC_END;
+    } else if (c == ESC) {
+        *out++ = ESC;
+        *out++ = ESC_ESC;
+    } else {
+        *out++ = c;
+    }
+    return out;
+}
+
+// out needs room for 2 * len + 10 bytes.
+static uint8_t* encode(uint8_t* out, const uint8_t* data, Py_ssize_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    *out++ = END;
+    for (Py_ssize_t i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        out = put_escaped(out, data[i]);
+    }
+    crc = ~crc;
+    for (int i = 0; i < 4; i++) {
+        out = put_escaped(out, (crc >> (i * 8)) & 0xFF);
+    }
+    *out++ = END;
+    return out;
+}
+
+#define FRAME_MAX_SIZE(len) (2 * (len) + 10)
+
+static PyObject* encode_frame(PyObject* self, PyObject* arg) {
+    Py_buffer data;
+    if (PyObject_GetBuffer(arg, &data, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+    PyObject* result = PyBytes_FromStringAndSize(NULL, FRAME_MAX_SIZE(data.len));
+    if (result != NULL) {
+        uint8_t* start = (uint8_t*) PyBytes_AS_STRING(result);
+        uint8_t* end = encode(start, data.buf, data.len);
+        _PyBytes_Resize(&result, end - start);
+    }
+    PyBuffer_Release(&data);
+    return result;
+}
+
+static PyObject* encode_frames(PyObject* self, PyObject* arg) {
+    PyObject* packets = PySequence_Fast(arg, "encode_frames() takes a sequence of packets");
+    if (packets == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(packets);
+    PyObject** items = PySequence_Fast_ITEMS(packets);
+    Py_buffer* buffers = PyMem_Calloc(n ? n : 1, sizeof(Py_buffer));
+    PyObject* result = NULL;
+    Py_ssize_t got = 0;
+    Py_ssize_t size = 0;
+    if (buffers == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    for (; got < n; got++) {
+        if (PyObject_GetBuffer(items[got], &buffers[got], PyBUF_SIMPLE) < 0) {
+            goto out;
+        }
+        size += FRAME_MAX_SIZE(buffers[got].len);
+    }
+    result = PyBytes_FromStringAndSize(NULL, size);
+    if (result != NULL) {
+        uint8_t* start = (uint8_t*) PyBytes_AS_STRING(result);
+        uint8_t* end = start;
+        for (Py_ssize_t i = 0; i < n; i++) {
+            end = encode(end, buffers[i].buf, buffers[i].len);
+        }
+        _PyBytes_Resize(&result, end - start);
+    }
+
+out:
+    for (Py_ssize_t i = 0; i < got; i++) {
+        PyBuffer_Release(&buffers[i]);
+    }
+    PyMem_Free(buffers);
+    Py_DECREF(packets);
+    return result;
+}
+
+static PyMethodDef methods[] = {
+    { "encode_frame", encode_frame, METH_O, "Returns data with a CRC32 appended, SLIP encoded as one frame." },
+    { "encode_frames", encode_frames, METH_O, "Returns the frames for several packets back to back, for a single write." },
+    { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    "_slip",
+    NULL,
+    -1,
+    methods,
+};
+
+PyMODINIT_FUNC PyInit__slip() {
+    crc_init();
+    return PyModule_Create(&module);
+}
@@ -0,0 +1,227 @@
+import argparse
+import array
+import asyncio
+import concurrent.futures
+import statistics
+import threading
+import time
+
+import network_transmitter
+import transmitter_helper
+
+# asyncio.sleep() is only trusted to wake up this close to a tick, the
+# rest is a busy wait. The event loop waits in whole milliseconds on
+# Linux and macOS. Windows' default timer is coarser, so there it takes a
+# larger --spin.
+SPIN_THRESHOLD = 0.001
+
+# The receiver only merges our state with other senders' while we've sent
+# something within the last second, so an unchanged state is repeated.
+REPEAT_INTERVAL = 0.25
+
+
+class Pacer:
+    """Wakes up rate times per second, on a fixed grid. Ticks that were
+    missed entirely are skipped rather than caught up with in a burst."""
+
+    def __init__(self, rate, spin=SPIN_THRESHOLD):
+        self.period = 1.0 / rate
+        self.spin = spin
+        self.next = time.perf_counter()
+        self.missed = 0
+
+    async def wait(self):
+        """Returns once the next tick has come."""
+        self.next += self.period
+        late = time.perf_counter() - self.next
+        if late >= self.period:
+            skipped = int(late / self.period)
+            self.missed += skipped
+            self.next += skipped * self.period
+        # Always give the event loop a turn, even when the spin covers the
+        # whole period.
+        await asyncio.sleep(max(0, self.next - time.perf_counter() - self.spin))
+        while time.perf_counter() < self.next:
+            pass
+
+
+class SendLog:
+    """The time of every send, optionally also written to a file with one
+    perf_counter() value in seconds per line."""
+
+    def __init__(self, filename=None):
+        self.times = array.array("d")
+        self.file = open(filename, "w", buffering=1) if filename else None
+
+    def record(self, t):
+        self.times.append(t)
+        if self.file:
+            self.file.write(f"{t:.9f}\n")
+
+    def summary(self, period=None):
+        """Intervals between sends, and how far they were from period."""
+        intervals = [b - a for a, b in zip(self.times, self.times[1:])]
+        if len(intervals) < 2:
+            return "not enough sends"
+        text = (
+            f"{len(self.times)} sends, "
+            f"interval mean {statistics.mean(intervals) * 1e6:.1f} us, "
+            f"stdev {statistics.stdev(intervals) * 1e6:.1f} us, "
+            f"min {min(intervals) * 1e6:.1f} us, max {max(intervals) * 1e6:.1f} us"
+        )
+        if period:
+            errors = sorted(abs(interval - period) for interval in intervals)
+            p99 = errors[min(len(errors) - 1, int(len(errors) * 0.99))]
+            text += f", jitter p99 {p99 * 1e6:.1f} us, worst {errors[-1] * 1e6:.1f} us"
+        return text
+
+
+class ThreadWriter:
+    """Hands packets to a blocking transmitter (serial, or anything else
+    from transmitter_helper) on a thread of its own, so the event loop
+    never waits for a write. Packets that come in while a write is under
+    way go out together in the next one."""
+
+    def __init__(self, transmitter):
+        self.transmitter = transmitter
+        self.executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+        self.pending = []
+        self.busy = False
+
+    async def start(self):
+        pass
+
+    def send(self, data):
+        self.pending.append(data)
+        if not self.busy:
+            self.write_pending()
+
+    def write_pending(self):
+        packets, self.pending = self.pending, []
+        self.busy = True
+        future = asyncio.get_running_loop().run_in_executor(
+            self.executor, self.transmitter.send_many, packets
+        )
+        future.add_done_callback(self.written)
+
+    def written(self, future):
+        self.busy = False
+        if self.pending:
+            self.write_pending()
+        future.result()
+
+
+class UDPWriter:
+    """Sends datagrams through an asyncio transport, which never blocks."""
+
+    def __init__(self, transmitter):
+        self.transmitter = transmitter
+        self.transport = None
+
+    async def start(self):
+        self.transport, _ = await asyncio.get_running_loop().create_datagram_endpoint(
+            asyncio.DatagramProtocol, sock=self.transmitter.sock
+        )
+
+    def send(self, data):
+        if self.transmitter.sequence:
+            data = self.transmitter.sequenced(data)
+        self.transport.sendto(data, (self.transmitter.address, network_transmitter.PORT))
+
+
+def make_writer(transmitter):
+    if isinstance(transmitter, network_transmitter.NetworkTransmitter):
+        return UDPWriter(transmitter)
+    return ThreadWriter(transmitter)
+
+
+class Sender:
+    """Sends a device's state. Without a rate, set() sends a new packet
+    right away and an unchanged one is repeated every REPEAT_INTERVAL.
+    With a rate, the latest packet goes out on every tick of a Pacer."""
+
+    def __init__(self, writer, rate=None, spin=SPIN_THRESHOLD, log=None):
+        self.writer = writer
+        self.rate = rate
+        self.spin = spin
+        self.log = log
+        self.data = None
+        self.last_send = 0.0
+        self.loop = None
+        self.writer_ready = False
+
+    def set(self, data):
+        if data == self.data:
+            return
+        self.data = data
+        if self.rate is None and self.writer_ready:
+            self.send(time.perf_counter())
+
+    def set_threadsafe(self, data):
+        """set() for callers outside the event loop's thread."""
+        self.loop.call_soon_threadsafe(self.set, data)
+
+    def send(self, now):
+        self.writer.send(self.data)
+        self.last_send = now
+        if self.log:
+            self.log.record(now)
+
+    async def run(self):
+        self.loop = asyncio.get_running_loop()
+        await self.writer.start()
+        self.writer_ready = True
+        if self.rate:
+            pacer = Pacer(self.rate, self.spin)
+            while True:
+                await pacer.wait()
+                if self.data is not None:
+                    self.send(time.perf_counter())
+        else:
+            while True:
+                if self.data is None:
+                    # Nothing to repeat yet, set() sends the first packet.
+                    await asyncio.sleep(REPEAT_INTERVAL)
+                    continue
+                await asyncio.sleep(self.last_send + REPEAT_INTERVAL - time.perf_counter())
+                now = time.perf_counter()
+                if self.data is not None and now - self.last_send >= REPEAT_INTERVAL:
+                    self.send(now)
+
+    def start_thread(self):
+        """Runs the sender on an event loop in a background thread, for
+        programs whose main thread belongs to something else."""
+        self.loop = asyncio.new_event_loop()
+        threading.Thread(
+            target=self.loop.run_until_complete, args=(self.run(),), daemon=True
+        ).start()
+
+    def summary(self):
+        """Send timing statistics, or None without a send log."""
+        if self.log is None:
+            return None
+        return self.log.summary(1.0 / self.rate if self.rate else None)
+
+
+def get_sender():
+    """Creates a Sender for the transmitter the command line asks for."""
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--rate",
+        type=float,
+        help="Send at exactly this many packets per second, for example 1000 or 500, instead of on every change",
+    )
+    parser.add_argument(
+        "--spin",
+        type=float,
+        default=SPIN_THRESHOLD,
+        help="With --rate, busy wait for this many seconds before each send instead of trusting the OS timer (default %(default)s)",
+    )
+    parser.add_argument(
+        "--send-log",
+        help="Write the time of every send to this file and print jitter statistics on exit",
+    )
+    transmitter = transmitter_helper.get_transmitter(parser)
+    config = transmitter_helper.config
+    log = SendLog(config.send_log) if config.send_log else None
+    return Sender(make_writer(transmitter), rate=config.rate, spin=config.spin, log=log)
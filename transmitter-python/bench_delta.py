@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+
+# Compares the number of bytes that go over the wire per update with
+# protocol version 1 (full reports) and version 2 (changed bytes only).
+#
+# Traces are text files with one hex encoded version 1 packet per line, as
+# written by any of the transmitters when run with --record. Without any
+# arguments a few synthetic traces are used instead.
+
+import math
+import sys
+
+import delta_encoder
+import devices
+import slip
+
+UPDATE_INTERVAL = 0.01  # seconds, same as the sample transmitters
+
+
+def gamepad_test_trace(n=1800):
+    # Same inputs as gamepad_test.py.
+    gamepad = devices.SwitchGamepad()
+    for t in range(n):
+        gamepad.lx = int(128 + 127 * math.sin(math.pi * t / 100))
+        gamepad.ly = int(128 + 127 * math.cos(math.pi * t / 100))
+        gamepad.rx = int(128 + -127 * math.sin(math.pi * t / 100))
+        gamepad.ry = int(128 + 127 * math.cos(math.pi * t / 100))
+        gamepad.b = (t % 900) // 50 == 0
+        gamepad.a = (t % 900) // 50 == 1
+        yield gamepad.get_data()
+
+
+def buttons_only_trace(n=1800):
+    # Sticks at rest, a button press every 50 updates.
+    gamepad = devices.SwitchGamepad()
+    for t in range(n):
+        gamepad.a = (t % 50) < 10
+        gamepad.dpad_up = (t % 100) < 20
+        yield gamepad.get_data()
+
+
+def one_stick_trace(n=1800):
+    gamepad = devices.SwitchGamepad()
+    for t in range(n):
+        gamepad.lx = int(128 + 127 * math.sin(math.pi * t / 100))
+        yield gamepad.get_data()
+
+
+def mouse_test_trace(n=1800):
+    # Same inputs as mouse_test.py.
+    mouse = devices.Mouse()
+    for t in range(n):
+        mouse.x = int(4 * math.sin(math.pi * t / 100))
+        mouse.y = int(4 * math.cos(math.pi * t / 100))
+        yield mouse.get_data()
+
+
+def file_trace(filename):
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                yield bytes.fromhex(line)
+
+
+def bench(name, trace):
+    encoder = delta_encoder.DeltaEncoder()
+    updates = 0
+    v1_bytes = 0
+    v2_bytes = 0
+    keyframes = 0
+    for packet in trace:
+        frame = encoder.encode(packet, now=updates * UPDATE_INTERVAL)
+        keyframes += frame[5] & delta_encoder.DELTA_FLAG_KEYFRAME
+        v1_bytes += len(slip.encode_frame(packet))
+        v2_bytes += len(slip.encode_frame(frame))
+        updates += 1
+    if updates == 0:
+        print(f"{name:>16}: empty")
+        return
+    print(
+        f"{name:>16}: {updates:6} updates, "
+        f"v1 {v1_bytes / updates:6.2f} B/update, "
+        f"v2 {v2_bytes / updates:6.2f} B/update "
+        f"({100 * v2_bytes / v1_bytes:5.1f}%), "
+        f"{keyframes} keyframes"
+    )
+
+
+if __name__ == "__main__":
+    if len(sys.argv) > 1:
+        for filename in sys.argv[1:]:
+            bench(filename, file_trace(filename))
+    else:
+        bench("gamepad_test", gamepad_test_trace())
+        bench("buttons_only", buttons_only_trace())
+        bench("one_stick", one_stick_trace())
+        bench("mouse_test", mouse_test_trace())
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+
+# Measures what the serial link to the receiver can take at different
+# speeds. For each rate it switches the link over, sends gamepad reports
+# as fast as the port takes them and asks the receiver how many arrived
+# and how many were broken.
+#
+# Usage: bench_serial.py SERIAL_PORT [DURATION [BAUDRATE...]]
+#
+# Needs a receiver with protocol version 5 support and its TX pin (GPIO4)
+# wired to the adapter's RX.
+
+import math
+import sys
+import time
+
+import devices
+import serial_transmitter
+import slip
+
+DEFAULT_RATES = [921600, 2000000, 3000000, 4000000, 6000000]
+DEFAULT_DURATION = 2.0  # seconds per rate
+
+
+def frames():
+    gamepad = devices.SwitchGamepad()
+    t = 0
+    while True:
+        gamepad.lx = int(128 + 127 * math.sin(math.pi * t / 100))
+        gamepad.ry = int(128 + 127 * math.cos(math.pi * t / 100))
+        gamepad.a = (t % 100) < 50
+        yield gamepad.get_data()
+        t += 1
+
+
+def bench(transmitter, baudrate, duration):
+    if baudrate != transmitter.ser.baudrate and not transmitter.negotiate(baudrate):
+        print(f"{baudrate:>8}: not accepted")
+        return
+    before = transmitter.request_status()
+    if before is None:
+        print(f"{baudrate:>8}: no status")
+        return
+    sent = 0
+    wire_bytes = 0
+    start = time.monotonic()
+    for packet in frames():
+        transmitter.send(packet)
+        sent += 1
+        wire_bytes += len(slip.encode_frame(packet))
+        if sent % 64 == 0 and time.monotonic() - start >= duration:
+            break
+    elapsed = time.monotonic() - start
+    after = transmitter.request_status()
+    if after is None or after.baudrate != baudrate:
+        print(f"{baudrate:>8}: link lost, receiver fell back")
+        return
+    # The status request after the run counts as a packet too.
+    received = after.packets - before.packets - 1
+    errors = (after.crc_errors - before.crc_errors) + (
+        after.framing_errors - before.framing_errors
+    )
+    print(
+        f"{baudrate:>8}: {wire_bytes / elapsed / 1000:8.1f} kB/s, "
+        f"{sent / elapsed:8.0f} frames/s sent, "
+        f"{received / elapsed:8.0f} received, "
+        f"{100 * errors / max(sent, 1):6.3f}% errors"
+    )
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(f"usage: {sys.argv[0]} SERIAL_PORT [DURATION [BAUDRATE...]]")
+        sys.exit(1)
+    duration = float(sys.argv[2]) if len(sys.argv) > 2 else DEFAULT_DURATION
+    rates = [int(rate) for rate in sys.argv[3:]] or DEFAULT_RATES
+    transmitter = serial_transmitter.SerialTransmitter(sys.argv[1])
+    for rate in rates:
+        bench(transmitter, rate, duration)
+    transmitter.negotiate(serial_transmitter.BAUDRATE)
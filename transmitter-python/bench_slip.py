@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+# Compares how many frames per second the SLIP encoders manage: the
+# original byte at a time version, the bytes.replace() one that slip.py
+# falls back to, and the C one in _slip.c if it was built. Also times
+# encoding BATCH packets for one write against encoding them one by one.
+
+import binascii
+import timeit
+
+import devices
+import slip
+
+BATCH = 16
+DURATION = 0.5  # seconds per measurement
+
+
+def escaped_byte(b):
+    if b == slip.END:
+        return bytes((slip.ESC, slip.ESC_END))
+    elif b == slip.ESC:
+        return bytes((slip.ESC, slip.ESC_ESC))
+    else:
+        return bytes((b,))
+
+
+def bytewise_encode_frame(data):
+    # What slip.encode_frame() used to be.
+    crc = binascii.crc32(data)
+    frame = bytes((slip.END,))
+    for b in data:
+        frame += escaped_byte(b)
+    for i in range(4):
+        frame += escaped_byte((crc >> (i * 8)) & 0xFF)
+    frame += bytes((slip.END,))
+    return frame
+
+
+def packets():
+    gamepad = devices.SwitchGamepad()
+    gamepad.a = True
+    gamepad.lx = slip.END  # one byte that needs escaping
+    keyboard = devices.Keyboard()
+    keyboard.pressed = {0x04, 0x16, 0xE1}
+    return [
+        ("gamepad", gamepad.get_data()),
+        ("keyboard", keyboard.get_data()),
+        ("256 bytes", bytes(range(256))),
+    ]
+
+
+def rate(function, arg, per_call=1):
+    timer = timeit.Timer(lambda: function(arg))
+    calls, elapsed = timer.autorange()
+    calls = max(calls, int(calls * DURATION / elapsed))
+    return per_call * calls / timer.timeit(calls)
+
+
+def bench(name, data):
+    encoders = [("bytewise", bytewise_encode_frame), ("python", slip.py_encode_frame)]
+    if slip.encode_frame is not slip.py_encode_frame:
+        encoders.append(("C", slip.encode_frame))
+    results = [(encoder, rate(function, data)) for encoder, function in encoders]
+    baseline = results[0][1]
+    print(
+        f"{name:>10}: "
+        + ", ".join(
+            f"{encoder} {r / 1000:7.0f}k/s ({r / baseline:5.1f}x)"
+            for encoder, r in results
+        )
+    )
+
+
+def bench_batch(data):
+    batch = [data] * BATCH
+    one_by_one = rate(lambda b: [slip.encode_frame(p) for p in b], batch, BATCH)
+    together = rate(slip.encode_frames, batch, BATCH)
+    print(
+        f"{'batch':>10}: {BATCH} frames one by one {one_by_one / 1000:7.0f}k/s, "
+        f"in one call {together / 1000:7.0f}k/s"
+    )
+
+
+if __name__ == "__main__":
+    if slip.encode_frame is slip.py_encode_frame:
+        print("_slip not built, see setup.py")
+    for name, data in packets():
+        bench(name, data)
+    bench_batch(packets()[0][1])
@@ -0,0 +1,95 @@
+import struct
+import time
+
+PROTOCOL_VERSION_DELTA = 2
+DELTA_FLAG_KEYFRAME = 1 << 0
+
+# A lost frame is repaired by the next keyframe, whichever of these comes first.
+KEYFRAME_INTERVAL = 32
+KEYFRAME_MAX_AGE = 0.5  # seconds
+
+# Unchanged bytes shorter than this between two changes are sent as part of
+# a single run, as each run costs an offset and a count byte.
+MAX_GAP = 2
+
+
+class _State:
+    def __init__(self):
+        self.report = None
+        self.seq = 0
+        self.frames_since_keyframe = 0
+        self.keyframe_time = 0.0
+
+
+def changed_runs(prev, report):
+    runs = []
+    start = None
+    gap = 0
+    for i in range(len(report)):
+        if report[i] != prev[i]:
+            if start is None:
+                start = i
+            gap = 0
+        elif start is not None:
+            gap += 1
+            if gap > MAX_GAP:
+                runs.append((start, i - gap + 1))
+                start = None
+    if start is not None:
+        runs.append((start, len(report) - gap))
+    return runs
+
+
+class DeltaEncoder:
+    """Turns protocol version 1 packets (as returned by devices.*.get_data())
+    into version 2 frames that only carry the bytes that changed."""
+
+    def __init__(
+        self, keyframe_interval=KEYFRAME_INTERVAL, keyframe_max_age=KEYFRAME_MAX_AGE
+    ):
+        self.keyframe_interval = keyframe_interval
+        self.keyframe_max_age = keyframe_max_age
+        self.states = {}
+
+    def encode(self, packet, now=None):
+        if now is None:
+            now = time.monotonic()
+        version, descriptor, length, report_id = packet[:4]
+        if version != 1:
+            # Batched packets are passed through as they are.
+            return packet
+        report = packet[4:]
+        state = self.states.setdefault((descriptor, report_id), _State())
+        keyframe = (
+            state.report is None
+            or len(state.report) != len(report)
+            or state.frames_since_keyframe >= self.keyframe_interval
+            or now - state.keyframe_time >= self.keyframe_max_age
+        )
+        body = bytes(report)
+        if not keyframe:
+            delta = bytearray()
+            for start, end in changed_runs(state.report, report):
+                delta += bytes((start, end - start))
+                delta += report[start:end]
+            # A keyframe that's no bigger than the delta is free.
+            keyframe = len(delta) >= len(report)
+            if not keyframe:
+                body = bytes(delta)
+        if keyframe:
+            state.frames_since_keyframe = 0
+            state.keyframe_time = now
+        else:
+            state.frames_since_keyframe += 1
+        state.seq = (state.seq + 1) & 0xFF
+        state.report = bytes(report)
+        header = struct.pack(
+            "<BBBBBB",
+            PROTOCOL_VERSION_DELTA,
+            descriptor,
+            length,
+            report_id,
+            state.seq,
+            DELTA_FLAG_KEYFRAME if keyframe else 0,
+        )
+        return header + body
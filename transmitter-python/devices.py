@@ -1,9 +1,19 @@
 import struct
 
 PROTOCOL_VERSION = 1
+PROTOCOL_VERSION_BATCH = 3
 
 DPAD_LUT = [15, 6, 2, 15, 0, 7, 1, 0, 4, 5, 3, 4, 15, 6, 2, 15]
 
+# Packet layouts, compiled once instead of on every get_data().
+MOUSE_PACKET = struct.Struct("<BBBBBhhhh")
+HEADER = struct.Struct("<BBBB")
+CONSUMER_CONTROL_PACKET = struct.Struct("<BBBBB")
+SWITCH_GAMEPAD_PACKET = struct.Struct("<BBBB BBBBBBBB")
+GAMEPAD_PACKET = struct.Struct("<BBBB I hhhh HH")
+BATCH_HEADER = struct.Struct("<BBB")
+BATCH_RECORD_HEADER = struct.Struct("<BB")
+
 
 class Mouse:
     def __init__(self):
@@ -24,8 +34,7 @@ class Mouse:
             | (self.right_button << 1)
             | (self.middle_button << 2)
         )
-        data = struct.pack(
-            "<BBBBBhhhh",
+        data = MOUSE_PACKET.pack(
             PROTOCOL_VERSION,
             self.OUR_DESCRIPTOR_NUMBER,
             self.LENGTH,
@@ -39,6 +48,72 @@ class Mouse:
         return data
 
 
+class Keyboard:
+    def __init__(self):
+        self.OUR_DESCRIPTOR_NUMBER = 0
+        self.REPORT_ID = 2
+        self.LENGTH = 16
+        # HID usage codes (0x04-0x73, 0x87-0x8B, 0x90-0x91, 0xE0-0xE7 for modifiers)
+        self.pressed = set()
+
+    def get_data(self):
+        bitmap = bytearray(self.LENGTH)
+        for usage in self.pressed:
+            if 0xE0 <= usage <= 0xE7:
+                bit = usage - 0xE0
+            elif 0x04 <= usage <= 0x73:
+                bit = 8 + usage - 0x04
+            elif 0x87 <= usage <= 0x8B:
+                bit = 120 + usage - 0x87
+            elif 0x90 <= usage <= 0x91:
+                bit = 125 + usage - 0x90
+            else:
+                continue
+            bitmap[bit // 8] |= 1 << (bit % 8)
+        data = HEADER.pack(
+            PROTOCOL_VERSION,
+            self.OUR_DESCRIPTOR_NUMBER,
+            self.LENGTH,
+            self.REPORT_ID,
+        )
+        return data + bytes(bitmap)
+
+
+class ConsumerControl:
+    def __init__(self):
+        self.OUR_DESCRIPTOR_NUMBER = 0
+        self.REPORT_ID = 3
+        self.LENGTH = 1
+        self.next_track = False
+        self.previous_track = False
+        self.stop = False
+        self.play_pause = False
+        self.mute = False
+        self.volume_up = False
+        self.volume_down = False
+        self.phone_mute = False
+
+    def get_data(self):
+        buttons = (
+            (self.next_track << 0)
+            | (self.previous_track << 1)
+            | (self.stop << 2)
+            | (self.play_pause << 3)
+            | (self.mute << 4)
+            | (self.volume_up << 5)
+            | (self.volume_down << 6)
+            | (self.phone_mute << 7)
+        )
+        data = CONSUMER_CONTROL_PACKET.pack(
+            PROTOCOL_VERSION,
+            self.OUR_DESCRIPTOR_NUMBER,
+            self.LENGTH,
+            self.REPORT_ID,
+            buttons,
+        )
+        return data
+
+
 class SwitchGamepad:
     def __init__(self):
         self.OUR_DESCRIPTOR_NUMBER = 2
@@ -92,8 +167,7 @@ class SwitchGamepad:
             | (self.dpad_up << 2)
             | (self.dpad_down << 3)
         ]
-        data = struct.pack(
-            "<BBBB BBBBBBBB",
+        data = SWITCH_GAMEPAD_PACKET.pack(
             PROTOCOL_VERSION,
             self.OUR_DESCRIPTOR_NUMBER,
             self.LENGTH,
@@ -108,3 +182,126 @@ class SwitchGamepad:
             0,
         )
         return data
+
+
+# Buttons of the canonical gamepad report, in bit order. They're numbered
+# like the W3C Gamepad API's standard mapping, by position: south is B on a
+# Switch controller and cross on a PlayStation one.
+GAMEPAD_BUTTONS = [
+    "south",
+    "east",
+    "west",
+    "north",
+    "l1",
+    "r1",
+    "l2",
+    "r2",
+    "select",
+    "start",
+    "l3",
+    "r3",
+    "dpad_up",
+    "dpad_down",
+    "dpad_left",
+    "dpad_right",
+    "home",
+    "capture",
+]
+
+
+class Gamepad:
+    """Canonical gamepad report, the receiver packs it into whichever
+    gamepad it emulates (see receiver-pico/src/gamepad.h)."""
+
+    def __init__(self):
+        self.OUR_DESCRIPTOR_NUMBER = 0x80
+        self.REPORT_ID = 0
+        self.LENGTH = 16
+        for name in GAMEPAD_BUTTONS:
+            setattr(self, name, False)
+        # -32768 to 32767, positive is right/down.
+        self.lx = 0
+        self.ly = 0
+        self.rx = 0
+        self.ry = 0
+        # 0 to 65535.
+        self.left_trigger = 0
+        self.right_trigger = 0
+
+    def get_data(self):
+        buttons = 0
+        for i, name in enumerate(GAMEPAD_BUTTONS):
+            buttons |= bool(getattr(self, name)) << i
+        return GAMEPAD_PACKET.pack(
+            PROTOCOL_VERSION,
+            self.OUR_DESCRIPTOR_NUMBER,
+            self.LENGTH,
+            self.REPORT_ID,
+            buttons,
+            self.lx,
+            self.ly,
+            self.rx,
+            self.ry,
+            self.left_trigger,
+            self.right_trigger,
+        )
+
+    def to_switch(self):
+        """The same state as a Switch gamepad report, for receivers that
+        don't know the canonical one."""
+        switch = SwitchGamepad()
+        switch.b = self.south
+        switch.a = self.east
+        switch.y = self.west
+        switch.x = self.north
+        switch.l = self.l1
+        switch.r = self.r1
+        switch.zl = self.l2
+        switch.zr = self.r2
+        switch.minus = self.select
+        switch.plus = self.start
+        switch.ls = self.l3
+        switch.rs = self.r3
+        switch.home = self.home
+        switch.capture = self.capture
+        switch.dpad_left = self.dpad_left
+        switch.dpad_right = self.dpad_right
+        switch.dpad_up = self.dpad_up
+        switch.dpad_down = self.dpad_down
+        switch.lx = (self.lx >> 8) + 128
+        switch.ly = (self.ly >> 8) + 128
+        switch.rx = (self.rx >> 8) + 128
+        switch.ry = (self.ry >> 8) + 128
+        return switch
+
+
+def batch_packets(packets):
+    """Combines protocol version 1 packets for the same descriptor into one
+    version 3 packet that the receiver forwards as a whole."""
+    descriptor = packets[0][1]
+    parts = [BATCH_HEADER.pack(PROTOCOL_VERSION_BATCH, descriptor, len(packets))]
+    for packet in packets:
+        if packet[1] != descriptor:
+            raise ValueError("All packets in a batch must use the same descriptor.")
+        parts.append(BATCH_RECORD_HEADER.pack(packet[3], packet[2]))
+        parts.append(packet[4:])
+    return b"".join(parts)
+
+
+class DeviceSet:
+    """Several devices that share a descriptor, for example a Mouse, a
+    Keyboard and a ConsumerControl. get_packets() returns the packets of
+    the devices whose state changed since the last call."""
+
+    def __init__(self, *devices):
+        self.devices = devices
+        self.prev_data = [None] * len(devices)
+
+    def get_packets(self):
+        packets = []
+        for i, device in enumerate(self.devices):
+            data = device.get_data()
+            if data != self.prev_data[i]:
+                packets.append(data)
+                self.prev_data[i] = data
+        return packets
@@ -2,24 +2,34 @@
 
 import pyglet
 
+import async_transmitter
 import devices
 import transmitter_helper
 
-transmitter = transmitter_helper.get_transmitter()
+# Reports go out from the sender's own thread as soon as a controller
+# event changes them (or at a fixed --rate), pyglet keeps the main one.
+sender = async_transmitter.get_sender()
+sender.start_thread()
 
 controller_manager = pyglet.input.ControllerManager()
-for controller in controller_manager.get_controllers():
+
+
+def open_controller(controller):
     if not ("HID Receiver" in controller.device.name):
         controller.open()
-
-prev_data = bytes()
+        controller.push_handlers(
+            on_stick_motion=update,
+            on_dpad_motion=update,
+            on_trigger_motion=update,
+            on_button_press=update,
+            on_button_release=update,
+        )
 
 
 @controller_manager.event
 def on_connect(controller):
     print(f"Connected: {controller}")
-    if not ("HID Receiver" in controller.device.name):
-        controller.open()
+    open_controller(controller)
 
 
 @controller_manager.event
@@ -27,42 +37,46 @@ def on_disconnect(controller):
     print(f"Disconnected: {controller}")
 
 
-def update(dt):
-    gamepad = devices.SwitchGamepad()
+def update(*args):
+    gamepad = devices.Gamepad()
     for controller in controller_manager.get_controllers():
-        gamepad.lx += controller.leftx * 128
-        gamepad.ly += controller.lefty * 128
-        gamepad.rx += controller.rightx * 128
-        gamepad.ry += controller.righty * 128
-        gamepad.b = gamepad.b or controller.a
-        gamepad.a = gamepad.a or controller.b
-        gamepad.y = gamepad.y or controller.x
-        gamepad.x = gamepad.x or controller.y
-        gamepad.l = gamepad.l or controller.leftshoulder
-        gamepad.r = gamepad.r or controller.rightshoulder
-        gamepad.zl = gamepad.zl or (controller.lefttrigger > 0.25)
-        gamepad.zr = gamepad.zr or (controller.righttrigger > 0.25)
-        gamepad.minus = gamepad.minus or controller.back
-        gamepad.plus = gamepad.plus or controller.start
-        gamepad.ls = gamepad.ls or controller.leftstick
-        gamepad.rs = gamepad.rs or controller.rightstick
+        gamepad.lx += controller.leftx * 32767
+        gamepad.ly += controller.lefty * 32767
+        gamepad.rx += controller.rightx * 32767
+        gamepad.ry += controller.righty * 32767
+        gamepad.left_trigger += controller.lefttrigger * 65535
+        gamepad.right_trigger += controller.righttrigger * 65535
+        gamepad.south = gamepad.south or controller.a
+        gamepad.east = gamepad.east or controller.b
+        gamepad.west = gamepad.west or controller.x
+        gamepad.north = gamepad.north or controller.y
+        gamepad.l1 = gamepad.l1 or controller.leftshoulder
+        gamepad.r1 = gamepad.r1 or controller.rightshoulder
+        gamepad.l2 = gamepad.l2 or (controller.lefttrigger > 0.25)
+        gamepad.r2 = gamepad.r2 or (controller.righttrigger > 0.25)
+        gamepad.select = gamepad.select or controller.back
+        gamepad.start = gamepad.start or controller.start
+        gamepad.l3 = gamepad.l3 or controller.leftstick
+        gamepad.r3 = gamepad.r3 or controller.rightstick
         gamepad.home = gamepad.home or controller.guide
         # gamepad.capture
         gamepad.dpad_left = gamepad.dpad_left or (controller.dpadx == -1)
         gamepad.dpad_right = gamepad.dpad_right or (controller.dpadx == 1)
         gamepad.dpad_up = gamepad.dpad_up or (controller.dpady == 1)
         gamepad.dpad_down = gamepad.dpad_down or (controller.dpady == -1)
-    gamepad.lx = int(max(0, min(255, gamepad.lx)))
-    gamepad.ly = int(max(0, min(255, gamepad.ly)))
-    gamepad.rx = int(max(0, min(255, gamepad.rx)))
-    gamepad.ry = int(max(0, min(255, gamepad.ry)))
-    global prev_data
-    data = gamepad.get_data()
-    if data != prev_data:
-        transmitter.send(gamepad.get_data())
-        prev_data = data
-
+    gamepad.lx = int(max(-32768, min(32767, gamepad.lx)))
+    gamepad.ly = int(max(-32768, min(32767, gamepad.ly)))
+    gamepad.rx = int(max(-32768, min(32767, gamepad.rx)))
+    gamepad.ry = int(max(-32768, min(32767, gamepad.ry)))
+    gamepad.left_trigger = int(max(0, min(65535, gamepad.left_trigger)))
+    gamepad.right_trigger = int(max(0, min(65535, gamepad.right_trigger)))
+    sender.set_threadsafe(transmitter_helper.gamepad_data(gamepad))
 
-pyglet.clock.schedule_interval(update, 0.01)
-
-pyglet.app.run()
+for controller in controller_manager.get_controllers():
+    open_controller(controller)
+update()
+try:
+    pyglet.app.run()
+finally:
+    if sender.log:
+        print(sender.summary())
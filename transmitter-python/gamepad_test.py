@@ -7,35 +7,22 @@ import time
 import transmitter_helper
 
 transmitter = transmitter_helper.get_transmitter()
-gamepad = devices.SwitchGamepad()
+gamepad = devices.Gamepad()
 
 
 t = 0
 
 while True:
-    gamepad.lx = int(128 + 127 * math.sin(math.pi * t / 100))
-    gamepad.ly = int(128 + 127 * math.cos(math.pi * t / 100))
-    gamepad.rx = int(128 + -127 * math.sin(math.pi * t / 100))
-    gamepad.ry = int(128 + 127 * math.cos(math.pi * t / 100))
-    button = (t % 900) // 50
-    gamepad.b = button == 0
-    gamepad.a = button == 1
-    gamepad.y = button == 2
-    gamepad.x = button == 3
-    gamepad.l = button == 4
-    gamepad.r = button == 5
-    gamepad.zl = button == 6
-    gamepad.zr = button == 7
-    gamepad.minus = button == 8
-    gamepad.plus = button == 9
-    gamepad.ls = button == 10
-    gamepad.rs = button == 11
-    gamepad.home = button == 12
-    gamepad.capture = button == 13
-    gamepad.dpad_left = button == 14
-    gamepad.dpad_right = button == 15
-    gamepad.dpad_up = button == 16
-    gamepad.dpad_down = button == 17
+    gamepad.lx = int(32767 * math.sin(math.pi * t / 100))
+    gamepad.ly = int(32767 * math.cos(math.pi * t / 100))
+    gamepad.rx = int(-32767 * math.sin(math.pi * t / 100))
+    gamepad.ry = int(32767 * math.cos(math.pi * t / 100))
+    gamepad.left_trigger = int(65535 * (t % 100) / 99)
+    gamepad.right_trigger = 65535 - gamepad.left_trigger
+    # Every button in turn.
+    button = (t % (50 * len(devices.GAMEPAD_BUTTONS))) // 50
+    for i, name in enumerate(devices.GAMEPAD_BUTTONS):
+        setattr(gamepad, name, button == i)
     t += 1
-    transmitter.send(gamepad.get_data())
+    transmitter.send(transmitter_helper.gamepad_data(gamepad))
     time.sleep(0.01)
@@ -0,0 +1,28 @@
+#!/usr/bin/env python3
+
+import devices
+import math
+import time
+
+import transmitter_helper
+
+transmitter = transmitter_helper.get_transmitter()
+mouse = devices.Mouse()
+keyboard = devices.Keyboard()
+consumer = devices.ConsumerControl()
+device_set = devices.DeviceSet(mouse, keyboard, consumer)
+
+KEY_A = 0x04
+KEY_LEFT_SHIFT = 0xE1
+
+t = 0
+while True:
+    mouse.x = int(4 * math.sin(math.pi * t / 100))
+    mouse.y = int(4 * math.cos(math.pi * t / 100))
+    # Shift+A and mute pressed in the same update, so they arrive together.
+    pressed = (t % 200) < 20
+    keyboard.pressed = {KEY_LEFT_SHIFT, KEY_A} if pressed else set()
+    consumer.mute = pressed
+    t += 1
+    transmitter_helper.flush(transmitter, device_set)
+    time.sleep(0.01)
@@ -1,13 +1,47 @@
+import collections
 import socket
 import struct
+import time
 
 PORT = 42734
 
+PROTOCOL_VERSION_SEQUENCED = 4
+# The receiver takes the newest packet plus up to 7 earlier ones.
+MAX_REDUNDANCY = 7
+
 
 class NetworkTransmitter:
-    def __init__(self, address):
+    """With sequence=True every datagram gets a sequence number and a send
+    timestamp, so the receiver drops reordered and stale datagrams instead
+    of applying them late. redundancy=K also repeats the previous K packets
+    in every datagram, so a lost datagram is repaired by the next one."""
+
+    def __init__(self, address, sequence=False, redundancy=0):
+        if redundancy > MAX_REDUNDANCY:
+            raise Exception("Redundancy can't be more than {}.".format(MAX_REDUNDANCY))
         self.address = address
         self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sequence = sequence or redundancy > 0
+        self.seq = 0
+        self.history = collections.deque(maxlen=redundancy)
 
     def send(self, data):
+        if self.sequence:
+            data = self.sequenced(data)
         self.sock.sendto(data, (self.address, PORT))
+
+    def send_many(self, packets):
+        for data in packets:
+            self.send(data)
+
+    def sequenced(self, data):
+        packets = [data] + list(self.history)
+        timestamp = (time.monotonic_ns() // 1000) & 0xFFFFFFFF
+        out = struct.pack(
+            "<BBII", PROTOCOL_VERSION_SEQUENCED, len(packets), self.seq, timestamp
+        )
+        for packet in packets:
+            out += struct.pack("<H", len(packet)) + packet
+        self.history.appendleft(data)
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        return out
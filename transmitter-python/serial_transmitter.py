@@ -1,43 +1,117 @@
+import collections
 import struct
+import threading
+import time
+
 import serial
-import binascii
 
+import delta_encoder
+import slip
+
+# The receiver always starts at this rate, and goes back to it when a
+# faster one doesn't work out.
 BAUDRATE = 921600
 
-END = 0o300  # indicates end of packet
-ESC = 0o333  # indicates byte stuffing
-ESC_END = 0o334  # ESC ESC_END means END data byte
-ESC_ESC = 0o335  # ESC ESC_ESC means ESC data byte
+PROTOCOL_VERSION_LINK = 5
+LINK_COMMAND_PROPOSE = 0
+LINK_COMMAND_STATUS_REQUEST = 1
+LINK_COMMAND_STATUS = 2
+LINK_STATUS_FORMAT = "<BBIIII"
+
+# Away from the default rate the receiver sends its status every 250 ms.
+# If we don't hear it for this long, the link is assumed to be broken and
+# we fall back to the default rate.
+LINK_TIMEOUT = 1.0
+REPLY_TIMEOUT = 0.5
+
+LinkStatus = collections.namedtuple(
+    "LinkStatus", ["baudrate", "packets", "crc_errors", "framing_errors"]
+)
 
 
 class SerialTransmitter:
-    def __init__(self, device):
-        self.ser = serial.Serial(device, BAUDRATE)
-        self.buffer = bytes()
-
-    def send_raw_byte(self, b):
-        self.buffer += bytes((b,))
-
-    def flush(self):
-        self.ser.write(self.buffer)
-        self.buffer = bytes()
-
-    def send_escaped_byte(self, b):
-        if b == END:
-            self.send_raw_byte(ESC)
-            self.send_raw_byte(ESC_END)
-        elif b == ESC:
-            self.send_raw_byte(ESC)
-            self.send_raw_byte(ESC_ESC)
-        else:
-            self.send_raw_byte(b)
+    """With baudrate set to something other than BAUDRATE the speed is
+    negotiated with the receiver, which needs the receiver's TX pin (GPIO4)
+    wired to the adapter's RX. Without an answer the link stays at the
+    default rate."""
+
+    def __init__(self, device, delta=False, baudrate=BAUDRATE):
+        self.ser = serial.Serial(device, BAUDRATE, timeout=0.05)
+        self.delta_encoder = delta_encoder.DeltaEncoder() if delta else None
+        self.lock = threading.Lock()
+        self.status_changed = threading.Condition()
+        self.status = None
+        self.status_time = 0.0
+        threading.Thread(target=self.read_loop, daemon=True).start()
+        if baudrate != BAUDRATE and not self.negotiate(baudrate):
+            print("Staying at {} baud.".format(self.ser.baudrate))
 
     def send(self, data):
-        crc = binascii.crc32(data)
-        self.send_raw_byte(END)
-        for b in data:
-            self.send_escaped_byte(b)
-        for i in range(4):
-            self.send_escaped_byte((crc >> (i * 8)) & 0xFF)
-        self.send_raw_byte(END)
-        self.flush()
+        self.send_many([data])
+
+    def send_many(self, packets):
+        """Sends several packets as separate frames, in a single write."""
+        if self.delta_encoder:
+            packets = [self.delta_encoder.encode(data) for data in packets]
+        frames = slip.encode_frames(packets)
+        with self.lock:
+            if (
+                self.ser.baudrate != BAUDRATE
+                and time.monotonic() - self.status_time > LINK_TIMEOUT
+            ):
+                print("Lost the receiver at {} baud, falling back.".format(self.ser.baudrate))
+                self.ser.baudrate = BAUDRATE
+            self.ser.write(frames)
+
+    def negotiate(self, baudrate):
+        """Switches both sides to baudrate. Returns whether that worked."""
+        status = self.request(LINK_COMMAND_PROPOSE, baudrate)
+        if status is None or status.baudrate != baudrate:
+            return False
+        # The receiver only stays at the new rate once it hears from us.
+        if self.request_status() is None:
+            with self.lock:
+                self.ser.baudrate = BAUDRATE
+            return False
+        return True
+
+    def request_status(self):
+        """Returns the receiver's LinkStatus, or None if it didn't answer."""
+        return self.request(LINK_COMMAND_STATUS_REQUEST, 0)
+
+    def request(self, command, baudrate):
+        with self.status_changed:
+            sent_at = time.monotonic()
+            with self.lock:
+                self.ser.write(
+                    slip.encode_frame(struct.pack("<BBI", PROTOCOL_VERSION_LINK, command, baudrate))
+                )
+            answered = self.status_changed.wait_for(
+                lambda: self.status_time > sent_at, REPLY_TIMEOUT
+            )
+            return self.status if answered else None
+
+    def read_loop(self):
+        decoder = slip.Decoder()
+        while True:
+            try:
+                data = self.ser.read(max(1, self.ser.in_waiting))
+            except (serial.SerialException, TypeError):
+                return
+            for frame in decoder.feed(data):
+                if (
+                    len(frame) != struct.calcsize(LINK_STATUS_FORMAT)
+                    or frame[0] != PROTOCOL_VERSION_LINK
+                    or frame[1] != LINK_COMMAND_STATUS
+                ):
+                    continue
+                status = LinkStatus._make(struct.unpack(LINK_STATUS_FORMAT, frame)[2:])
+                # The receiver announces a new rate, its own or a fall back,
+                # at the old one and switches right after.
+                with self.lock:
+                    if self.ser.baudrate != status.baudrate:
+                        self.ser.baudrate = status.baudrate
+                with self.status_changed:
+                    self.status = status
+                    self.status_time = time.monotonic()
+                    self.status_changed.notify_all()
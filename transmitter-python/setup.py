@@ -0,0 +1,7 @@
+# Builds the optional C SLIP encoder next to slip.py:
+#
+#   python3 setup.py build_ext --inplace
+
+from setuptools import Extension, setup
+
+setup(name="hid-forwarder-transmitter", ext_modules=[Extension("_slip", ["_slip.c"])])
@@ -0,0 +1,75 @@
+import binascii
+import struct
+
+END = 0o300  # indicates end of packet
+ESC = 0o333  # indicates byte stuffing
+ESC_END = 0o334  # ESC ESC_END means END data byte
+ESC_ESC = 0o335  # ESC ESC_ESC means ESC data byte
+
+END_BYTES = bytes((END,))
+ESC_BYTES = bytes((ESC,))
+ESCAPED_END = bytes((ESC, ESC_END))
+ESCAPED_ESC = bytes((ESC, ESC_ESC))
+
+CRC = struct.Struct("<I")
+
+
+def escape(data):
+    # ESC first, or the ESCs put in for END would be escaped again.
+    return data.replace(ESC_BYTES, ESCAPED_ESC).replace(END_BYTES, ESCAPED_END)
+
+
+def py_encode_frame(data):
+    """Returns data with a CRC32 appended, SLIP encoded as one frame."""
+    return END_BYTES + escape(bytes(data) + CRC.pack(binascii.crc32(data))) + END_BYTES
+
+
+def py_encode_frames(packets):
+    """Returns the frames for several packets back to back, for a single write."""
+    return b"".join([py_encode_frame(packet) for packet in packets])
+
+
+# The C version in _slip.c does the same in one pass over the data. Build it
+# with "python3 setup.py build_ext --inplace", without it the pure Python
+# version above is used.
+try:
+    from _slip import encode_frame, encode_frames
+except ImportError:
+    encode_frame = py_encode_frame
+    encode_frames = py_encode_frames
+
+
+class Decoder:
+    """Splits a received byte stream into frames, the other way around from
+    encode_frame(). Frames with a bad CRC or escape are dropped."""
+
+    def __init__(self):
+        self.frame = bytearray()
+        self.escaped = False
+        self.bad = False
+
+    def feed(self, data):
+        """Returns the payloads of the frames completed by data."""
+        frames = []
+        for b in data:
+            if self.escaped:
+                self.escaped = False
+                if b == ESC_END:
+                    self.frame.append(END)
+                elif b == ESC_ESC:
+                    self.frame.append(ESC)
+                else:
+                    self.bad = True
+            elif b == ESC:
+                self.escaped = True
+            elif b == END:
+                if len(self.frame) > 4 and not self.bad:
+                    payload = bytes(self.frame[:-4])
+                    crc = int.from_bytes(self.frame[-4:], "little")
+                    if binascii.crc32(payload) == crc:
+                        frames.append(payload)
+                self.frame = bytearray()
+                self.bad = False
+            else:
+                self.frame.append(b)
+        return frames
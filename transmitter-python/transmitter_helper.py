@@ -1,10 +1,57 @@
 import argparse
 
+import devices
 
-def get_transmitter():
-    parser = argparse.ArgumentParser()
+# Whether flush() combines several reports into one packet.
+batch = False
+# Whether gamepad_data() sends canonical gamepad reports.
+canonical_gamepad = False
+# The parsed command line, including any options of the caller's parser.
+config = None
+
+
+def get_transmitter(parser=None):
+    """Creates the transmitter the command line asks for. parser can come
+    with options of the calling program already added."""
+    if parser is None:
+        parser = argparse.ArgumentParser()
     parser.add_argument("--address", help="HID Receiver IP address")
     parser.add_argument("--serial-port", help="HID Receiver serial port/device")
+    parser.add_argument(
+        "--delta",
+        action="store_true",
+        help="Only send the bytes that changed (serial, needs protocol version 2 support on the receiver)",
+    )
+    parser.add_argument(
+        "--sequence",
+        action="store_true",
+        help="Number and timestamp datagrams so the receiver drops late ones (network, needs protocol version 4 support on the receiver)",
+    )
+    parser.add_argument(
+        "--redundancy",
+        type=int,
+        default=0,
+        metavar="K",
+        help="Repeat the previous K packets in every datagram so lost ones are repaired by the next (network, implies --sequence)",
+    )
+    parser.add_argument(
+        "--baudrate",
+        type=int,
+        default=921600,
+        help="Negotiate this serial speed with the receiver, falls back to 921600 if that doesn't work (serial, needs protocol version 5 support and the receiver's TX wired up)",
+    )
+    parser.add_argument("--record", help="Also write every packet sent to this file")
+    parser.add_argument(
+        "--batch",
+        action="store_true",
+        help="Send the reports that changed together in one packet (needs protocol version 3 support on the receiver)",
+    )
+    parser.add_argument(
+        "--canonical-gamepad",
+        action="store_true",
+        help="Send canonical gamepad reports, which the receiver packs into whichever gamepad it emulates, instead of Switch gamepad ones (needs canonical gamepad support on the receiver)",
+    )
+    global config
     config = parser.parse_args()
     if not config.address and not config.serial_port:
         raise Exception("Either --address or --serial-port must be specified.")
@@ -15,8 +62,56 @@ def get_transmitter():
     if config.address:
         import network_transmitter
 
-        return network_transmitter.NetworkTransmitter(config.address)
+        transmitter = network_transmitter.NetworkTransmitter(
+            config.address, sequence=config.sequence, redundancy=config.redundancy
+        )
     if config.serial_port:
         import serial_transmitter
 
-        return serial_transmitter.SerialTransmitter(config.serial_port)
+        transmitter = serial_transmitter.SerialTransmitter(
+            config.serial_port, delta=config.delta, baudrate=config.baudrate
+        )
+    if config.record:
+        transmitter = RecordingTransmitter(transmitter, config.record)
+    global batch
+    batch = config.batch
+    global canonical_gamepad
+    canonical_gamepad = config.canonical_gamepad
+    return transmitter
+
+
+def gamepad_data(gamepad):
+    """The packet for a devices.Gamepad, in the format the command line
+    asks for."""
+    if canonical_gamepad:
+        return gamepad.get_data()
+    return gamepad.to_switch().get_data()
+
+
+def flush(transmitter, device_set):
+    """Sends everything that changed in device_set, in a single packet
+    if batching was enabled on the command line."""
+    packets = device_set.get_packets()
+    if not packets:
+        return
+    if batch and len(packets) > 1:
+        transmitter.send(devices.batch_packets(packets))
+    else:
+        transmitter.send_many(packets)
+
+
+class RecordingTransmitter:
+    """Writes one hex encoded packet per line, for bench_delta.py and friends."""
+
+    def __init__(self, transmitter, filename):
+        self.transmitter = transmitter
+        self.file = open(filename, "w", buffering=1)
+
+    def send(self, data):
+        self.file.write(data.hex() + "\n")
+        self.transmitter.send(data)
+
+    def send_many(self, packets):
+        for data in packets:
+            self.file.write(data.hex() + "\n")
+        self.transmitter.send_many(packets)
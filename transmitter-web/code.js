@@ -1,17 +1,34 @@
-import crc32 from './crc.js';
-
 const dpad_lut = [15, 6, 2, 15, 0, 7, 1, 0, 4, 5, 3, 4, 15, 6, 2, 15];
 
-const END = 0o300;     /* indicates end of packet */
-const ESC = 0o333;     /* indicates byte stuffing */
-const ESC_END = 0o334; /* ESC ESC_END means END data byte */
-const ESC_ESC = 0o335; /* ESC ESC_ESC means ESC data byte */
+// Receivers with canonical gamepad support pack those reports into whichever
+// gamepad they emulate. Older ones silently drop them, so Switch gamepad
+// reports are the default.
+const CANONICAL_DESCRIPTOR = 0x80;
+const CANONICAL_REPORT_SIZE = 16;
+const CANONICAL_BUTTONS = 18;
+const SWITCH_DESCRIPTOR = 2;
+const SWITCH_REPORT_SIZE = 8;
+
+// The receiver starts at this speed. Faster ones have to be negotiated
+// (protocol version 5), which needs its TX wired up too.
+const DEFAULT_BAUDRATE = 921600;
+
+// How often the text on the page is redrawn, it isn't needed every frame.
+const OUTPUT_INTERVAL = 250; // ms
+
+// Encoding and writing happen in worker.js, this page only reads the
+// gamepads (the Gamepad API isn't available in workers) once per frame
+// and hands over reports that changed.
+const worker = new Worker(new URL('./worker.js', import.meta.url), { type: 'module' });
 
 document.addEventListener("DOMContentLoaded", function () {
     document.getElementById("select_device").addEventListener("click", select_device);
     output = document.getElementById("output");
-    setInterval(loop, 8);
-    // loop();
+    stats_output = document.getElementById("stats");
+    delta_checkbox = document.getElementById("delta");
+    delta_checkbox.addEventListener("change", () => prev_report.fill(0xFF));
+    canonical_checkbox = document.getElementById("canonical");
+    requestAnimationFrame(loop);
 });
 
 if (!("serial" in navigator)) {
@@ -19,174 +36,194 @@ if (!("serial" in navigator)) {
 }
 
 let port = null;
-let prev_report = new Uint8Array([0, 0, 15, 0, 0, 0, 0, 0, 0]);
+const report = new Uint8Array(CANONICAL_REPORT_SIZE);
+const report_view = new DataView(report.buffer);
+let report_len = 0;
+const prev_report = new Uint8Array(CANONICAL_REPORT_SIZE);
+let prev_descriptor = null;
 let output;
+let stats_output;
+let delta_checkbox;
+let canonical_checkbox;
+let last_output_time = 0;
+let worker_stats = null;
+
+// Time between animation frames, which is how often gamepads are read.
+let last_frame_time = 0;
+let frame_interval_sum = 0;
+let frame_interval_sum_sq = 0;
+let frame_interval_max = 0;
+let frames = 0;
+
+let worker_closed = null;
+
+worker.onmessage = function (event) {
+    const msg = event.data;
+    if (msg.type == 'stats') {
+        worker_stats = msg;
+    } else if ((msg.type == 'closed') && worker_closed) {
+        worker_closed();
+    }
+};
 
 async function select_device() {
     if (port && port.connected) {
-        port.close();
+        // The worker holds the port's writable stream, it has to let go first.
+        await new Promise((resolve) => {
+            worker_closed = resolve;
+            worker.postMessage({ type: 'close' });
+        });
+        await port.close();
     }
     port = await navigator.serial.requestPort();
-    await port.open({ baudRate: 921600 });
-}
-
-let transmit_buffer = [];
-
-function ser_write(c) {
-    transmit_buffer.push(c);
-}
-
-async function flush() {
-    const writer = port.writable?.getWriter();
-    if (writer) {
-        await writer.write(new Uint8Array(transmit_buffer));
-        writer.releaseLock();
-    }
-    transmit_buffer = [];
-}
-
-function send_escaped_byte(b) {
-    switch (b) {
-        case END:
-            ser_write(ESC);
-            ser_write(ESC_END);
-            break;
-
-        case ESC:
-            ser_write(ESC);
-            ser_write(ESC_ESC);
-            break;
-
-        default:
-            ser_write(b);
-    }
-}
-
-async function send_report(report) {
-    if (!port || !port.connected) {
-        return;
-    }
-
-    let data = new Uint8Array(4 + 8 + 4);
-    data[0] = 1;
-    data[1] = 2;
-    data[2] = 8;
-    data[3] = 0
-    data.set(report, 4);
-    const crc = crc32(new DataView(data.buffer), 12);
-    data[12] = (crc >> 0) & 0xFF;
-    data[13] = (crc >> 8) & 0xFF;
-    data[14] = (crc >> 16) & 0xFF;
-    data[15] = (crc >> 24) & 0xFF;
-
-    ser_write(END);
-    for (let i = 0; i < 16; i++) {
-        send_escaped_byte(data[i]);
-    }
-    ser_write(END);
-    await flush();
+    await port.open({ baudRate: DEFAULT_BAUDRATE });
+    worker.postMessage({ type: 'port', writable: port.writable }, [port.writable]);
+    // Make sure the current state goes out even if it didn't change.
+    prev_report.fill(0xFF);
 }
 
-async function loop() {
+function loop(now) {
+    requestAnimationFrame(loop);
     try {
-        clear_output();
-        if (port && port.connected) {
-            write("CONNECTED\n\n");
-        } else {
-            write("NOT CONNECTED\n\n");
+        if (last_frame_time) {
+            const interval = now - last_frame_time;
+            frame_interval_sum += interval;
+            frame_interval_sum_sq += interval * interval;
+            frame_interval_max = Math.max(frame_interval_max, interval);
+            frames++;
+        }
+        last_frame_time = now;
+
+        const show = (now - last_output_time >= OUTPUT_INTERVAL);
+        if (show) {
+            last_output_time = now;
+            clear_output();
+            if (port && port.connected) {
+                write("CONNECTED\n\n");
+            } else {
+                write("NOT CONNECTED\n\n");
+            }
         }
 
-        let b = false;
-        let a = false;
-        let y = false;
-        let x = false;
-        let l = false;
-        let r = false;
-        let zl = false;
-        let zr = false;
-        let minus = false;
-        let plus = false;
-        let ls = false;
-        let rs = false;
-        let home = false;
-        let capture = false;
-        let dpad_left = false;
-        let dpad_right = false;
-        let dpad_up = false;
-        let dpad_down = false;
-        let lx = 128;
-        let ly = 128;
-        let rx = 128;
-        let ry = 128;
+        // Canonical gamepad report (see receiver-pico/src/gamepad.h), its
+        // buttons are numbered like the standard mapping's.
+        let buttons = 0;
+        let lx = 0;
+        let ly = 0;
+        let rx = 0;
+        let ry = 0;
+        let l2 = 0;
+        let r2 = 0;
         for (const gamepad of navigator.getGamepads()) {
             if (!gamepad) {
                 continue;
             }
-            write(gamepad.id);
-            write("\n");
+            if (show) {
+                write(gamepad.id);
+                write("\n");
+            }
             if ((gamepad.mapping == 'standard') && !gamepad.id.includes('HID Receiver')) {
-                for (const b of gamepad.buttons) {
-                    write(b.value);
-                    write(" ");
+                if (show) {
+                    for (const b of gamepad.buttons) {
+                        write(b.value);
+                        write(" ");
+                    }
+                    for (const b of gamepad.axes) {
+                        write(b);
+                        write(" ");
+                    }
+                    write("\n");
                 }
-                for (const b of gamepad.axes) {
-                    write(b);
-                    write(" ");
+                const n = Math.min(gamepad.buttons.length, CANONICAL_BUTTONS);
+                for (let i = 0; i < n; i++) {
+                    if ((i == 6) || (i == 7) ? (gamepad.buttons[i].value > 0.25) : gamepad.buttons[i].pressed) {
+                        buttons |= 1 << i;
+                    }
                 }
-                write("\n");
-                b |= gamepad.buttons[0].value;
-                a |= gamepad.buttons[1].value;
-                y |= gamepad.buttons[2].value;
-                x |= gamepad.buttons[3].value;
-                l |= gamepad.buttons[4].value;
-                r |= gamepad.buttons[5].value;
-                zl |= gamepad.buttons[6].value > 0.25;
-                zr |= gamepad.buttons[7].value > 0.25;
-                minus |= gamepad.buttons[8].value;
-                plus |= gamepad.buttons[9].value;
-                ls |= gamepad.buttons[10].value;
-                rs |= gamepad.buttons[11].value;
-                home |= gamepad.buttons[16].value;
-                dpad_up |= gamepad.buttons[12].value;
-                dpad_down |= gamepad.buttons[13].value;
-                dpad_left |= gamepad.buttons[14].value;
-                dpad_right |= gamepad.buttons[15].value;
-                lx += gamepad.axes[0] * 128;
-                ly += gamepad.axes[1] * 128;
-                rx += gamepad.axes[2] * 128;
-                ry += gamepad.axes[3] * 128;
-            } else {
+                if (gamepad.buttons.length > 7) {
+                    l2 += gamepad.buttons[6].value * 65535;
+                    r2 += gamepad.buttons[7].value * 65535;
+                }
+                lx += gamepad.axes[0] * 32767;
+                ly += gamepad.axes[1] * 32767;
+                rx += gamepad.axes[2] * 32767;
+                ry += gamepad.axes[3] * 32767;
+            } else if (show) {
                 write("IGNORED\n");
             }
-            write("\n");
+            if (show) {
+                write("\n");
+            }
         }
 
-        let report = new Uint8Array(8);
-
-        report[0] = (y << 0) | (b << 1) | (a << 2) | (x << 3) | (l << 4) | (r << 5) | (zl << 6) | (zr << 7);
-        report[1] = (minus << 0) | (plus << 1) | (ls << 2) | (rs << 3) | (home << 4) | (capture << 5);
-        report[2] = dpad_lut[(dpad_left << 0) | (dpad_right << 1) | (dpad_up << 2) | (dpad_down << 3)];
-        report[3] = Math.max(0, Math.min(255, lx));
-        report[4] = Math.max(0, Math.min(255, ly));
-        report[5] = Math.max(0, Math.min(255, rx));
-        report[6] = Math.max(0, Math.min(255, ry));
+        const descriptor = canonical_checkbox.checked ? CANONICAL_DESCRIPTOR : SWITCH_DESCRIPTOR;
+        if (descriptor == CANONICAL_DESCRIPTOR) {
+            report_view.setUint32(0, buttons, true);
+            report_view.setInt16(4, clamp(lx, -32768, 32767), true);
+            report_view.setInt16(6, clamp(ly, -32768, 32767), true);
+            report_view.setInt16(8, clamp(rx, -32768, 32767), true);
+            report_view.setInt16(10, clamp(ry, -32768, 32767), true);
+            report_view.setUint16(12, clamp(l2, 0, 65535), true);
+            report_view.setUint16(14, clamp(r2, 0, 65535), true);
+            report_len = CANONICAL_REPORT_SIZE;
+        } else {
+            const bit = (i) => (buttons >> i) & 1;
+            report[0] = (bit(2) << 0) | (bit(0) << 1) | (bit(1) << 2) | (bit(3) << 3) | (bit(4) << 4) | (bit(5) << 5) | (bit(6) << 6) | (bit(7) << 7);
+            report[1] = (bit(8) << 0) | (bit(9) << 1) | (bit(10) << 2) | (bit(11) << 3) | (bit(16) << 4) | (bit(17) << 5);
+            report[2] = dpad_lut[(bit(14) << 0) | (bit(15) << 1) | (bit(12) << 2) | (bit(13) << 3)];
+            report[3] = clamp(128 + lx / 256, 0, 255);
+            report[4] = clamp(128 + ly / 256, 0, 255);
+            report[5] = clamp(128 + rx / 256, 0, 255);
+            report[6] = clamp(128 + ry / 256, 0, 255);
+            report[7] = 0;
+            report_len = SWITCH_REPORT_SIZE;
+        }
 
-        write("OUTPUT\n");
-        for (let i = 0; i < 8; i++) {
-            write(report[i].toString(16).padStart(2, '0'));
-            write(" ");
+        if (show) {
+            write("OUTPUT\n");
+            for (let i = 0; i < report_len; i++) {
+                write(report[i].toString(16).padStart(2, '0'));
+                write(" ");
+            }
+            write("\n");
+            show_stats();
         }
-        write("\n");
 
-        if (!reports_equal(prev_report, report)) {
-            await send_report(report);
-            prev_report = report;
+        if (port && port.connected && ((descriptor != prev_descriptor) || !reports_equal(prev_report, report, report_len))) {
+            worker.postMessage({
+                type: 'report',
+                descriptor: descriptor,
+                report: report.subarray(0, report_len),
+                delta: delta_checkbox.checked,
+            });
+            prev_report.set(report);
+            prev_descriptor = descriptor;
         }
     } catch (e) {
         console.log(e);
     }
+}
 
-    // requestAnimationFrame(loop);
+function show_stats() {
+    let text = "";
+    if (frames >= 2) {
+        const mean = frame_interval_sum / frames;
+        const stdev = Math.sqrt(Math.max(0, frame_interval_sum_sq / frames - mean * mean));
+        text += `gamepad poll: every ${mean.toFixed(2)} ms, jitter ${stdev.toFixed(2)} ms, max ${frame_interval_max.toFixed(2)} ms\n`;
+    }
+    frame_interval_sum = 0;
+    frame_interval_sum_sq = 0;
+    frame_interval_max = 0;
+    frames = 0;
+    if (worker_stats && worker_stats.connected) {
+        const s = worker_stats;
+        text += `sent: ${s.sends_per_second.toFixed(1)} frames/s, ${s.bytes_per_second.toFixed(0)} B/s`;
+        if (s.interval_mean > 0) {
+            text += `, every ${s.interval_mean.toFixed(2)} ms, jitter ${s.interval_stdev.toFixed(2)} ms, max ${s.interval_max.toFixed(2)} ms`;
+        }
+        text += `, ${s.write_errors} write errors\n`;
+    }
+    stats_output.innerText = text;
 }
 
 function write(s) {
@@ -197,14 +234,15 @@ function clear_output() {
     output.innerHTML = '';
 }
 
-function reports_equal(a, b) {
-    if (a.length != b.length) {
-        return false;
-    }
-    for (let i = 0; i < a.length; i++) {
+function clamp(value, min, max) {
+    return Math.max(min, Math.min(max, value));
+}
+
+function reports_equal(a, b, len) {
+    for (let i = 0; i < len; i++) {
         if (a[i] != b[i]) {
             return false;
         }
     }
     return true;
-}
\ No newline at end of file
+}
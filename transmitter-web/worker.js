@@ -0,0 +1,263 @@
+// Encodes reports into SLIP frames and writes them to the serial port,
+// away from the page's main thread. Background tabs throttle the page's
+// timers, but not a worker's, so the repeats still go out on time.
+//
+// Messages in:
+//   { type: 'port', writable }       the port's WritableStream, transferred
+//   { type: 'close' }                release it, answered with 'closed'
+//   { type: 'report', descriptor, report, delta }
+//                                    a new gamepad report
+// Messages out:
+//   { type: 'closed' }
+//   { type: 'stats', ... }           every STATS_INTERVAL ms
+
+import crc32 from './crc.js';
+
+const END = 0o300;     /* indicates end of packet */
+const ESC = 0o333;     /* indicates byte stuffing */
+const ESC_END = 0o334; /* ESC ESC_END means END data byte */
+const ESC_ESC = 0o335; /* ESC ESC_ESC means ESC data byte */
+
+const PROTOCOL_VERSION = 1;
+const PROTOCOL_VERSION_DELTA = 2;
+const DELTA_FLAG_KEYFRAME = 1 << 0;
+const KEYFRAME_INTERVAL = 32;
+const KEYFRAME_MAX_AGE = 500; // ms
+
+const REPORT_ID = 0;
+const MAX_REPORT_SIZE = 64;
+
+// The receiver only merges our state with other senders' while we've sent
+// something within the last second, so an unchanged state is repeated.
+const REPEAT_INTERVAL = 250; // ms
+const STATS_INTERVAL = 500; // ms
+const SEND_LOG_SIZE = 1024;
+
+// Everything a frame is built in is allocated once, up front.
+const report = new Uint8Array(MAX_REPORT_SIZE);
+let report_len = 0;
+let descriptor_number = 0;
+let delta = false;
+const packet = new Uint8Array(6 + 2 * MAX_REPORT_SIZE + 4);
+const packet_view = new DataView(packet.buffer);
+const frame = new Uint8Array(2 * packet.length + 2);
+
+// State of the receiver's copy of our report, for protocol version 2.
+const delta_prev_report = new Uint8Array(MAX_REPORT_SIZE);
+let delta_valid = false;
+let delta_seq = 0;
+let delta_frames_since_keyframe = 0;
+let delta_keyframe_time = 0;
+
+let writer = null;
+let writing = false;
+let dirty = false;
+let repeat_timer = null;
+
+// Ring of send times, for the jitter readout.
+const send_times = new Float64Array(SEND_LOG_SIZE);
+let sends = 0;
+let bytes_sent = 0;
+let write_errors = 0;
+
+function encode_packet() {
+    packet[0] = PROTOCOL_VERSION;
+    packet[1] = descriptor_number;
+    packet[2] = report_len;
+    packet[3] = REPORT_ID;
+    packet.set(report.subarray(0, report_len), 4);
+    return 4 + report_len;
+}
+
+// Only the bytes that changed since the last report, as (offset, count, bytes) runs.
+function encode_delta_packet(now) {
+    let keyframe = !delta_valid ||
+        (delta_frames_since_keyframe >= KEYFRAME_INTERVAL) ||
+        (now - delta_keyframe_time >= KEYFRAME_MAX_AGE);
+    let len = 6;
+    if (!keyframe) {
+        let i = 0;
+        while (i < report_len) {
+            if (report[i] == delta_prev_report[i]) {
+                i++;
+                continue;
+            }
+            let start = i;
+            let end = i + 1;
+            // Short gaps of unchanged bytes are cheaper to send than a new run.
+            for (let j = end; j < report_len && j <= end + 2; j++) {
+                if (report[j] != delta_prev_report[j]) {
+                    end = j + 1;
+                }
+            }
+            packet[len++] = start;
+            packet[len++] = end - start;
+            for (let k = start; k < end; k++) {
+                packet[len++] = report[k];
+            }
+            i = end;
+        }
+        if (len - 6 >= report_len) {
+            keyframe = true;
+        }
+    }
+    if (keyframe) {
+        packet.set(report.subarray(0, report_len), 6);
+        len = 6 + report_len;
+        delta_frames_since_keyframe = 0;
+        delta_keyframe_time = now;
+    } else {
+        delta_frames_since_keyframe++;
+    }
+    delta_seq = (delta_seq + 1) & 0xFF;
+    delta_prev_report.set(report.subarray(0, report_len));
+    delta_valid = true;
+
+    packet[0] = PROTOCOL_VERSION_DELTA;
+    packet[1] = descriptor_number;
+    packet[2] = report_len;
+    packet[3] = REPORT_ID;
+    packet[4] = delta_seq;
+    packet[5] = keyframe ? DELTA_FLAG_KEYFRAME : 0;
+    return len;
+}
+
+function put_escaped(pos, b) {
+    if (b == END) {
+        frame[pos++] = ESC;
+        frame[pos++] = ESC_END;
+    } else if (b == ESC) {
+        frame[pos++] = ESC;
+        frame[pos++] = ESC_ESC;
+    } else {
+        frame[pos++] = b;
+    }
+    return pos;
+}
+
+function encode_frame(now) {
+    const len = delta ? encode_delta_packet(now) : encode_packet();
+    const crc = crc32(packet_view, len);
+    let pos = 0;
+    frame[pos++] = END;
+    for (let i = 0; i < len; i++) {
+        pos = put_escaped(pos, packet[i]);
+    }
+    for (let i = 0; i < 4; i++) {
+        pos = put_escaped(pos, (crc >>> (i * 8)) & 0xFF);
+    }
+    frame[pos++] = END;
+    return pos;
+}
+
+// Only one write is in flight at a time. A report that changes during it
+// is sent once it's done, so the port never falls behind the gamepad.
+async function send() {
+    if (!writer || (report_len == 0)) {
+        return;
+    }
+    if (writing) {
+        dirty = true;
+        return;
+    }
+    writing = true;
+    do {
+        dirty = false;
+        const now = performance.now();
+        const len = encode_frame(now);
+        send_times[sends % SEND_LOG_SIZE] = now;
+        sends++;
+        bytes_sent += len;
+        try {
+            await writer.write(frame.subarray(0, len));
+        } catch (e) {
+            write_errors++;
+            console.log(e);
+            break;
+        }
+    } while (dirty && writer);
+    writing = false;
+    schedule_repeat();
+}
+
+function schedule_repeat() {
+    clearTimeout(repeat_timer);
+    repeat_timer = setTimeout(send, REPEAT_INTERVAL);
+}
+
+let stats_sends = 0;
+let stats_bytes = 0;
+let stats_time = performance.now();
+
+function post_stats() {
+    const now = performance.now();
+    const n = Math.min(sends - stats_sends, SEND_LOG_SIZE);
+    let mean = 0;
+    let jitter = 0;
+    let max = 0;
+    if (n >= 3) {
+        // Intervals between the sends since the last readout.
+        let sum = 0;
+        let sum_sq = 0;
+        for (let i = sends - n + 1; i < sends; i++) {
+            const interval = send_times[i % SEND_LOG_SIZE] - send_times[(i - 1) % SEND_LOG_SIZE];
+            sum += interval;
+            sum_sq += interval * interval;
+            max = Math.max(max, interval);
+        }
+        mean = sum / (n - 1);
+        jitter = Math.sqrt(Math.max(0, sum_sq / (n - 1) - mean * mean));
+    }
+    const elapsed = (now - stats_time) / 1000;
+    self.postMessage({
+        type: 'stats',
+        connected: writer != null,
+        sends_per_second: (sends - stats_sends) / elapsed,
+        bytes_per_second: (bytes_sent - stats_bytes) / elapsed,
+        interval_mean: mean,
+        interval_stdev: jitter,
+        interval_max: max,
+        write_errors: write_errors,
+    });
+    stats_sends = sends;
+    stats_bytes = bytes_sent;
+    stats_time = now;
+}
+
+self.onmessage = async function (event) {
+    const msg = event.data;
+    switch (msg.type) {
+        case 'port':
+            writer = msg.writable.getWriter();
+            delta_valid = false;
+            send();
+            break;
+
+        case 'close':
+            clearTimeout(repeat_timer);
+            if (writer) {
+                const w = writer;
+                writer = null;
+                try {
+                    await w.close();
+                } catch (e) {
+                    console.log(e);
+                }
+            }
+            self.postMessage({ type: 'closed' });
+            break;
+
+        case 'report':
+            if ((msg.delta != delta) || (msg.descriptor != descriptor_number)) {
+                delta = msg.delta;
+                descriptor_number = msg.descriptor;
+                delta_valid = false;
+            }
+            report_len = Math.min(msg.report.length, MAX_REPORT_SIZE);
+            report.set(msg.report.subarray(0, report_len));
+            send();
+            break;
+    }
+};
+
+setInterval(post_stats, STATS_INTERVAL);